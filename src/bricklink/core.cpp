@@ -476,6 +476,16 @@ void Core::setUpdateIntervals(const QMap<QByteArray, int> &intervals)
 #endif
 }
 
+void Core::setDiskCacheLimits(const QMap<QByteArray, int> &limits)
+{
+#if !defined(BS_BACKEND)
+    m_pictureCache->setDiskCacheLimit(qint64(limits["Picture"]) * 1'000'000);
+    m_priceGuideCache->setDiskCacheLimit(qint64(limits["PriceGuide"]) * 1'000'000);
+#else
+    Q_UNUSED(limits)
+#endif
+}
+
 QString Core::countryIdFromName(const QString &name) const
 {
     // BrickLink doesn't use the standard ISO country names...
@@ -741,45 +751,43 @@ const Category *Core::category(uint id) const
     return nullptr;
 }
 
-const Color *Core::color(uint id) const
+// The hash indexes are built after loading a database. While the database is being built by
+// the TextImport however, we have to fall back to a binary search on the sorted vectors.
+template<typename T>
+static const T *lookupById(const std::vector<T> &container, const HashIndex &index, uint id)
 {
-    auto it = std::lower_bound(colors().cbegin(), colors().cend(), id);
-    if ((it != colors().cend()) && (*it == id))
+    if (!index.isEmpty()) {
+        auto i = index.find(qHash(id), [&container, id](quint32 i) {
+            return container[i].id() == id;
+        });
+        return (i >= 0) ? &container[size_t(i)] : nullptr;
+    }
+    auto it = std::lower_bound(container.cbegin(), container.cend(), id);
+    if ((it != container.cend()) && (it->id() == id))
         return &(*it);
     return nullptr;
 }
 
+const Color *Core::color(uint id) const
+{
+    return lookupById(colors(), m_database->m_colorIndex, id);
+}
+
 const Color *Core::colorFromName(const QString &name) const
 {
     if (name.isEmpty())
         return nullptr;
 
-    auto it = std::find_if(colors().cbegin(), colors().cend(), [name](const auto &color) {
-        return !color.name().compare(name, Qt::CaseInsensitive);
+    auto i = m_database->m_colorNameIndex.find(Database::caseFoldedHash(name), [this, &name](quint32 i) {
+        return !colors()[i].name().compare(name, Qt::CaseInsensitive);
     });
-    if (it != colors().cend())
-        return &(*it);
-    return nullptr;
+    return (i >= 0) ? &colors()[size_t(i)] : nullptr;
 }
 
 
 const Color *Core::colorFromLDrawId(int ldrawId) const
 {
-    auto it = std::find_if(colors().cbegin(), colors().cend(), [ldrawId](const auto &color) {
-        return (color.ldrawId() == ldrawId);
-    });
-    if (it != colors().cend())
-        return &(*it);
-
-    const auto &extraColors = m_database->m_ldrawExtraColors;
-
-    it = std::find_if(extraColors.cbegin(), extraColors.cend(), [ldrawId](const auto &color) {
-        return (color.ldrawId() == ldrawId);
-    });
-    if (it != extraColors.cend())
-        return &(*it);
-
-    return nullptr;
+    return m_database->m_colorLDrawIdIndex.value(ldrawId);
 }
 
 
@@ -791,32 +799,39 @@ const ItemType *Core::itemType(char id) const
     return nullptr;
 }
 
-const Item *Core::item(char tid, const QByteArray &id) const
+const Item *Core::item(char tid, QByteArrayView id) const
 {
-    auto needle = std::make_pair(tid, id);
+    const auto &index = m_database->m_itemIndex;
+
+    if (!index.isEmpty()) {
+        auto i = index.find(Database::itemHash(tid, id), [this, tid, id](quint32 i) {
+            const Item &item = items()[i];
+            const QByteArray itemId = item.id(); // raw data, does not allocate
+            return (item.itemTypeId() == tid) && (itemId.size() == id.size())
+                    && (id.compare(itemId) == 0);
+        });
+        return (i >= 0) ? &items()[size_t(i)] : nullptr;
+    }
+
+    auto needle = std::make_pair(tid, QByteArray::fromRawData(id.data(), id.size()));
     auto it = std::lower_bound(items().cbegin(), items().cend(), needle);
     if ((it != items().cend()) && (*it == needle))
         return &(*it);
     return nullptr;
 }
 
-const Item *Core::item(const std::string &tids, const QByteArray &id) const
+const Item *Core::item(const std::string &tids, QByteArrayView id) const
 {
     for (const char &tid : tids) {
-        auto needle = std::make_pair(tid, id);
-        auto it = std::lower_bound(items().cbegin(), items().cend(), needle);
-        if ((it != items().cend()) && (*it == needle))
-            return &(*it);
+        if (auto it = item(tid, id))
+            return it;
     }
     return nullptr;
 }
 
 const PartColorCode *Core::partColorCode(uint id)
 {
-    auto it = std::lower_bound(pccs().cbegin(), pccs().cend(), id);
-    if ((it != pccs().cend()) && (*it == id))
-        return &(*it);
-    return nullptr;
+    return lookupById(pccs(), m_database->m_pccIndex, id);
 }
 
 const Relationship *Core::relationship(uint id)
@@ -829,10 +844,7 @@ const Relationship *Core::relationship(uint id)
 
 const RelationshipMatch *Core::relationshipMatch(uint id)
 {
-    auto it = std::lower_bound(relationshipMatches().cbegin(), relationshipMatches().cend(), id);
-    if ((it != relationshipMatches().cend()) && (it->id() == id))
-        return &(*it);
-    return nullptr;
+    return lookupById(relationshipMatches(), m_database->m_relationshipMatchIndex, id);
 }
 
 void Core::cancelTransfers()
@@ -921,7 +933,8 @@ uint Core::applyColorChangeLog(uint colorId, uint startAtChangelogId, const QDat
     return colorId;
 }
 
-Core::ResolveResult Core::resolveIncomplete(Lot *lot, uint startAtChangelogId, const QDateTime &creationTime)
+Core::ResolveResult Core::resolveIncomplete(Lot *lot, uint startAtChangelogId, const QDateTime &creationTime,
+                                             ResolveCache *cache)
 {
     // How to apply changelog entries:
     //  * if startAtChangelogId > 0, use it
@@ -943,20 +956,25 @@ Core::ResolveResult Core::resolveIncomplete(Lot *lot, uint startAtChangelogId, c
     bool tryToResolveItem = (itemTypeAndId.size() > 1) && itemTypeAndId.at(0);
     bool tryToResolveColor = (colorId != Color::InvalidId);
 
-    if (startAtChangelogId || creationTime.isValid()) {
-        if (tryToResolveItem)
-            resolvedItemTypeAndId = applyItemChangeLog(itemTypeAndId, startAtChangelogId, creationTime.date());
-        if (tryToResolveColor)
-            resolvedColorId = applyColorChangeLog(colorId, startAtChangelogId, creationTime.date());
-    }
-
+    const bool applyChangeLog = (startAtChangelogId || creationTime.isValid());
     const Item *item = nullptr;
     const Color *color = nullptr;
 
-    if (tryToResolveItem)
+    // failed lookups are not cached: they are rare and we want the warnings for each of them
+    if (tryToResolveItem && !(cache && cache->findItem(itemTypeAndId, item, resolvedItemTypeAndId))) {
+        if (applyChangeLog)
+            resolvedItemTypeAndId = applyItemChangeLog(itemTypeAndId, startAtChangelogId, creationTime.date());
         item = core()->item(resolvedItemTypeAndId.at(0), resolvedItemTypeAndId.mid(1));
-    if (tryToResolveColor)
+        if (item && cache)
+            cache->insertItem(itemTypeAndId, item, resolvedItemTypeAndId);
+    }
+    if (tryToResolveColor && !(cache && cache->findColor(colorId, color, resolvedColorId))) {
+        if (applyChangeLog)
+            resolvedColorId = applyColorChangeLog(colorId, startAtChangelogId, creationTime.date());
         color = core()->color(resolvedColorId);
+        if (color && cache)
+            cache->insertColor(colorId, color, resolvedColorId);
+    }
 
     if (item)
         lot->setItem(item);
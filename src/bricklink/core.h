@@ -5,6 +5,7 @@
 
 #include <vector>
 #include <memory>
+#include <tuple>
 
 #include <QtCore/QDateTime>
 #include <QtCore/QString>
@@ -14,6 +15,7 @@
 #include <QtCore/QPair>
 #include <QtCore/QUrl>
 #include <QtCore/QThreadPool>
+#include <QtCore/QReadWriteLock>
 #include <QtGui/QImage>
 #include <QtGui/QIcon>
 
@@ -33,6 +35,50 @@ namespace BrickLink {
 
 class QmlBrickLink;
 
+/* Remembers what item and color ids were resolved to by Core::resolveIncomplete(), so that
+ * big documents only have to look up (and apply the change-log to) every distinct id once.
+ * The results depend on the change-log starting point, so a cache must only be used for
+ * one document. It can be shared by multiple parser threads.
+ */
+class ResolveCache
+{
+public:
+    bool findItem(const QByteArray &itemTypeAndId, const Item *&item, QByteArray &resolvedItemTypeAndId) const
+    {
+        QReadLocker locker(&m_lock);
+        auto it = m_items.constFind(itemTypeAndId);
+        if (it == m_items.cend())
+            return false;
+        std::tie(item, resolvedItemTypeAndId) = *it;
+        return true;
+    }
+    void insertItem(const QByteArray &itemTypeAndId, const Item *item, const QByteArray &resolvedItemTypeAndId)
+    {
+        QWriteLocker locker(&m_lock);
+        m_items.insert(itemTypeAndId, { item, resolvedItemTypeAndId });
+    }
+
+    bool findColor(uint colorId, const Color *&color, uint &resolvedColorId) const
+    {
+        QReadLocker locker(&m_lock);
+        auto it = m_colors.constFind(colorId);
+        if (it == m_colors.cend())
+            return false;
+        std::tie(color, resolvedColorId) = *it;
+        return true;
+    }
+    void insertColor(uint colorId, const Color *color, uint resolvedColorId)
+    {
+        QWriteLocker locker(&m_lock);
+        m_colors.insert(colorId, { color, resolvedColorId });
+    }
+
+private:
+    mutable QReadWriteLock m_lock;
+    QHash<QByteArray, std::pair<const Item *, QByteArray>> m_items;
+    QHash<uint, std::pair<const Color *, uint>> m_colors;
+};
+
 
 class Core : public QObject
 {
@@ -96,8 +142,8 @@ public:
     const Color *colorFromLDrawId(int ldrawId) const;
     const Category *category(uint id) const;
     const ItemType *itemType(char id) const;
-    const Item *item(char tid, const QByteArray &id) const;
-    const Item *item(const std::string &tids, const QByteArray &id) const;
+    const Item *item(char tid, QByteArrayView id) const;
+    const Item *item(const std::string &tids, QByteArrayView id) const;
 
     const PartColorCode *partColorCode(uint id);
 
@@ -115,7 +161,8 @@ public:
     static QString itemHtmlDescription(const Item *item, const Color *color, const QColor &highlight);
 
     enum class ResolveResult { Fail, Direct, ChangeLog };
-    ResolveResult resolveIncomplete(Lot *lot, uint startAtChangelogId, const QDateTime &creationTime);
+    ResolveResult resolveIncomplete(Lot *lot, uint startAtChangelogId, const QDateTime &creationTime,
+                                    ResolveCache *cache = nullptr);
 
     static const QVector<ApiQuirk> knownApiQuirks();
     bool isApiQuirkEnabled(ApiQuirk apiQuirk);
@@ -125,6 +172,7 @@ public:
 
 public slots:
     void setUpdateIntervals(const QMap<QByteArray, int> &intervals);
+    void setDiskCacheLimits(const QMap<QByteArray, int> &limits);
 
     void cancelTransfers();
 
@@ -3,6 +3,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <bit>
 
 #include <QFile>
 #include <QBuffer>
@@ -12,6 +13,10 @@
 #include <QDirIterator>
 #include <QDebug>
 #include <QScopeGuard>
+#include <QtEndian>
+#include <QMutex>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 #include "utility/stopwatch.h"
 #include "utility/chunkreader.h"
@@ -28,6 +33,103 @@
 
 namespace BrickLink {
 
+static constexpr quint32 NoHeapOffset = 0xffffffff;
+
+struct Database::HeapWriter
+{
+    QByteArray data;
+
+    template<typename T> quint32 add(const PooledArray<T> &pa)
+    {
+        if (pa.isEmpty())
+            return NoHeapOffset;
+
+        data.append(qsizetype((alignof(T) - size_t(data.size()) % alignof(T)) % alignof(T)), '\0');
+        const auto offset = data.size();
+        data.append(static_cast<const char *>(pa.rawData()), pa.rawDataSize());
+        if (data.size() >= qsizetype(NoHeapOffset))
+            throw Exception("the database heap is larger than 4GB");
+        return quint32(offset);
+    }
+};
+
+struct Database::MappedHeap
+{
+    const char *data = nullptr;
+    quint32 size = 0;
+
+    template<typename T> void map(PooledArray<T> &pa, quint32 offset) const
+    {
+        if (offset == NoHeapOffset)
+            return;
+
+        if ((offset % alignof(T)) || ((quint64(offset) + sizeof(T)) > size))
+            throw Exception("invalid heap offset %1 in database").arg(offset);
+
+        const auto s = *reinterpret_cast<const typename PooledArray<T>::SizeType *>(data + offset);
+        if ((s <= 0) || ((quint64(offset) + (quint64(s) + 1) * sizeof(T)) > size))
+            throw Exception("invalid heap array at offset %1 in database").arg(offset);
+
+        pa.setRawData(data + offset);
+    }
+};
+
+struct Database::ColorRecord
+{
+    enum ValidColorFlag : quint32 {
+        ValidColor          = 0x01,
+        ValidLDrawColor     = 0x02,
+        ValidLDrawEdgeColor = 0x04,
+        ValidParticleColor  = 0x08,
+    };
+
+    quint32_le id;
+    quint32_le name;
+    qint32_le  ldrawId;
+    quint32_le type;
+    quint32_le popularity;        // float bits
+    quint16_le yearFrom;
+    quint16_le yearTo;
+    quint32_le luminance;         // float bits
+    quint32_le particleMinSize;   // float bits
+    quint32_le particleMaxSize;   // float bits
+    quint32_le particleFraction;  // float bits
+    quint32_le particleVFraction; // float bits
+    quint32_le validColors;
+    quint64_le color;             // QRgba64
+    quint64_le ldrawColor;        // QRgba64
+    quint64_le ldrawEdgeColor;    // QRgba64
+    quint64_le particleColor;     // QRgba64
+};
+
+struct Database::CategoryRecord
+{
+    quint32_le id;
+    quint32_le name;
+    quint8     yearFrom;
+    quint8     yearTo;
+    quint8     yearRecency;
+    quint8     hasInventories;
+};
+
+struct Database::ItemRecord
+{
+    quint32_le id;
+    quint32_le name;
+    quint32_le categoryIndexes;
+    quint32_le knownColorIndexes;
+    quint32_le appearsIn;
+    quint32_le consistsOf;
+    quint32_le relationshipMatchIds;
+    quint32_le dimensions;
+    quint16_le itemTypeIndex;
+    quint16_le defaultColorIndex;
+    quint8     yearFrom;
+    quint8     yearTo;
+    quint8     reserved[2];
+    quint32_le weight;            // float bits
+};
+
 Database::Database(const QString &updateUrl, QObject *parent)
     : QObject(parent)
     , m_updateUrl(updateUrl)
@@ -124,6 +226,7 @@ void Database::setUpdateStatus(UpdateStatus updateStatus)
 
 void Database::clear()
 {
+    stopItemSearchIndex();
     m_colors.clear();
     m_ldrawExtraColors.clear();
     m_itemTypes.clear();
@@ -132,7 +235,115 @@ void Database::clear()
     m_pccs.clear();
     m_itemChangelog.clear();
     m_colorChangelog.clear();
-    m_pool.reset();
+    m_itemIndex.clear();
+    m_colorIndex.clear();
+    m_pccIndex.clear();
+    m_relationshipMatchIndex.clear();
+    m_colorNameIndex.clear();
+    m_colorLDrawIdIndex.clear();
+    m_pools.clear();
+    m_mappedData.clear();
+    m_mappedFile.reset();
+}
+
+void Database::buildIndexes()
+{
+    m_itemIndex.build(m_items, [this](const Item &item) {
+        const char itemTypeId = (item.m_itemTypeIndex < m_itemTypes.size())
+                ? m_itemTypes[item.m_itemTypeIndex].id() : 0;
+        return itemHash(itemTypeId, item.id());
+    });
+    m_colorIndex.build(m_colors, [](const Color &color) { return qHash(color.id()); });
+    m_pccIndex.build(m_pccs, [](const PartColorCode &pcc) { return qHash(pcc.id()); });
+    m_relationshipMatchIndex.build(m_relationshipMatches, [](const RelationshipMatch &match) {
+        return qHash(match.id());
+    });
+    m_colorNameIndex.build(m_colors, [](const Color &color) { return caseFoldedHash(color.name()); });
+
+    // the BrickLink colors take precedence over the extra LDraw colors
+    m_colorLDrawIdIndex.clear();
+    for (const auto *colors : { &m_colors, &m_ldrawExtraColors }) {
+        for (const Color &color : *colors) {
+            if (!m_colorLDrawIdIndex.contains(color.ldrawId()))
+                m_colorLDrawIdIndex.insert(color.ldrawId(), &color);
+        }
+    }
+
+//#define BS_BENCHMARK_LOOKUPS
+#if defined(BS_BENCHMARK_LOOKUPS)
+    // resolve every single item by type and id, just like loading a huge document would
+    std::vector<std::pair<char, QByteArray>> needles;
+    needles.reserve(m_items.size());
+    for (const Item &item : m_items)
+        needles.emplace_back(item.itemTypeId(), item.id());
+
+    size_t found = 0;
+    {
+        stopwatch sw("Item lookups via binary search");
+        for (const auto &needle : needles)
+            found += std::binary_search(m_items.cbegin(), m_items.cend(), needle) ? 1 : 0;
+    }
+    {
+        stopwatch sw("Item lookups via hash index");
+        for (const auto &needle : needles)
+            found += core()->item(needle.first, needle.second) ? 1 : 0;
+    }
+    qInfo() << "Looked up" << found << "of" << (2 * needles.size()) << "items. Index memory:"
+            << (m_itemIndex.memoryUsage() + m_colorIndex.memoryUsage() + m_pccIndex.memoryUsage()
+                + m_relationshipMatchIndex.memoryUsage()) << "bytes";
+#endif
+}
+
+void Database::startItemSearchIndex(const QString &databaseFileName, const QDateTime &generationDate)
+{
+    // The index is only needed once the user searches for items: build it in the background,
+    // or load it from the cache next to the database, if that is still up-to-date.
+    stopItemSearchIndex();
+    m_itemSearchIndexCanceled = false;
+
+    m_itemSearchIndexFuture = QtConcurrent::run(QThreadPool::globalInstance(),
+                                                [this, databaseFileName, generationDate]() {
+        const QString cacheFileName = databaseFileName + u".search";
+        auto index = std::make_shared<ItemSearchIndex>();
+
+        if (!index->load(cacheFileName, generationDate, m_items.size())) {
+            stopwatch sw("Building the item search index");
+
+            if (!index->build(m_items, qsizetype(m_categories.size()),
+                              [this]() { return m_itemSearchIndexCanceled.load(); })) {
+                return;
+            }
+            if (!index->save(cacheFileName, generationDate))
+                qWarning() << "Could not save the item search index to" << cacheFileName;
+        }
+        QMutexLocker locker(&m_itemSearchIndexMutex);
+        m_itemSearchIndex = index;
+    });
+}
+
+void Database::stopItemSearchIndex()
+{
+    // the background task references m_items, so it has to be finished before they change
+    m_itemSearchIndexCanceled = true;
+    m_itemSearchIndexFuture.waitForFinished();
+
+    QMutexLocker locker(&m_itemSearchIndexMutex);
+    m_itemSearchIndex.reset();
+}
+
+std::shared_ptr<const ItemSearchIndex> Database::itemSearchIndex() const
+{
+    QMutexLocker locker(&m_itemSearchIndexMutex);
+    return m_itemSearchIndex;
+}
+
+size_t Database::caseFoldedHash(QStringView str)
+{
+    // this has to match QString::compare(..., Qt::CaseInsensitive), without allocating
+    size_t h = 0;
+    for (const QChar &c : str)
+        h = 31 * h + c.toCaseFolded().unicode();
+    return qHash(h);
 }
 
 bool Database::startUpdate()
@@ -192,17 +403,29 @@ void Database::read(const QString &fileName)
     try {
         auto *sw = new stopwatch("Loading database");
 
-        QFile f(!fileName.isEmpty() ? fileName : core()->dataPath() + Database::defaultDatabaseName());
+        auto file = std::make_unique<QFile>(!fileName.isEmpty() ? fileName : core()->dataPath() + Database::defaultDatabaseName());
+        QFile &f = *file.get();
 
         if (!f.open(QFile::ReadOnly))
             throw Exception(&f, "could not open database for reading");
 
+        // The V11 format references the heap chunk directly, so the data has to stay around for
+        // as long as this database is active. Windows however cannot replace a file that is
+        // still mapped, which would break database updates: we have to read it in one go there.
+#if defined(Q_OS_WINDOWS)
+        QByteArray ba = f.readAll();
+        if (ba.size() != f.size())
+            throw Exception("could not read the database (%1)").arg(f.fileName());
+        f.close();
+        const char *data = ba.constData();
+#else
         const char *data = reinterpret_cast<char *>(f.map(0, f.size()));
 
         if (!data)
             throw Exception("could not memory map the database (%1)").arg(f.fileName());
 
-        QByteArray ba = QByteArray::fromRawData(data, int(f.size()));
+        QByteArray ba = QByteArray::fromRawData(data, f.size());
+#endif
         QBuffer buf(&ba);
         buf.open(QIODevice::ReadOnly);
         ChunkReader cr(&buf, QDataStream::LittleEndian);
@@ -217,25 +440,40 @@ void Database::read(const QString &fileName)
             throw Exception("invalid database version: expected %1, but got %2")
                 .arg(int(Version::Latest)).arg(cr.chunkVersion());
         }
+        if (QSysInfo::ByteOrder != QSysInfo::LittleEndian)
+            throw Exception("the database format is only supported on little-endian systems");
+
+        // 1st pass: just index the chunks, so we can decode them independently afterwards
+        struct ChunkIndex {
+            quint32 id;
+            quint32 version;
+            qint64 offset;
+            qint64 size;
+        };
+        QVector<ChunkIndex> chunks;
 
-        bool gotColors = false, gotCategories = false, gotItemTypes = false, gotItems = false;
-        bool gotChangeLog = false, gotPccs = false;
-        bool gotRelationships = false, gotRelationshipMatches = false;
+        while (cr.startChunk()) {
+            chunks.append({ cr.chunkId(), cr.chunkVersion(), buf.pos(), cr.chunkSize() });
 
-        auto check = [&ds, &f]() {
-            if (ds.status() != QDataStream::Ok)
-                throw Exception("failed to read from database (%1) at position %2")
-                    .arg(f.fileName()).arg(ds.device()->pos());
-        };
+            if ((chunks.constLast().offset + chunks.constLast().size) > ba.size()) {
+                throw Exception("chunk exceeds the size of the database (%1) at position %2")
+                    .arg(f.fileName()).arg(buf.pos());
+            }
+            if (!cr.skipChunk() || !cr.endChunk()) {
+                throw Exception("missed the end of a chunk when reading from database (%1) at position %2")
+                    .arg(f.fileName()).arg(buf.pos());
+            }
+        }
+        if (!cr.endChunk()) {
+            throw Exception("missed the end of the root chunk when reading from database (%1) at position %2")
+                .arg(f.fileName()).arg(buf.pos());
+        }
 
-        auto sizeCheck = [&f](uint s, uint max) {
-            if (s > max)
-                throw Exception("failed to read from database (%1) at position %2: size value %L3 is larger than expected maximum %L4")
-                    .arg(f.fileName()).arg(f.pos()).arg(s).arg(max);
-        };
+        ds.commitTransaction();
 
-        // This is the new pool. We need to keep the old alive till the scope end
-        std::unique_ptr<MemoryResource> pool(new DatabaseMonotonicMemoryResource(1024*1024));
+        bool gotHeap = false, gotColors = false, gotCategories = false, gotItemTypes = false, gotItems = false;
+        bool gotChangeLog = false, gotPccs = false;
+        bool gotRelationships = false, gotRelationshipMatches = false;
 
         QDateTime                        generationDate;
         std::vector<Color>               colors;
@@ -250,165 +488,282 @@ void Database::read(const QString &fileName)
         std::vector<RelationshipMatch>   relationshipMatches;
         uint                             latestChangelogId = 0;
 
-        while (cr.startChunk()) {
-            switch (cr.chunkId() | quint64(cr.chunkVersion()) << 32) {
-            case ChunkId('D','A','T','E') | 1ULL << 32: {
-                ds >> generationDate;
-                break;
-            }
-            case ChunkId('C','O','L',' ') | 1ULL << 32: {
-                quint32 colc = 0;
-                ds >> colc;
-                check();
-                sizeCheck(colc, 1'000);
+        auto findChunk = [&chunks](quint32 id, quint32 version) -> const ChunkIndex * {
+            auto it = std::find_if(chunks.cbegin(), chunks.cend(), [=](const ChunkIndex &ci) {
+                return (ci.id == id) && (ci.version == version);
+            });
+            return (it != chunks.cend()) ? &(*it) : nullptr;
+        };
 
-                colors.resize(colc);
-                for (quint32 i = 0; i < colc; ++i) {
-                    readColorFromDatabase(colors[i], ds, pool.get());
-                    check();
-                }
-                gotColors = true;
-                break;
-            }
-            case ChunkId('L', 'C','O','L') | 1ULL << 32: { // optional, can be missing or empty
-                quint32 colc = 0;
-                ds >> colc;
+        // every chunk gets its own stream, so that they can be decoded in parallel
+        auto decodeChunk = [&f, data](const ChunkIndex &ci, const auto &decode) {
+            QDataStream cds(QByteArray::fromRawData(data + ci.offset, ci.size));
+            cds.setVersion(QDataStream::Qt_5_11);
+            cds.setByteOrder(QDataStream::LittleEndian);
+
+            auto check = [&cds, &f, &ci]() {
+                if (cds.status() != QDataStream::Ok)
+                    throw Exception("failed to read from database (%1) at position %2")
+                        .arg(f.fileName()).arg(ci.offset + cds.device()->pos());
+            };
+            decode(cds, check);
+            check();
+        };
+
+        auto sizeCheck = [&f](uint s, uint max) {
+            if (s > max)
+                throw Exception("failed to read from database (%1): size value %L2 is larger than expected maximum %L3")
+                    .arg(f.fileName()).arg(s).arg(max);
+        };
+
+        // returns the start of the fixed-size records in the chunk and skips over them
+        auto recordsCheck = [&f, data](const ChunkIndex &ci, QDataStream &cds, quint32 count,
+                                       quint32 recordSize, size_t expectedRecordSize) {
+            if (recordSize != expectedRecordSize)
+                throw Exception("invalid record size in database (%1): expected %2, but got %3")
+                    .arg(f.fileName()).arg(expectedRecordSize).arg(recordSize);
+            const qint64 pos = cds.device()->pos();
+            if ((pos + qint64(count) * recordSize) > ci.size)
+                throw Exception("record data exceeds the chunk size in database (%1) at position %2")
+                    .arg(f.fileName()).arg(ci.offset + pos);
+            cds.device()->seek(pos + qint64(count) * recordSize);
+            return data + ci.offset + pos;
+        };
+
+        // The monotonic pools are not thread-safe, so every parallel decoder gets its own.
+        // The new pools need to be kept alive till the end of this scope.
+        std::vector<std::unique_ptr<MemoryResource>> pools;
+        auto newPool = [&pools]() {
+            pools.emplace_back(new DatabaseMonotonicMemoryResource(1024*1024));
+            return pools.back().get();
+        };
+
+        // 2nd pass: the small chunks are decoded sequentially, as the record chunks depend on
+        // the heap
+        MappedHeap heap;
+        MemoryResource *sequentialPool = newPool();
+
+        if (auto ci = findChunk(ChunkId('D','A','T','E'), 1)) {
+            decodeChunk(*ci, [&](QDataStream &cds, const auto &) {
+                cds >> generationDate;
+            });
+        }
+        if (auto ci = findChunk(ChunkId('H','E','A','P'), 1)) {
+            decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                quint32 heapSize = 0, reserved32 = 0;
+                quint64 reserved64 = 0;
+                cds >> heapSize >> reserved32 >> reserved64;
                 check();
-                sizeCheck(colc, 1'000);
 
-                ldrawExtraColors.resize(colc);
-                for (quint32 i = 0; i < colc; ++i) {
-                    readColorFromDatabase(ldrawExtraColors[i], ds, pool.get());
+                heap.data = recordsCheck(*ci, cds, heapSize, 1, 1);
+                heap.size = heapSize;
+            });
+            gotHeap = true;
+        }
+        if (!gotHeap)
+            throw Exception("the heap chunk is missing in the database (%1)").arg(f.fileName());
+
+        for (const quint32 id : { ChunkId('C','O','L',' '), ChunkId('L','C','O','L') }) {
+            const bool isLDraw = (id == ChunkId('L','C','O','L')); // optional, can be missing or empty
+
+            if (auto ci = findChunk(id, 2)) {
+                auto &cols = isLDraw ? ldrawExtraColors : colors;
+                decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                    quint32 colc = 0, recordSize = 0;
+                    quint64 reserved = 0;
+                    cds >> colc >> recordSize >> reserved;
                     check();
-                }
-                break;
+                    sizeCheck(colc, 1'000);
+
+                    const auto *records = reinterpret_cast<const ColorRecord *>(
+                        recordsCheck(*ci, cds, colc, recordSize, sizeof(ColorRecord)));
+                    cols.resize(colc);
+                    for (quint32 i = 0; i < colc; ++i)
+                        readColorFromRecord(cols[i], records[i], heap);
+                });
+                if (!isLDraw)
+                    gotColors = true;
             }
-            case ChunkId('C','A','T',' ') | 1ULL << 32: {
-                quint32 catc = 0;
-                ds >> catc;
+        }
+        if (auto ci = findChunk(ChunkId('C','A','T',' '), 2)) {
+            decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                quint32 catc = 0, recordSize = 0;
+                quint64 reserved = 0;
+                cds >> catc >> recordSize >> reserved;
                 check();
                 sizeCheck(catc, 10'000);
 
+                const auto *records = reinterpret_cast<const CategoryRecord *>(
+                    recordsCheck(*ci, cds, catc, recordSize, sizeof(CategoryRecord)));
                 categories.resize(catc);
-                for (quint32 i = 0; i < catc; ++i) {
-                    readCategoryFromDatabase(categories[i], ds, pool.get());
-                    check();
-                }
-                gotCategories = true;
-                break;
-            }
-            case ChunkId('T','Y','P','E') | 1ULL << 32: {
+                for (quint32 i = 0; i < catc; ++i)
+                    readCategoryFromRecord(categories[i], records[i], heap);
+            });
+            gotCategories = true;
+        }
+        if (auto ci = findChunk(ChunkId('T','Y','P','E'), 1)) {
+            decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
                 quint32 ittc = 0;
-                ds >> ittc;
+                cds >> ittc;
                 check();
                 sizeCheck(ittc, 20);
 
                 itemTypes.resize(ittc);
                 for (quint32 i = 0; i < ittc; ++i) {
-                    readItemTypeFromDatabase(itemTypes[i], ds, pool.get());
-                    check();
-                }
-                gotItemTypes = true;
-                break;
-            }
-            case ChunkId('I','T','E','M') | 1ULL << 32: {
-                quint32 itc = 0;
-                ds >> itc;
-                check();
-                sizeCheck(itc, 1'000'000);
-
-                items.resize(itc);
-                for (quint32 i = 0; i < itc; ++i) {
-                    readItemFromDatabase(items[i], ds, pool.get());
+                    readItemTypeFromDatabase(itemTypes[i], cds, sequentialPool);
                     check();
                 }
-                gotItems = true;
-                break;
-            }
-            case ChunkId('C','H','G','L') | 2ULL << 32: {
-                quint32 clid = 0, clic = 0, clcc = 0;
-                ds >> clid >> clic >> clcc;
-                check();
-                sizeCheck(clic, 1'000'000);
-                sizeCheck(clcc, 1'000);
+            });
+            gotItemTypes = true;
+        }
 
-                itemChangelog.resize(clic);
-                for (quint32 i = 0; i < clic; ++i) {
-                    readItemChangeLogFromDatabase(itemChangelog[i], ds, pool.get());
-                    check();
+        // 3rd pass: the big chunks are decoded in parallel on the global thread pool. The items
+        // are additionally split into ranges.
+        QVector<QFuture<void>> futures;
+        QMutex errorMutex;
+        QString error;
+
+        // the tasks reference local variables: never leave this scope while they are running
+        auto waitForTasks = qScopeGuard([&futures]() {
+            for (auto &future : futures)
+                future.waitForFinished();
+        });
+
+        auto runParallel = [&futures, &errorMutex, &error](auto task) {
+            futures << QtConcurrent::run(QThreadPool::globalInstance(), [&errorMutex, &error, task]() {
+                // nothing may escape from here: waitForFinished() would rethrow it and we would
+                // leave the scope while the other tasks are still running
+                QString taskError;
+                try {
+                    task();
+                } catch (const Exception &e) {
+                    taskError = e.errorString();
+                } catch (const std::exception &e) {
+                    taskError = QString::fromLocal8Bit(e.what());
+                } catch (...) {
+                    taskError = u"unknown error"_qs;
                 }
-                colorChangelog.resize(clcc);
-                for (quint32 i = 0; i < clcc; ++i) {
-                    readColorChangeLogFromDatabase(colorChangelog[i], ds, pool.get());
-                    check();
+                if (!taskError.isEmpty()) {
+                    QMutexLocker locker(&errorMutex);
+                    if (error.isEmpty())
+                        error = taskError;
                 }
-                latestChangelogId = clid;
-                gotChangeLog = true;
-                break;
-            }
-            case ChunkId('P','C','C',' ') | 1ULL << 32: {
-                quint32 pccc = 0;
-                ds >> pccc;
-                check();
-                sizeCheck(pccc, 1'000'000);
+            });
+        };
 
-                pccs.resize(pccc);
-                for (quint32 i = 0; i < pccc; ++i) {
-                    readPCCFromDatabase(pccs[i], ds, pool.get());
-                    check();
-                }
-                gotPccs = true;
-                break;
-            }
-            case ChunkId('R','E','L',' ') | 1ULL << 32: {
-                quint32 relc = 0;
-                ds >> relc;
-                check();
-                sizeCheck(relc, 1'000);
+        if (auto ci = findChunk(ChunkId('I','T','E','M'), 2)) {
+            quint32 itc = 0;
+            const ItemRecord *records = nullptr;
 
-                relationships.resize(relc);
-                for (quint32 i = 0; i < relc; ++i) {
-                    readRelationshipFromDatabase(relationships[i], ds, pool.get());
-                    check();
-                }
-                gotRelationships = true;
-                break;
-            }
-            case ChunkId('R','E','L','M') | 1ULL << 32: {
-                quint32 matchc = 0;
-                ds >> matchc;
+            decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                quint32 recordSize = 0;
+                quint64 reserved = 0;
+                cds >> itc >> recordSize >> reserved;
                 check();
-                sizeCheck(matchc, 1'000'000);
+                sizeCheck(itc, 1'000'000);
 
-                relationshipMatches.resize(matchc);
-                for (quint32 i = 0; i < matchc; ++i) {
-                    readRelationshipMatchFromDatabase(relationshipMatches[i], ds, pool.get());
-                    check();
-                }
-                gotRelationshipMatches = true;
-                break;
-            }
-            default: {
-                cr.skipChunk();
-                check();
-                break;
-            }
-            }
-            if (!cr.endChunk()) {
-                throw Exception("missed the end of a chunk when reading from database (%1) at position %2")
-                    .arg(f.fileName()).arg(f.pos());
+                records = reinterpret_cast<const ItemRecord *>(
+                    recordsCheck(*ci, cds, itc, recordSize, sizeof(ItemRecord)));
+            });
+            items.resize(itc);
+
+            const quint32 rangeSize = std::max(10'000U, itc / quint32(QThread::idealThreadCount()) + 1);
+            for (quint32 from = 0; from < itc; from += rangeSize) {
+                const quint32 to = std::min(itc, from + rangeSize);
+
+                runParallel([&items, &heap, records, from, to]() {
+                    for (quint32 i = from; i < to; ++i)
+                        readItemFromRecord(items[i], records[i], heap);
+                });
             }
+            gotItems = true;
         }
-        if (!cr.endChunk()) {
-            throw Exception("missed the end of the root chunk when reading from database (%1) at position %2")
-                .arg(f.fileName()).arg(f.pos());
+        if (auto ci = findChunk(ChunkId('C','H','G','L'), 2)) {
+            runParallel([&, ci, pool = newPool()]() {
+                decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                    quint32 clid = 0, clic = 0, clcc = 0;
+                    cds >> clid >> clic >> clcc;
+                    check();
+                    sizeCheck(clic, 1'000'000);
+                    sizeCheck(clcc, 1'000);
+
+                    itemChangelog.resize(clic);
+                    for (quint32 i = 0; i < clic; ++i) {
+                        readItemChangeLogFromDatabase(itemChangelog[i], cds, pool);
+                        check();
+                    }
+                    colorChangelog.resize(clcc);
+                    for (quint32 i = 0; i < clcc; ++i) {
+                        readColorChangeLogFromDatabase(colorChangelog[i], cds, pool);
+                        check();
+                    }
+                    latestChangelogId = clid;
+                });
+            });
+            gotChangeLog = true;
+        }
+        if (auto ci = findChunk(ChunkId('P','C','C',' '), 1)) {
+            runParallel([&, ci, pool = newPool()]() {
+                decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                    quint32 pccc = 0;
+                    cds >> pccc;
+                    check();
+                    sizeCheck(pccc, 1'000'000);
+
+                    pccs.resize(pccc);
+                    for (quint32 i = 0; i < pccc; ++i) {
+                        readPCCFromDatabase(pccs[i], cds, pool);
+                        check();
+                    }
+                });
+            });
+            gotPccs = true;
+        }
+        if (auto ci = findChunk(ChunkId('R','E','L',' '), 1)) {
+            runParallel([&, ci, pool = newPool()]() {
+                decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                    quint32 relc = 0;
+                    cds >> relc;
+                    check();
+                    sizeCheck(relc, 1'000);
+
+                    relationships.resize(relc);
+                    for (quint32 i = 0; i < relc; ++i) {
+                        readRelationshipFromDatabase(relationships[i], cds, pool);
+                        check();
+                    }
+                });
+            });
+            gotRelationships = true;
+        }
+        if (auto ci = findChunk(ChunkId('R','E','L','M'), 1)) {
+            runParallel([&, ci, pool = newPool()]() {
+                decodeChunk(*ci, [&](QDataStream &cds, const auto &check) {
+                    quint32 matchc = 0;
+                    cds >> matchc;
+                    check();
+                    sizeCheck(matchc, 1'000'000);
+
+                    relationshipMatches.resize(matchc);
+                    for (quint32 i = 0; i < matchc; ++i) {
+                        readRelationshipMatchFromDatabase(relationshipMatches[i], cds, pool);
+                        check();
+                    }
+                });
+            });
+            gotRelationshipMatches = true;
         }
 
-        ds.commitTransaction();
+        for (auto &future : futures)
+            future.waitForFinished();
+        waitForTasks.dismiss();
+
+        if (!error.isEmpty())
+            throw Exception(error);
 
         delete sw;
 
-        if (!gotColors || !gotCategories || !gotItemTypes || !gotItems || !gotChangeLog
+        if (!gotHeap || !gotColors || !gotCategories || !gotItemTypes || !gotItems || !gotChangeLog
             || !gotPccs || !gotRelationships || !gotRelationshipMatches) {
             throw Exception("not all required data chunks were found in the database (%1)")
                 .arg(f.fileName());
@@ -448,6 +803,8 @@ void Database::read(const QString &fileName)
             qInfo().noquote() << out;
         }
 
+        stopItemSearchIndex();
+
         m_colors = std::move(colors);
         m_ldrawExtraColors = std::move(ldrawExtraColors);
         m_categories = std::move(categories);
@@ -460,7 +817,16 @@ void Database::read(const QString &fileName)
         m_relationshipMatches = std::move(relationshipMatches);
         m_latestChangelogId = latestChangelogId;
 
-        m_pool.swap(pool);
+        m_pools.swap(pools);
+#if !defined(Q_OS_WINDOWS)
+        m_mappedFile.swap(file);
+#endif
+        m_mappedData.swap(ba);
+
+        buildIndexes();
+#if !defined(BS_BACKEND)
+        startItemSearchIndex(f.fileName(), generationDate);
+#endif
 
         Color::s_colorImageCache.clear();
 
@@ -487,6 +853,8 @@ void Database::write(const QString &filename, Version version) const
 {
     if (version <= Version::Invalid)
         throw Exception("version %1 is too old").arg(int(version));
+    if ((version >= Version::V11) && (QSysInfo::ByteOrder != QSysInfo::LittleEndian))
+        throw Exception("version %1 can only be written on little-endian systems").arg(int(version));
 
     QString fn(!filename.isEmpty() ? filename : core()->dataPath() + defaultDatabaseName(version));
 
@@ -509,37 +877,87 @@ void Database::write(const QString &filename, Version version) const
     ds << QDateTime::currentDateTimeUtc();
     check(cw.endChunk());
 
-    check(cw.startChunk(ChunkId('C','O','L',' '), 1));
-    ds << quint32(m_colors.size());
-    for (const Color &col : m_colors)
-        writeColorToDatabase(col, ds, version);
-    check(cw.endChunk());
-
-    if ((version >= Version::V7) && !m_ldrawExtraColors.empty()) {
-        check(cw.startChunk(ChunkId('L','C','O','L'), 1));
-        ds << quint32(m_ldrawExtraColors.size());
+    if (version >= Version::V11) {
+        // The heap has to be written before any records referencing it
+        HeapWriter heap;
+        std::vector<ColorRecord> colorRecords;
+        std::vector<ColorRecord> ldrawExtraColorRecords;
+        std::vector<CategoryRecord> categoryRecords;
+        std::vector<ItemRecord> itemRecords;
+
+        colorRecords.reserve(m_colors.size());
+        for (const Color &col : m_colors)
+            colorRecords.push_back(writeColorToRecord(col, heap));
+        ldrawExtraColorRecords.reserve(m_ldrawExtraColors.size());
         for (const Color &col : m_ldrawExtraColors)
+            ldrawExtraColorRecords.push_back(writeColorToRecord(col, heap));
+        categoryRecords.reserve(m_categories.size());
+        for (const Category &cat : m_categories)
+            categoryRecords.push_back(writeCategoryToRecord(cat, heap));
+        itemRecords.reserve(m_items.size());
+        for (const Item &item : m_items)
+            itemRecords.push_back(writeItemToRecord(item, heap));
+
+        auto writeRecords = [&](quint32 chunkId, const auto &records) {
+            using Record = typename std::decay_t<decltype(records)>::value_type;
+
+            check(cw.startChunk(chunkId, 2));
+            ds << quint32(records.size()) << quint32(sizeof(Record)) << quint64(0);
+            ds.writeRawData(reinterpret_cast<const char *>(records.data()), int(records.size() * sizeof(Record)));
+            check(cw.endChunk());
+        };
+
+        check(cw.startChunk(ChunkId('H','E','A','P'), 1));
+        ds << quint32(heap.data.size()) << quint32(0) << quint64(0);
+        ds.writeRawData(heap.data.constData(), int(heap.data.size()));
+        check(cw.endChunk());
+
+        writeRecords(ChunkId('C','O','L',' '), colorRecords);
+        if (!ldrawExtraColorRecords.empty())
+            writeRecords(ChunkId('L','C','O','L'), ldrawExtraColorRecords);
+        writeRecords(ChunkId('C','A','T',' '), categoryRecords);
+
+        check(cw.startChunk(ChunkId('T','Y','P','E'), 1));
+        ds << quint32(m_itemTypes.size());
+        for (const ItemType &itt : m_itemTypes)
+            writeItemTypeToDatabase(itt, ds, version);
+        check(cw.endChunk());
+
+        writeRecords(ChunkId('I','T','E','M'), itemRecords);
+
+    } else {
+        check(cw.startChunk(ChunkId('C','O','L',' '), 1));
+        ds << quint32(m_colors.size());
+        for (const Color &col : m_colors)
             writeColorToDatabase(col, ds, version);
         check(cw.endChunk());
-    }
 
-    check(cw.startChunk(ChunkId('C','A','T',' '), 1));
-    ds << quint32(m_categories.size());
-    for (const Category &cat : m_categories)
-        writeCategoryToDatabase(cat, ds, version);
-    check(cw.endChunk());
+        if ((version >= Version::V7) && !m_ldrawExtraColors.empty()) {
+            check(cw.startChunk(ChunkId('L','C','O','L'), 1));
+            ds << quint32(m_ldrawExtraColors.size());
+            for (const Color &col : m_ldrawExtraColors)
+                writeColorToDatabase(col, ds, version);
+            check(cw.endChunk());
+        }
 
-    check(cw.startChunk(ChunkId('T','Y','P','E'), 1));
-    ds << quint32(m_itemTypes.size());
-    for (const ItemType &itt : m_itemTypes)
-        writeItemTypeToDatabase(itt, ds, version);
-    check(cw.endChunk());
+        check(cw.startChunk(ChunkId('C','A','T',' '), 1));
+        ds << quint32(m_categories.size());
+        for (const Category &cat : m_categories)
+            writeCategoryToDatabase(cat, ds, version);
+        check(cw.endChunk());
 
-    check(cw.startChunk(ChunkId('I','T','E','M'), 1));
-    ds << quint32(m_items.size());
-    for (const Item &item : m_items)
-        writeItemToDatabase(item, ds, version);
-    check(cw.endChunk());
+        check(cw.startChunk(ChunkId('T','Y','P','E'), 1));
+        ds << quint32(m_itemTypes.size());
+        for (const ItemType &itt : m_itemTypes)
+            writeItemTypeToDatabase(itt, ds, version);
+        check(cw.endChunk());
+
+        check(cw.startChunk(ChunkId('I','T','E','M'), 1));
+        ds << quint32(m_items.size());
+        for (const Item &item : m_items)
+            writeItemToDatabase(item, ds, version);
+        check(cw.endChunk());
+    }
 
     if (version >= Version::V9) {
         check(cw.startChunk(ChunkId('C','H','G','L'), 2));
@@ -608,17 +1026,63 @@ void Database::remove()
 ///////////////////////////////////////////////////////////////////////
 
 
-void Database::readColorFromDatabase(Color &col, QDataStream &dataStream, MemoryResource *pool)
+void Database::readColorFromRecord(Color &col, const ColorRecord &rec, const MappedHeap &heap)
 {
-    quint32 flags;
+    Q_STATIC_ASSERT(sizeof(ColorRecord) == 80);
+
+    auto toColor = [&rec](quint64 rgba64, quint32 validFlag) {
+        return (rec.validColors & validFlag) ? QColor::fromRgba64(QRgba64::fromRgba64(rgba64))
+                                             : QColor { };
+    };
 
-    dataStream >> col.m_id >> col.m_name.deserialize(pool) >> col.m_ldraw_id >> col.m_color
-        >> flags >> col.m_popularity >> col.m_year_from >> col.m_year_to;
-    col.m_type = static_cast<ColorType>(flags);
+    col.m_id = rec.id;
+    heap.map(col.m_name, rec.name);
+    col.m_ldraw_id = rec.ldrawId;
+    col.m_type = static_cast<ColorType>(quint32(rec.type));
+    col.m_popularity = std::bit_cast<float>(quint32(rec.popularity));
+    col.m_year_from = rec.yearFrom;
+    col.m_year_to = rec.yearTo;
+    col.m_luminance = std::bit_cast<float>(quint32(rec.luminance));
+    col.m_particleMinSize = std::bit_cast<float>(quint32(rec.particleMinSize));
+    col.m_particleMaxSize = std::bit_cast<float>(quint32(rec.particleMaxSize));
+    col.m_particleFraction = std::bit_cast<float>(quint32(rec.particleFraction));
+    col.m_particleVFraction = std::bit_cast<float>(quint32(rec.particleVFraction));
+    col.m_color = toColor(rec.color, ColorRecord::ValidColor);
+    col.m_ldraw_color = toColor(rec.ldrawColor, ColorRecord::ValidLDrawColor);
+    col.m_ldraw_edge_color = toColor(rec.ldrawEdgeColor, ColorRecord::ValidLDrawEdgeColor);
+    col.m_particleColor = toColor(rec.particleColor, ColorRecord::ValidParticleColor);
+}
+
+Database::ColorRecord Database::writeColorToRecord(const Color &col, HeapWriter &heap)
+{
+    ColorRecord rec { };
+    quint32 validColors = 0;
+
+    auto fromColor = [&validColors](const QColor &c, quint32 validFlag) -> quint64 {
+        if (!c.isValid())
+            return 0;
+        validColors |= validFlag;
+        return c.rgba64();
+    };
 
-    dataStream >> col.m_ldraw_color >> col.m_ldraw_edge_color >> col.m_luminance
-            >> col.m_particleMinSize >> col.m_particleMaxSize >> col.m_particleColor
-            >> col.m_particleFraction >> col.m_particleVFraction;
+    rec.id = col.m_id;
+    rec.name = heap.add(col.m_name);
+    rec.ldrawId = col.m_ldraw_id;
+    rec.type = quint32(col.m_type);
+    rec.popularity = std::bit_cast<quint32>(col.m_popularity);
+    rec.yearFrom = col.m_year_from;
+    rec.yearTo = col.m_year_to;
+    rec.luminance = std::bit_cast<quint32>(col.m_luminance);
+    rec.particleMinSize = std::bit_cast<quint32>(col.m_particleMinSize);
+    rec.particleMaxSize = std::bit_cast<quint32>(col.m_particleMaxSize);
+    rec.particleFraction = std::bit_cast<quint32>(col.m_particleFraction);
+    rec.particleVFraction = std::bit_cast<quint32>(col.m_particleVFraction);
+    rec.color = fromColor(col.m_color, ColorRecord::ValidColor);
+    rec.ldrawColor = fromColor(col.m_ldraw_color, ColorRecord::ValidLDrawColor);
+    rec.ldrawEdgeColor = fromColor(col.m_ldraw_edge_color, ColorRecord::ValidLDrawEdgeColor);
+    rec.particleColor = fromColor(col.m_particleColor, ColorRecord::ValidParticleColor);
+    rec.validColors = validColors;
+    return rec;
 }
 
 void Database::writeColorToDatabase(const Color &col, QDataStream &dataStream, Version v) const
@@ -634,10 +1098,28 @@ void Database::writeColorToDatabase(const Color &col, QDataStream &dataStream, V
 }
 
 
-void Database::readCategoryFromDatabase(Category &cat, QDataStream &dataStream, MemoryResource *pool)
+void Database::readCategoryFromRecord(Category &cat, const CategoryRecord &rec, const MappedHeap &heap)
 {
-    dataStream >> cat.m_id >> cat.m_name.deserialize(pool) >> cat.m_year_from >> cat.m_year_to
-        >> cat.m_year_recency >> cat.m_has_inventories;
+    Q_STATIC_ASSERT(sizeof(CategoryRecord) == 12);
+
+    cat.m_id = rec.id;
+    heap.map(cat.m_name, rec.name);
+    cat.m_year_from = rec.yearFrom;
+    cat.m_year_to = rec.yearTo;
+    cat.m_year_recency = rec.yearRecency;
+    cat.m_has_inventories = rec.hasInventories;
+}
+
+Database::CategoryRecord Database::writeCategoryToRecord(const Category &cat, HeapWriter &heap)
+{
+    CategoryRecord rec { };
+    rec.id = cat.m_id;
+    rec.name = heap.add(cat.m_name);
+    rec.yearFrom = cat.m_year_from;
+    rec.yearTo = cat.m_year_to;
+    rec.yearRecency = cat.m_year_recency;
+    rec.hasInventories = cat.m_has_inventories;
+    return rec;
 }
 
 void Database::writeCategoryToDatabase(const Category &cat, QDataStream &dataStream, Version v) const
@@ -676,29 +1158,42 @@ void Database::writeItemTypeToDatabase(const ItemType &itt, QDataStream &dataStr
 }
 
 
-void Database::readItemFromDatabase(Item &item, QDataStream &dataStream, MemoryResource *pool)
+void Database::readItemFromRecord(Item &item, const ItemRecord &rec, const MappedHeap &heap)
 {
-    quint16 itemTypeIndex;
-    quint16 defaultColorIndex;
-
-    dataStream
-        >> item.m_id.deserialize(pool)
-        >> item.m_name.deserialize(pool)
-        >> itemTypeIndex
-        >> defaultColorIndex
-        >> item.m_year_from
-        >> item.m_year_to
-        >> item.m_weight;
-
-    item.m_itemTypeIndex = itemTypeIndex;
-    item.m_defaultColorIndex = defaultColorIndex;
+    Q_STATIC_ASSERT(sizeof(ItemRecord) == 44);
+
+    heap.map(item.m_id, rec.id);
+    heap.map(item.m_name, rec.name);
+    item.m_itemTypeIndex = quint16(rec.itemTypeIndex);
+    item.m_defaultColorIndex = quint16(rec.defaultColorIndex);
+    item.m_year_from = rec.yearFrom;
+    item.m_year_to = rec.yearTo;
+    item.m_weight = std::bit_cast<float>(quint32(rec.weight));
+    heap.map(item.m_appears_in, rec.appearsIn);
+    heap.map(item.m_consists_of, rec.consistsOf);
+    heap.map(item.m_knownColorIndexes, rec.knownColorIndexes);
+    heap.map(item.m_categoryIndexes, rec.categoryIndexes);
+    heap.map(item.m_relationshipMatchIds, rec.relationshipMatchIds);
+    heap.map(item.m_dimensions, rec.dimensions);
+}
 
-    dataStream >> item.m_appears_in.deserialize(pool);
-    dataStream >> item.m_consists_of.deserialize(pool);
-    dataStream >> item.m_knownColorIndexes.deserialize(pool);
-    dataStream >> item.m_categoryIndexes.deserialize(pool);
-    dataStream >> item.m_relationshipMatchIds.deserialize(pool);
-    dataStream >> item.m_dimensions.deserialize(pool);
+Database::ItemRecord Database::writeItemToRecord(const Item &item, HeapWriter &heap)
+{
+    ItemRecord rec { };
+    rec.id = heap.add(item.m_id);
+    rec.name = heap.add(item.m_name);
+    rec.itemTypeIndex = quint16(item.m_itemTypeIndex);
+    rec.defaultColorIndex = quint16(item.m_defaultColorIndex);
+    rec.yearFrom = item.m_year_from;
+    rec.yearTo = item.m_year_to;
+    rec.weight = std::bit_cast<quint32>(item.m_weight);
+    rec.appearsIn = heap.add(item.m_appears_in);
+    rec.consistsOf = heap.add(item.m_consists_of);
+    rec.knownColorIndexes = heap.add(item.m_knownColorIndexes);
+    rec.categoryIndexes = heap.add(item.m_categoryIndexes);
+    rec.relationshipMatchIds = heap.add(item.m_relationshipMatchIds);
+    rec.dimensions = heap.add(item.m_dimensions);
+    return rec;
 }
 
 void Database::writeItemToDatabase(const Item &item, QDataStream &dataStream, Version v) const
@@ -3,8 +3,14 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include <QObject>
 #include <QDateTime>
+#include <QHash>
+#include <QFuture>
+#include <QMutex>
 #include <QtQml/qqmlregistration.h>
 
 #include "bricklink/global.h"
@@ -15,8 +21,12 @@
 #include "bricklink/changelogentry.h"
 #include "bricklink/partcolorcode.h"
 #include "bricklink/relationship.h"
+#include "bricklink/itemsearchindex.h"
 #include "utility/memoryresource.h"
+#include "utility/hashindex.h"
+
 
+QT_FORWARD_DECLARE_CLASS(QFile)
 
 class Transfer;
 class TransferJob;
@@ -47,10 +57,11 @@ public:
         V8,  // 2022.6.2
         V9,  // 2023.3.1
         V10, // 2023.11.1
+        V11, // 2024.1.1
 
         OldestStillSupported = V6,
 
-        Latest = V10
+        Latest = V11
     };
 
     void setUpdateInterval(int interval);
@@ -72,6 +83,9 @@ public:
 
     static void remove();
 
+    // nullptr until the index has been loaded or built in the background after read()
+    std::shared_ptr<const ItemSearchIndex> itemSearchIndex() const;
+
 signals:
     void updateStarted();
     void updateProgress(int received, int total);
@@ -87,6 +101,12 @@ private:
     void setUpdateStatus(UpdateStatus updateStatus);
 
     void clear();
+    void buildIndexes();
+    void startItemSearchIndex(const QString &databaseFileName, const QDateTime &generationDate);
+    void stopItemSearchIndex();
+
+    static size_t itemHash(char itemTypeId, QByteArrayView itemId)  { return qHash(itemId, uchar(itemTypeId)); }
+    static size_t caseFoldedHash(QStringView str);
 
     QString m_updateUrl;
     bool m_valid = false;
@@ -97,7 +117,9 @@ private:
     Transfer *m_transfer;
     TransferJob *m_job = nullptr;
 
-    std::unique_ptr<MemoryResource>  m_pool;
+    std::vector<std::unique_ptr<MemoryResource>> m_pools;
+    std::unique_ptr<QFile>           m_mappedFile; // V11+: pooled arrays point into this mapping...
+    QByteArray                       m_mappedData; // ... or into this buffer (see read())
     std::vector<Color>               m_colors;
     std::vector<Color>               m_ldrawExtraColors;
     std::vector<Category>            m_categories;
@@ -111,18 +133,46 @@ private:
 
     uint m_latestChangelogId = 0;
 
+    // hash indexes for Core::item(), color(), partColorCode() and relationshipMatch()
+    HashIndex m_itemIndex;
+    HashIndex m_colorIndex;
+    HashIndex m_pccIndex;
+    HashIndex m_relationshipMatchIndex;
+    // case-insensitive name index for Core::colorFromName()
+    HashIndex m_colorNameIndex;
+    // combined index of m_colors and m_ldrawExtraColors for Core::colorFromLDrawId()
+    QHash<int, const Color *> m_colorLDrawIdIndex;
+
+    // trigram index for ItemModel's text filter, see startItemSearchIndex()
+    QFuture<void> m_itemSearchIndexFuture;
+    std::atomic<bool> m_itemSearchIndexCanceled = false;
+    mutable QMutex m_itemSearchIndexMutex;
+    std::shared_ptr<const ItemSearchIndex> m_itemSearchIndex;
+
     friend class Core;
     friend class TextImport;
 
     // IO
 
-    static void readColorFromDatabase(Color &col, QDataStream &dataStream, MemoryResource *pool);
+    // V11+: items, colors and categories are stored as fixed-size, little-endian records. All
+    // their PooledArrays live in a shared heap chunk and are referenced by offset.
+    struct HeapWriter;
+    struct MappedHeap;
+    struct ColorRecord;
+    struct CategoryRecord;
+    struct ItemRecord;
+
+    static void readColorFromRecord(Color &col, const ColorRecord &rec, const MappedHeap &heap);
+    static ColorRecord writeColorToRecord(const Color &col, HeapWriter &heap);
+    static void readCategoryFromRecord(Category &cat, const CategoryRecord &rec, const MappedHeap &heap);
+    static CategoryRecord writeCategoryToRecord(const Category &cat, HeapWriter &heap);
+    static void readItemFromRecord(Item &item, const ItemRecord &rec, const MappedHeap &heap);
+    static ItemRecord writeItemToRecord(const Item &item, HeapWriter &heap);
+
     void writeColorToDatabase(const Color &color, QDataStream &dataStream, Version v) const;
-    static void readCategoryFromDatabase(Category &cat, QDataStream &dataStream, MemoryResource *pool);
     void writeCategoryToDatabase(const Category &category, QDataStream &dataStream, Version v) const;
     static void readItemTypeFromDatabase(ItemType &itt, QDataStream &dataStream, MemoryResource *pool);
     void writeItemTypeToDatabase(const ItemType &itemType, QDataStream &dataStream, Version v) const;
-    static void readItemFromDatabase(Item &item, QDataStream &dataStream, MemoryResource *pool);
     void writeItemToDatabase(const Item &item, QDataStream &dataStream, Version v) const;
     static void readPCCFromDatabase(PartColorCode &pcc, QDataStream &dataStream, MemoryResource *pool);
     void writePCCToDatabase(const PartColorCode &pcc, QDataStream &dataStream, Version v) const;
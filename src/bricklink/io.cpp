@@ -1,10 +1,16 @@
 // Copyright (C) 2004-2023 Robert Griebl
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <atomic>
+#include <vector>
+
 #include <QtCore/QBuffer>
 #include <QtCore/QXmlStreamReader>
 #include <QtCore/QXmlStreamWriter>
 #include <QtCore/QTimeZone>
+#include <QtCore/QScopeGuard>
+#include <QtCore/QThreadPool>
+#include <QtConcurrent/QtConcurrentRun>
 
 #include "utility/utility.h"
 #include "utility/exception.h"
@@ -127,9 +133,13 @@ QString IO::toBrickLinkXML(const LotList &lots)
 }
 
 
-IO::ParseResult IO::fromBrickLinkXML(const QByteArray &data, Hint hint, const QDateTime &creationTime)
+// Parses a complete BrickLink XML document into pr. Returns false if lotParsed() returned
+// false to abort the parsing.
+static bool parseBrickLinkXML(QXmlStreamReader &xml, IO::Hint hint, const QDateTime &creationTime,
+                              ResolveCache &resolveCache, IO::ParseResult &pr,
+                              const std::function<bool()> &lotParsed)
 {
-    //stopwatch loadXMLWatch("Load XML");
+    using Hint = IO::Hint;
 
     const bool doubleEscapedComments = core()->isApiQuirkEnabled(ApiQuirk::InventoryCommentsAreDoubleEscaped);
     const bool doubleEscapedRemarks = core()->isApiQuirkEnabled(ApiQuirk::InventoryRemarksAreDoubleEscaped);
@@ -137,13 +147,11 @@ IO::ParseResult IO::fromBrickLinkXML(const QByteArray &data, Hint hint, const QD
     // field is generated with thousands-separators enabled (e.g. 1,752 instead of 1752)
     const bool qtyHasComma = (hint == Hint::Order) && core()->isApiQuirkEnabled(ApiQuirk::OrderQtyHasComma);
 
-    ParseResult pr;
-    QXmlStreamReader xml(data);
     QString rootName = u"INVENTORY"_qs;
     if (hint == Hint::Order)
         rootName = u"ORDER"_qs;
 
-    QHash<QStringView, std::function<void(ParseResult &pr, const QString &value)>> rootTagHash;
+    QHash<QStringView, std::function<void(IO::ParseResult &pr, const QString &value)>> rootTagHash;
 
     QHash<QStringView, std::function<void(Lot *, const QString &value)>> itemTagHash {
     { u"ITEMID",       [](auto *lot, auto &v) { lot->isIncomplete()->m_item_id = v.toLatin1(); } },
@@ -213,86 +221,230 @@ IO::ParseResult IO::fromBrickLinkXML(const QByteArray &data, Hint hint, const QD
         });
     }
 
-    try {
-        bool foundRoot = false;
-
-        while (true) {
-            switch (xml.readNext()) {
-            case QXmlStreamReader::StartElement: {
-                auto tagName = xml.name();
-                if (!foundRoot) { // check the root element
-                    if (tagName.toString() != rootName)
-                        throw Exception("Expected %1 as root element, but got: %2").arg(rootName).arg(tagName);
-                    foundRoot = true;
-                } else if (tagName == u"ITEM") {
-                    auto *lot = new Lot();
-                    auto inc = new Incomplete;
-                    inc->m_color_id = 0;
-                    inc->m_category_id = 0;
-                    lot->setIncomplete(inc);
-
-                    while (xml.readNextStartElement()) {
-                        auto it = itemTagHash.find(xml.name());
-                        if (it != itemTagHash.end())
-                            (*it)(lot, xml.readElementText());
-                        else
-                            xml.skipCurrentElement();
-                    }
-
-                    switch (core()->resolveIncomplete(lot, 0, creationTime)) {
-                    case Core::ResolveResult::Fail: pr.incInvalidLotCount(); break;
-                    case Core::ResolveResult::ChangeLog: pr.incFixedLotCount(); break;
-                    default: break;
-                    }
-
-                    pr.addLot(std::move(lot));
-                } else {
-                    auto it = rootTagHash.find(xml.name());
-                    if (it != rootTagHash.end())
-                        (*it)(pr, xml.readElementText());
+    bool foundRoot = false;
+
+    while (true) {
+        switch (xml.readNext()) {
+        case QXmlStreamReader::StartElement: {
+            auto tagName = xml.name();
+            if (!foundRoot) { // check the root element
+                if (tagName.toString() != rootName)
+                    throw Exception("Expected %1 as root element, but got: %2").arg(rootName).arg(tagName);
+                foundRoot = true;
+            } else if (tagName == u"ITEM") {
+                auto *lot = new Lot();
+                auto inc = new Incomplete;
+                inc->m_color_id = 0;
+                inc->m_category_id = 0;
+                lot->setIncomplete(inc);
+
+                while (xml.readNextStartElement()) {
+                    auto it = itemTagHash.find(xml.name());
+                    if (it != itemTagHash.end())
+                        (*it)(lot, xml.readElementText());
                     else
                         xml.skipCurrentElement();
                 }
-                break;
+
+                switch (core()->resolveIncomplete(lot, 0, creationTime, &resolveCache)) {
+                case Core::ResolveResult::Fail: pr.incInvalidLotCount(); break;
+                case Core::ResolveResult::ChangeLog: pr.incFixedLotCount(); break;
+                default: break;
+                }
+
+                pr.addLot(std::move(lot));
+
+                if (lotParsed && !lotParsed())
+                    return false;
+            } else {
+                auto it = rootTagHash.find(xml.name());
+                if (it != rootTagHash.end())
+                    (*it)(pr, xml.readElementText());
+                else
+                    xml.skipCurrentElement();
             }
-            case QXmlStreamReader::Invalid:
-                throw Exception(xml.errorString());
+            break;
+        }
+        case QXmlStreamReader::Invalid:
+            throw Exception(xml.errorString());
+
+        case QXmlStreamReader::EndDocument:
+            if (!foundRoot)
+                throw Exception("Not a valid BrickLink XML file");
+            return true;
 
-            case QXmlStreamReader::EndDocument:
-                if (!foundRoot)
-                    throw Exception("Not a valid BrickLink XML file");
+        default:
+            break;
+        }
+    }
+}
 
-                if (pr.currencyCode().isEmpty())
-                    pr.setCurrencyCode(u"USD"_qs);
+// Splits the data at the <ITEM> tags into chunks of a few thousand lots and parses these
+// chunks in parallel on the global thread pool. Every chunk is wrapped in the header and
+// trailer of the original document, so it is a complete XML document in the same encoding.
+// Returns false if the data is too small or can't be split, or if any chunk fails to parse:
+// the sequential parser has to take over in this case, so it can report a proper error.
+static bool parseBrickLinkXMLChunked(const QByteArray &data, IO::Hint hint, const QDateTime &creationTime,
+                                     ResolveCache &resolveCache, const std::function<bool(int, int)> &progress,
+                                     IO::ParseResult &pr)
+{
+    static constexpr qsizetype MinLotsPerChunk = 1000;
+
+    const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    if (threadCount < 2)
+        return false;
+
+    QVector<qsizetype> itemStarts;
+    for (auto pos = data.indexOf("<ITEM>"); pos >= 0; pos = data.indexOf("<ITEM>", pos + 6))
+        itemStarts.append(pos);
+    const qsizetype lotCount = itemStarts.size();
+    if (lotCount < 2 * MinLotsPerChunk)
+        return false;
+
+    const qsizetype itemsEnd = data.lastIndexOf("</ITEM>") + 7;
+    if (itemsEnd <= itemStarts.constLast())
+        return false;
+    const QByteArray header = data.left(itemStarts.constFirst());
+    const QByteArray trailer = data.mid(itemsEnd);
+
+    struct Chunk
+    {
+        qsizetype from = 0;
+        qsizetype to = 0;
+        int lotCount = 0;
+        IO::ParseResult pr;
+    };
 
-                return pr;
+    const qsizetype lotsPerChunk = std::max(MinLotsPerChunk, lotCount / (threadCount * 4) + 1);
+    std::vector<Chunk> chunks(size_t((lotCount + lotsPerChunk - 1) / lotsPerChunk));
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const qsizetype first = qsizetype(i) * lotsPerChunk;
+        const qsizetype last = std::min(first + lotsPerChunk, lotCount);
+        chunks[i].from = itemStarts.at(first);
+        chunks[i].to = (last == lotCount) ? itemsEnd : itemStarts.at(last);
+        chunks[i].lotCount = int(last - first);
+    }
 
-            default:
-                break;
+    std::atomic<bool> stop = false;
+    std::atomic<bool> failed = false;
+    bool canceled = false;
+    QVector<QFuture<void>> futures;
+
+    // the tasks reference local variables: never leave this scope while they are running
+    auto waitForTasks = qScopeGuard([&futures]() {
+        for (auto &future : futures)
+            future.waitForFinished();
+    });
+
+    for (auto &chunk : chunks) {
+        futures << QtConcurrent::run(QThreadPool::globalInstance(),
+                                     [&data, &header, &trailer, &creationTime, &resolveCache,
+                                      &stop, &failed, hint, c = &chunk]() {
+            if (stop)
+                return;
+
+            QByteArray chunkData;
+            chunkData.reserve(header.size() + (c->to - c->from) + trailer.size());
+            chunkData.append(header).append(data.constData() + c->from, c->to - c->from).append(trailer);
+
+            QXmlStreamReader xml(chunkData);
+            try {
+                parseBrickLinkXML(xml, hint, creationTime, resolveCache, c->pr, [&stop]() { return !stop; });
+            } catch (const Exception &) {
+                failed = true;
+                stop = true;
             }
+        });
+    }
+
+    // the chunks are roughly the same size, so reporting the progress in order is good enough
+    int lotsDone = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        futures[qsizetype(i)].waitForFinished();
+        lotsDone += chunks[i].lotCount;
+        if (progress && !stop && !progress(lotsDone, int(lotCount))) {
+            canceled = true;
+            stop = true;
         }
-    } catch (const Exception &e) {
-        qsizetype pos = xml.characterOffset();
-        QString context = QString::fromUtf8(data);
-        auto lpos = context.lastIndexOf(u'\n', pos ? pos - 1 : 0) + 1;
-        auto rpos = context.indexOf(u'\n', pos);
-        context = context.mid(lpos, rpos == -1 ? context.size() : rpos - lpos);
-        auto contextPos = pos - lpos - 1;
-
-        QString msg = u"XML parse error at line %1, column %2: %3"_qs
-                          .arg(xml.lineNumber()).arg(xml.columnNumber()).arg(e.errorString());
-
-        qDebug().noquote().nospace() << msg << "\n\n  " << context << "\n  "
-                                     << QString(contextPos, u' ') << u'^';
-
-        throw Exception(msg.toHtmlEscaped() + u"<br><br><tt>"
-                        + context.left(contextPos).toHtmlEscaped()
-                        + u"<span style=\"background-color: " + QColor(Qt::red).name() + u"\">"
-                        + context.mid(contextPos, 1).toHtmlEscaped()
-                        + u"</span>"
-                        + context.mid(contextPos + 1).toHtmlEscaped()
-                        + u"</tt>");
     }
+
+    if (canceled)
+        throw Exception("Parsing the XML data was canceled");
+    if (failed)
+        return false;
+
+    QString currencyCode;
+    for (const auto &chunk : chunks) {
+        const QString chunkCurrencyCode = chunk.pr.currencyCode();
+        if (chunkCurrencyCode.isEmpty())
+            continue;
+        else if (currencyCode.isEmpty())
+            currencyCode = chunkCurrencyCode;
+        else if (currencyCode != chunkCurrencyCode)
+            return false;
+    }
+
+    pr.setCurrencyCode(currencyCode);
+    for (auto &chunk : chunks) {
+        const LotList lots = chunk.pr.takeLots();
+        for (auto *lot : lots)
+            pr.addLot(std::move(lot));
+        pr.incInvalidLotCount(chunk.pr.invalidLotCount());
+        pr.incFixedLotCount(chunk.pr.fixedLotCount());
+    }
+    return true;
+}
+
+IO::ParseResult IO::fromBrickLinkXML(const QByteArray &data, Hint hint, const QDateTime &creationTime,
+                                     const std::function<bool(int, int)> &progress)
+{
+    //stopwatch loadXMLWatch("Load XML");
+
+    // shared by all the parser threads, and also by the sequential fallback
+    ResolveCache resolveCache;
+    ParseResult pr;
+
+    if (!parseBrickLinkXMLChunked(data, hint, creationTime, resolveCache, progress, pr)) {
+        const int lotCount = progress ? int(data.count("<ITEM>")) : 0;
+        int lotsDone = 0;
+        bool canceled = false;
+        QXmlStreamReader xml(data);
+
+        try {
+            canceled = !parseBrickLinkXML(xml, hint, creationTime, resolveCache, pr, [&]() {
+                ++lotsDone;
+                return !progress || (lotsDone % 1000) || progress(lotsDone, lotCount);
+            });
+        } catch (const Exception &e) {
+            qsizetype pos = xml.characterOffset();
+            QString context = QString::fromUtf8(data);
+            auto lpos = context.lastIndexOf(u'\n', pos ? pos - 1 : 0) + 1;
+            auto rpos = context.indexOf(u'\n', pos);
+            context = context.mid(lpos, rpos == -1 ? context.size() : rpos - lpos);
+            auto contextPos = pos - lpos - 1;
+
+            QString msg = u"XML parse error at line %1, column %2: %3"_qs
+                              .arg(xml.lineNumber()).arg(xml.columnNumber()).arg(e.errorString());
+
+            qDebug().noquote().nospace() << msg << "\n\n  " << context << "\n  "
+                                         << QString(contextPos, u' ') << u'^';
+
+            throw Exception(msg.toHtmlEscaped() + u"<br><br><tt>"
+                            + context.left(contextPos).toHtmlEscaped()
+                            + u"<span style=\"background-color: " + QColor(Qt::red).name() + u"\">"
+                            + context.mid(contextPos, 1).toHtmlEscaped()
+                            + u"</span>"
+                            + context.mid(contextPos + 1).toHtmlEscaped()
+                            + u"</tt>");
+        }
+        if (canceled)
+            throw Exception("Parsing the XML data was canceled");
+    }
+
+    if (pr.currencyCode().isEmpty())
+        pr.setCurrencyCode(u"USD"_qs);
+
+    return pr;
 }
 
 QString IO::toWantedListXML(const LotList &lots, const QString &wantedList)
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include <functional>
+
 #include <QtCore/QString>
 #include <QtCore/QHash>
 #include <QtXml/QDomElement>
@@ -33,8 +35,8 @@ public:
 
     void addLot(Lot *&&lot);
     void setCurrencyCode(const QString &ccode) { m_currencyCode = ccode; }
-    void incInvalidLotCount()    { ++m_invalidLotCount; }
-    void incFixedLotCount()      { ++m_fixedLotCount; }
+    void incInvalidLotCount(int n = 1) { m_invalidLotCount += n; }
+    void incFixedLotCount(int n = 1)   { m_fixedLotCount += n; }
     void addToDifferenceModeBase(const Lot *lot, const Lot &base);
 
 private:
@@ -63,7 +65,10 @@ enum class Hint {
 };
 
 QString toBrickLinkXML(const LotList &lots);
-ParseResult fromBrickLinkXML(const QByteArray &xml, Hint hint, const QDateTime &creationTime = { });
+// Big documents are parsed in parallel. progress is called every now and then with the
+// number of lots parsed so far: returning false cancels the parsing with an Exception.
+ParseResult fromBrickLinkXML(const QByteArray &xml, Hint hint, const QDateTime &creationTime = { },
+                             const std::function<bool(int done, int total)> &progress = { });
 
 ParseResult fromPartInventory(const Item *item, const Color *color = nullptr, int quantity = 1,
                               Condition condition = Condition::New, Status extraParts = Status::Extra,
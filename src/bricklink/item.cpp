@@ -106,6 +106,18 @@ const QVector<const Category *> Item::categories(bool includeMainCategory) const
     return cats;
 }
 
+bool Item::hasCategory(const Category *cat) const
+{
+    if (!cat)
+        return false;
+    auto index = quint16(cat - core()->categories().data());
+    for (const auto &catIdx : m_categoryIndexes) {
+        if (catIdx == index)
+            return true;
+    }
+    return false;
+}
+
 const Color *Item::defaultColor() const
 {
     return (m_defaultColorIndex != 0xfff) ? &core()->colors()[uint(m_defaultColorIndex)] : nullptr;
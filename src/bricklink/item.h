@@ -33,6 +33,7 @@ public:
     const ItemType *itemType() const;
     const Category *category() const;
     const QVector<const Category *> categories(bool includeMainCategory = false) const;
+    bool hasCategory(const Category *cat) const; // including the main category
     inline bool hasInventory() const       { return !m_consists_of.isEmpty(); }
     const Color *defaultColor() const;
     double weight() const                  { return double(m_weight); }
@@ -158,6 +159,7 @@ private:
     friend class Core;
     friend class Database;
     friend class ItemType;
+    friend class ItemSearchIndex;
     friend class TextImport;
 };
 
@@ -0,0 +1,281 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <algorithm>
+#include <iterator>
+
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+#include <QtCore/QDataStream>
+#include <QtCore/QHash>
+
+#include "bricklink/item.h"
+#include "bricklink/itemsearchindex.h"
+
+
+namespace BrickLink {
+
+static constexpr quint32 CacheMagic = 0x42535349; // 'BSSI'
+static constexpr quint32 CacheVersion = 1;
+
+static void appendVarint(QByteArray &data, quint32 value)
+{
+    while (value >= 0x80) {
+        data.append(char(value | 0x80));
+        value >>= 7;
+    }
+    data.append(char(value));
+}
+
+namespace {
+
+struct PostingsBuilder
+{
+    QByteArray data;
+    quint32 last = 0;
+
+    void append(quint32 itemIndex)
+    {
+        appendVarint(data, itemIndex - last);
+        last = itemIndex;
+    }
+};
+
+// the cache file is machine local, so the arrays are simply written in native byte order
+template <typename T>
+void writeVector(QDataStream &ds, const std::vector<T> &v)
+{
+    ds << quint64(v.size());
+    ds.writeRawData(reinterpret_cast<const char *>(v.data()), int(v.size() * sizeof(T)));
+}
+
+template <typename T>
+bool readVector(QDataStream &ds, std::vector<T> &v, quint64 maxSize)
+{
+    quint64 size = 0;
+    ds >> size;
+    if ((ds.status() != QDataStream::Ok) || (size > maxSize))
+        return false;
+    v.resize(size);
+    const auto bytes = int(size * sizeof(T));
+    return ds.readRawData(reinterpret_cast<char *>(v.data()), bytes) == bytes;
+}
+
+} // namespace
+
+
+QString ItemSearchIndex::matchString(const Item &item)
+{
+    return QString::fromLatin1(item.id()) + u' ' + item.name();
+}
+
+void ItemSearchIndex::trigrams(QStringView str, std::vector<quint64> &result)
+{
+    // Case folding has to be done per character, just like QString::contains() with
+    // Qt::CaseInsensitive does. Trigrams with surrogates are skipped: they would need to be
+    // folded as a pair, but leaving them out just results in a few more candidates.
+    result.clear();
+    quint64 trigram = 0;
+    int valid = 0;
+
+    for (const QChar c : str) {
+        if (c.isSurrogate()) {
+            valid = 0;
+            continue;
+        }
+        trigram = ((trigram << 16) | c.toCaseFolded().unicode()) & 0xffff'ffff'ffffULL;
+        if (++valid >= 3)
+            result.push_back(trigram);
+    }
+    std::sort(result.begin(), result.end());
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+}
+
+bool ItemSearchIndex::build(const std::vector<Item> &items, qsizetype categoryCount,
+                            const std::function<bool()> &isCanceled)
+{
+    QHash<quint64, PostingsBuilder> trigramPostings;
+    std::vector<PostingsBuilder> categoryPostings(size_t(std::max(categoryCount, qsizetype(0))));
+    std::vector<quint64> itemTrigrams;
+
+    for (quint32 i = 0; i < quint32(items.size()); ++i) {
+        if (isCanceled && !(i % 1024) && isCanceled())
+            return false;
+
+        const Item &item = items[i];
+        trigrams(matchString(item), itemTrigrams);
+        for (const auto trigram : itemTrigrams)
+            trigramPostings[trigram].append(i);
+
+        for (const auto categoryIndex : item.m_categoryIndexes) {
+            if (size_t(categoryIndex) < categoryPostings.size())
+                categoryPostings[categoryIndex].append(i);
+        }
+    }
+
+    m_itemCount = items.size();
+    m_trigrams.clear();
+    m_trigrams.reserve(size_t(trigramPostings.size()));
+    for (auto it = trigramPostings.cbegin(); it != trigramPostings.cend(); ++it)
+        m_trigrams.push_back(it.key());
+    std::sort(m_trigrams.begin(), m_trigrams.end());
+
+    qsizetype dataSize = 0;
+    for (const auto &postings : std::as_const(trigramPostings))
+        dataSize += postings.data.size();
+    for (const auto &postings : categoryPostings)
+        dataSize += postings.data.size();
+
+    m_postingData.clear();
+    m_postingData.reserve(dataSize);
+    m_trigramOffsets.clear();
+    m_trigramOffsets.reserve(m_trigrams.size() + 1);
+    for (const auto trigram : m_trigrams) {
+        m_trigramOffsets.push_back(quint32(m_postingData.size()));
+        m_postingData.append(trigramPostings.value(trigram).data);
+    }
+    m_trigramOffsets.push_back(quint32(m_postingData.size()));
+
+    m_categoryOffsets.clear();
+    m_categoryOffsets.reserve(categoryPostings.size() + 1);
+    for (const auto &postings : categoryPostings) {
+        m_categoryOffsets.push_back(quint32(m_postingData.size()));
+        m_postingData.append(postings.data);
+    }
+    m_categoryOffsets.push_back(quint32(m_postingData.size()));
+    return true;
+}
+
+bool ItemSearchIndex::load(const QString &fileName, const QDateTime &generationDate, size_t itemCount)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream ds(&f);
+    ds.setVersion(QDataStream::Qt_5_11);
+
+    quint32 magic = 0, version = 0;
+    QDateTime date;
+    quint64 count = 0;
+    ds >> magic >> version >> date >> count;
+    if ((ds.status() != QDataStream::Ok) || (magic != CacheMagic) || (version != CacheVersion)
+            || (date != generationDate) || (count != itemCount)) {
+        return false;
+    }
+
+    std::vector<quint64> trigrams;
+    std::vector<quint32> trigramOffsets;
+    std::vector<quint32> categoryOffsets;
+    QByteArray postingData;
+
+    const quint64 maxSize = quint64(f.size());
+    if (!readVector(ds, trigrams, maxSize) || !readVector(ds, trigramOffsets, maxSize)
+            || !readVector(ds, categoryOffsets, maxSize)) {
+        return false;
+    }
+    ds >> postingData;
+    if (ds.status() != QDataStream::Ok)
+        return false;
+
+    // the offsets are used without any further checks, so better make sure they are sane
+    auto offsetsValid = [&postingData](const std::vector<quint32> &offsets) {
+        return !offsets.empty() && std::is_sorted(offsets.cbegin(), offsets.cend())
+                && (offsets.back() <= quint32(postingData.size()));
+    };
+    if ((trigramOffsets.size() != (trigrams.size() + 1)) || !offsetsValid(trigramOffsets)
+            || !offsetsValid(categoryOffsets)) {
+        return false;
+    }
+
+    m_itemCount = itemCount;
+    m_trigrams = std::move(trigrams);
+    m_trigramOffsets = std::move(trigramOffsets);
+    m_categoryOffsets = std::move(categoryOffsets);
+    m_postingData = postingData;
+    return true;
+}
+
+bool ItemSearchIndex::save(const QString &fileName, const QDateTime &generationDate) const
+{
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+
+    QDataStream ds(&f);
+    ds.setVersion(QDataStream::Qt_5_11);
+
+    ds << CacheMagic << CacheVersion << generationDate << quint64(m_itemCount);
+    writeVector(ds, m_trigrams);
+    writeVector(ds, m_trigramOffsets);
+    writeVector(ds, m_categoryOffsets);
+    ds << m_postingData;
+
+    return (ds.status() == QDataStream::Ok) && f.commit();
+}
+
+std::optional<ItemSearchIndex::Postings> ItemSearchIndex::candidates(const QString &text) const
+{
+    std::vector<quint64> textTrigrams;
+    trigrams(text, textTrigrams);
+    if (textTrigrams.empty())
+        return { };
+
+    // start with the shortest posting list, so the intermediate results stay small
+    std::vector<std::pair<quint32, quint32>> ranges;
+    for (const auto trigram : textTrigrams) {
+        auto it = std::lower_bound(m_trigrams.cbegin(), m_trigrams.cend(), trigram);
+        if ((it == m_trigrams.cend()) || (*it != trigram))
+            return Postings { }; // this trigram doesn't appear anywhere
+        const auto index = size_t(it - m_trigrams.cbegin());
+        ranges.emplace_back(m_trigramOffsets[index], m_trigramOffsets[index + 1]);
+    }
+    std::sort(ranges.begin(), ranges.end(), [](const auto &r1, const auto &r2) {
+        return (r1.second - r1.first) < (r2.second - r2.first);
+    });
+
+    Postings result = decode(ranges.front().first, ranges.front().second);
+    for (size_t i = 1; (i < ranges.size()) && !result.empty(); ++i)
+        result = intersect(result, decode(ranges[i].first, ranges[i].second));
+    return result;
+}
+
+ItemSearchIndex::Postings ItemSearchIndex::categoryItems(qsizetype categoryIndex) const
+{
+    if ((categoryIndex < 0) || (size_t(categoryIndex + 1) >= m_categoryOffsets.size()))
+        return { };
+    return decode(m_categoryOffsets[size_t(categoryIndex)], m_categoryOffsets[size_t(categoryIndex) + 1]);
+}
+
+ItemSearchIndex::Postings ItemSearchIndex::intersect(const Postings &postings1, const Postings &postings2)
+{
+    Postings result;
+    result.reserve(std::min(postings1.size(), postings2.size()));
+    std::set_intersection(postings1.cbegin(), postings1.cend(), postings2.cbegin(), postings2.cend(),
+                          std::back_inserter(result));
+    return result;
+}
+
+ItemSearchIndex::Postings ItemSearchIndex::decode(quint32 from, quint32 to) const
+{
+    Postings result;
+    const auto *data = reinterpret_cast<const uchar *>(m_postingData.constData());
+    quint32 value = 0;
+    quint32 pos = from;
+
+    while (pos < to) {
+        quint32 delta = 0;
+        int shift = 0;
+        uchar b;
+        do {
+            b = data[pos++];
+            delta |= quint32(b & 0x7f) << shift;
+            shift += 7;
+        } while ((b & 0x80) && (pos < to) && (shift < 32));
+        value += delta;
+        result.push_back(value);
+    }
+    return result;
+}
+
+} // namespace BrickLink
@@ -0,0 +1,69 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <functional>
+#include <optional>
+#include <vector>
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
+#include <QtCore/QString>
+
+
+namespace BrickLink {
+
+class Item;
+class Category;
+
+/* A trigram index over the ids and names of all items, used by ItemModel's text filter.
+ *
+ * Every item is indexed by the case folded trigrams of "<id> <name>", which is exactly the
+ * string the filter matches against. A search text with at least 3 characters is narrowed
+ * down to a few candidate items by intersecting the posting lists of its trigrams. These
+ * candidates still have to be verified, because the trigrams could come from different
+ * positions in the string.
+ * In addition, there is a posting list for every category, covering both the main and the
+ * additional categories of the items.
+ *
+ * The posting lists are delta and varint encoded, which keeps the index for ~1M items at a
+ * reasonable size. Building it takes a few seconds, so the Database builds it on a worker
+ * thread and caches it on disk.
+ */
+
+class ItemSearchIndex
+{
+public:
+    using Postings = std::vector<quint32>; // sorted item indexes
+
+    static QString matchString(const Item &item);
+
+    // returns false if isCanceled() returned true while building
+    bool build(const std::vector<Item> &items, qsizetype categoryCount,
+               const std::function<bool()> &isCanceled = { });
+
+    bool load(const QString &fileName, const QDateTime &generationDate, size_t itemCount);
+    bool save(const QString &fileName, const QDateTime &generationDate) const;
+
+    size_t itemCount() const  { return m_itemCount; }
+
+    // All items that might contain text (case insensitive), or nothing if the text is too
+    // short to be looked up via trigrams
+    std::optional<Postings> candidates(const QString &text) const;
+    Postings categoryItems(qsizetype categoryIndex) const;
+
+    static Postings intersect(const Postings &postings1, const Postings &postings2);
+
+private:
+    static void trigrams(QStringView str, std::vector<quint64> &result);
+    Postings decode(quint32 from, quint32 to) const;
+
+    size_t m_itemCount = 0;
+    std::vector<quint64> m_trigrams;        // sorted
+    std::vector<quint32> m_trigramOffsets;  // m_trigrams.size() + 1 offsets into m_postingData
+    std::vector<quint32> m_categoryOffsets; // categoryCount + 1 offsets into m_postingData
+    QByteArray m_postingData;
+};
+
+} // namespace BrickLink
@@ -1,6 +1,7 @@
 // Copyright (C) 2004-2023 Robert Griebl
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <cstring>
 #include <memory>
 #include <QRegularExpression>
 
@@ -201,4 +202,267 @@ Lot *Lot::restore(QDataStream &ds, uint startChangelogAt)
     return lot.release();
 }
 
+
+namespace {
+
+enum DeltaField : quint32 {
+    DF_Item          = 1u << 0,
+    DF_Color         = 1u << 1,
+    DF_Incomplete    = 1u << 2,
+    DF_Flags         = 1u << 3,  // status, condition, sub-condition, retain, stockroom, ...
+    DF_LotId         = 1u << 4,
+    DF_Reserved      = 1u << 5,
+    DF_Comments      = 1u << 6,
+    DF_Remarks       = 1u << 7,
+    DF_Quantity      = 1u << 8,
+    DF_BulkQuantity  = 1u << 9,
+    DF_TierQuantity  = 1u << 10,
+    DF_Sale          = 1u << 11,
+    DF_Price         = 1u << 12,
+    DF_Cost          = 1u << 13,
+    DF_TierPrice     = 1u << 14,
+    DF_Weight        = 1u << 15,
+    DF_MarkerText    = 1u << 16,
+    DF_MarkerColor   = 1u << 17,
+    DF_DateAdded     = 1u << 18,
+    DF_DateLastSold  = 1u << 19,
+};
+
+// exact comparison: a delta has to restore the original value bit by bit
+bool differs(double d1, double d2)
+{
+    return memcmp(&d1, &d2, sizeof(double)) != 0;
+}
+
+} // namespace
+
+void Lot::writeDelta(QDataStream &ds, const Lot &to) const
+{
+    quint32 fields = 0;
+
+    if (m_item != to.m_item)
+        fields |= DF_Item;
+    if (m_color != to.m_color)
+        fields |= DF_Color;
+    if ((bool(m_incomplete) != bool(to.m_incomplete))
+            || (m_incomplete && (*m_incomplete != *to.m_incomplete))) {
+        fields |= DF_Incomplete;
+    }
+    if ((m_status != to.m_status) || (m_condition != to.m_condition)
+            || (m_scondition != to.m_scondition) || (m_retain != to.m_retain)
+            || (m_stockroom != to.m_stockroom) || (m_alternate != to.m_alternate)
+            || (m_alt_id != to.m_alt_id) || (m_cpart != to.m_cpart)) {
+        fields |= DF_Flags;
+    }
+    if (m_lot_id != to.m_lot_id)
+        fields |= DF_LotId;
+    if (m_reserved != to.m_reserved)
+        fields |= DF_Reserved;
+    if (m_comments != to.m_comments)
+        fields |= DF_Comments;
+    if (m_remarks != to.m_remarks)
+        fields |= DF_Remarks;
+    if (m_quantity != to.m_quantity)
+        fields |= DF_Quantity;
+    if (m_bulk_quantity != to.m_bulk_quantity)
+        fields |= DF_BulkQuantity;
+    if (m_tier_quantity != to.m_tier_quantity)
+        fields |= DF_TierQuantity;
+    if (m_sale != to.m_sale)
+        fields |= DF_Sale;
+    if (differs(m_price, to.m_price))
+        fields |= DF_Price;
+    if (differs(m_cost, to.m_cost))
+        fields |= DF_Cost;
+    if (differs(m_tier_price[0], to.m_tier_price[0]) || differs(m_tier_price[1], to.m_tier_price[1])
+            || differs(m_tier_price[2], to.m_tier_price[2])) {
+        fields |= DF_TierPrice;
+    }
+    if (differs(m_weight, to.m_weight))
+        fields |= DF_Weight;
+    if (m_markerText != to.m_markerText)
+        fields |= DF_MarkerText;
+    if (m_markerColor != to.m_markerColor)
+        fields |= DF_MarkerColor;
+    if (m_dateAdded != to.m_dateAdded)
+        fields |= DF_DateAdded;
+    if (m_dateLastSold != to.m_dateLastSold)
+        fields |= DF_DateLastSold;
+
+    ds << fields;
+    to.writeDeltaFields(ds, fields);
+}
+
+void Lot::swapDelta(QDataStream &in, QDataStream &out)
+{
+    quint32 fields = 0;
+    in >> fields;
+    out << fields;
+    writeDeltaFields(out, fields);
+    readDeltaFields(in, fields);
+}
+
+void Lot::skipDelta(QDataStream &in, QDataStream *out)
+{
+    quint32 fields = 0;
+    in >> fields;
+    Lot scratch;
+    scratch.readDeltaFields(in, fields);
+    if (out) {
+        *out << fields;
+        scratch.writeDeltaFields(*out, fields);
+    }
+}
+
+void Lot::mergeDelta(QDataStream &in, QDataStream &other, QDataStream &out)
+{
+    quint32 fields = 0;
+    quint32 otherFields = 0;
+    Lot scratch;
+    Lot otherScratch;
+    in >> fields;
+    scratch.readDeltaFields(in, fields);
+    other >> otherFields;
+    otherScratch.readDeltaFields(other, otherFields);
+
+    // copy the missing fields over
+    if (const quint32 missing = (otherFields & ~fields)) {
+        QByteArray buffer;
+        QDataStream bufferOut(&buffer, QIODevice::WriteOnly);
+        otherScratch.writeDeltaFields(bufferOut, missing);
+        QDataStream bufferIn(buffer);
+        scratch.readDeltaFields(bufferIn, missing);
+    }
+    out << (fields | otherFields);
+    scratch.writeDeltaFields(out, fields | otherFields);
+}
+
+void Lot::writeDeltaFields(QDataStream &ds, quint32 fields) const
+{
+    if (fields & DF_Item)
+        ds << quint64(quintptr(m_item));
+    if (fields & DF_Color)
+        ds << quint64(quintptr(m_color));
+    if (fields & DF_Incomplete) {
+        ds << bool(m_incomplete);
+        if (m_incomplete) {
+            ds << m_incomplete->m_item_id << qint8(m_incomplete->m_itemtype_id)
+               << m_incomplete->m_category_id << m_incomplete->m_color_id
+               << m_incomplete->m_item_name << m_incomplete->m_itemtype_name
+               << m_incomplete->m_category_name << m_incomplete->m_color_name;
+        }
+    }
+    if (fields & DF_Flags) {
+        ds << quint8(m_status) << quint8(m_condition) << quint8(m_scondition)
+           << quint8(m_retain ? 1 : 0) << quint8(m_stockroom) << quint8(m_alternate ? 1 : 0)
+           << quint8(m_alt_id) << quint8(m_cpart ? 1 : 0);
+    }
+    if (fields & DF_LotId)
+        ds << m_lot_id;
+    if (fields & DF_Reserved)
+        ds << m_reserved;
+    if (fields & DF_Comments)
+        ds << m_comments;
+    if (fields & DF_Remarks)
+        ds << m_remarks;
+    if (fields & DF_Quantity)
+        ds << m_quantity;
+    if (fields & DF_BulkQuantity)
+        ds << m_bulk_quantity;
+    if (fields & DF_TierQuantity)
+        ds << m_tier_quantity[0] << m_tier_quantity[1] << m_tier_quantity[2];
+    if (fields & DF_Sale)
+        ds << m_sale;
+    if (fields & DF_Price)
+        ds << m_price;
+    if (fields & DF_Cost)
+        ds << m_cost;
+    if (fields & DF_TierPrice)
+        ds << m_tier_price[0] << m_tier_price[1] << m_tier_price[2];
+    if (fields & DF_Weight)
+        ds << m_weight;
+    if (fields & DF_MarkerText)
+        ds << m_markerText;
+    if (fields & DF_MarkerColor)
+        ds << m_markerColor;
+    if (fields & DF_DateAdded)
+        ds << m_dateAdded;
+    if (fields & DF_DateLastSold)
+        ds << m_dateLastSold;
+}
+
+void Lot::readDeltaFields(QDataStream &ds, quint32 fields)
+{
+    if (fields & DF_Item) {
+        quint64 item = 0;
+        ds >> item;
+        m_item = reinterpret_cast<const Item *>(quintptr(item));
+    }
+    if (fields & DF_Color) {
+        quint64 color = 0;
+        ds >> color;
+        m_color = reinterpret_cast<const Color *>(quintptr(color));
+    }
+    if (fields & DF_Incomplete) {
+        bool hasIncomplete = false;
+        ds >> hasIncomplete;
+        if (hasIncomplete) {
+            auto inc = std::make_unique<Incomplete>();
+            qint8 itemTypeId = 0;
+            ds >> inc->m_item_id >> itemTypeId >> inc->m_category_id >> inc->m_color_id
+                    >> inc->m_item_name >> inc->m_itemtype_name
+                    >> inc->m_category_name >> inc->m_color_name;
+            inc->m_itemtype_id = char(itemTypeId);
+            m_incomplete = std::move(inc);
+        } else {
+            m_incomplete.reset();
+        }
+    }
+    if (fields & DF_Flags) {
+        quint8 status = 0, cond = 0, scond = 0, retain = 0, stockroom = 0, alternate = 0,
+                altId = 0, cpart = 0;
+        ds >> status >> cond >> scond >> retain >> stockroom >> alternate >> altId >> cpart;
+        m_status = static_cast<Status>(status);
+        m_condition = static_cast<Condition>(cond);
+        m_scondition = static_cast<SubCondition>(scond);
+        m_retain = (retain);
+        m_stockroom = static_cast<Stockroom>(stockroom);
+        m_alternate = (alternate);
+        m_alt_id = altId;
+        m_cpart = (cpart);
+    }
+    if (fields & DF_LotId)
+        ds >> m_lot_id;
+    if (fields & DF_Reserved)
+        ds >> m_reserved;
+    if (fields & DF_Comments)
+        ds >> m_comments;
+    if (fields & DF_Remarks)
+        ds >> m_remarks;
+    if (fields & DF_Quantity)
+        ds >> m_quantity;
+    if (fields & DF_BulkQuantity)
+        ds >> m_bulk_quantity;
+    if (fields & DF_TierQuantity)
+        ds >> m_tier_quantity[0] >> m_tier_quantity[1] >> m_tier_quantity[2];
+    if (fields & DF_Sale)
+        ds >> m_sale;
+    if (fields & DF_Price)
+        ds >> m_price;
+    if (fields & DF_Cost)
+        ds >> m_cost;
+    if (fields & DF_TierPrice)
+        ds >> m_tier_price[0] >> m_tier_price[1] >> m_tier_price[2];
+    if (fields & DF_Weight)
+        ds >> m_weight;
+    if (fields & DF_MarkerText)
+        ds >> m_markerText;
+    if (fields & DF_MarkerColor)
+        ds >> m_markerColor;
+    if (fields & DF_DateAdded)
+        ds >> m_dateAdded;
+    if (fields & DF_DateLastSold)
+        ds >> m_dateLastSold;
+}
+
 } // namespace BrickLink
@@ -143,7 +143,21 @@ public:
     void save(QDataStream &ds) const;
     static Lot *restore(QDataStream &ds, uint startChangelogAt);
 
+    // Compact change records for undo/redo: writeDelta() only stores the fields that differ
+    // between this lot and 'to' (with the values of 'to'). swapDelta() applies such a record
+    // and writes the overwritten values as the reverse record, so applying that restores the
+    // lot. skipDelta() copies a record from 'in' to 'out' (if not nullptr) without applying it.
+    // mergeDelta() combines two records into one: fields from 'in' win, fields that are only
+    // in 'other' are added.
+    void writeDelta(QDataStream &ds, const Lot &to) const;
+    void swapDelta(QDataStream &in, QDataStream &out);
+    static void skipDelta(QDataStream &in, QDataStream *out);
+    static void mergeDelta(QDataStream &in, QDataStream &other, QDataStream &out);
+
 private:
+    void writeDeltaFields(QDataStream &ds, quint32 fields) const;
+    void readDeltaFields(QDataStream &ds, quint32 fields);
+
     const Item * m_item;
     const Color *m_color;
 
@@ -16,7 +16,9 @@
 #include "utility/utility.h"
 #include "bricklink/core.h"
 #include "bricklink/category.h"
+#include "bricklink/database.h"
 #include "bricklink/item.h"
+#include "bricklink/itemsearchindex.h"
 #include "bricklink/picture.h"
 #include "bricklink/model.h"
 #include "bricklink/model_p.h"
@@ -853,15 +855,55 @@ bool ItemModel::lessThan(const void *p1, const void *p2, int column, Qt::SortOrd
                                    (column == 2) ? i2->name() : QString::fromLatin1(i2->id())) < 0;
 }
 
+void ItemModel::prepareFilter()
+{
+    // Narrow the items down via the search index, if it is available already: filterAccepts()
+    // can then reject everything that is not a candidate without even looking at it.
+    // Negated terms and terms shorter than 3 characters cannot be looked up in the index.
+    m_filter_candidates.clear();
+
+    const auto &items = core()->items();
+    const auto searchIndex = core()->database()->itemSearchIndex();
+    if (!searchIndex || (searchIndex->itemCount() != items.size()))
+        return;
+
+    std::optional<ItemSearchIndex::Postings> candidates;
+    auto narrow = [&candidates](ItemSearchIndex::Postings &&postings) {
+        if (candidates)
+            candidates = ItemSearchIndex::intersect(*candidates, postings);
+        else
+            candidates = std::move(postings);
+    };
+
+    if (m_category_filter && (m_category_filter != CategoryModel::AllCategories))
+        narrow(searchIndex->categoryItems(m_category_filter - core()->categories().data()));
+    for (const auto &ft : std::as_const(m_filter_terms)) {
+        if (!ft.m_negate) {
+            if (auto postings = searchIndex->candidates(ft.m_text))
+                narrow(std::move(*postings));
+        }
+    }
+
+    if (candidates) {
+        m_filter_candidates.resize(qsizetype(items.size()));
+        for (const auto itemIndex : std::as_const(*candidates)) {
+            if (itemIndex < items.size())
+                m_filter_candidates.setBit(qsizetype(itemIndex));
+        }
+    }
+}
+
 bool ItemModel::filterAccepts(const void *pointer) const
 {
     const Item *item = static_cast<const Item *>(pointer);
 
     if (!item)
         return false;
+    else if (!m_filter_candidates.isEmpty() && !m_filter_candidates.testBit(pointerIndexOf(item)))
+        return false;
     else if (m_itemtype_filter && (m_itemtype_filter != ItemTypeModel::AllItemTypes) && (item->itemType() != m_itemtype_filter))
         return false;
-    else if (m_category_filter && (m_category_filter != CategoryModel::AllCategories) && !item->categories(true).contains(m_category_filter))
+    else if (m_category_filter && (m_category_filter != CategoryModel::AllCategories) && !item->hasCategory(m_category_filter))
         return false;
     else if (m_inv_filter && !item->hasInventory())
         return false;
@@ -872,7 +914,7 @@ bool ItemModel::filterAccepts(const void *pointer) const
     else if (m_year_max_filter && (!item->yearLastProduced() || (item->yearLastProduced() > m_year_max_filter)))
         return false;
     else {
-        const QString matchStr = QString::fromLatin1(item->id()) + u' ' + item->name();
+        const QString matchStr = ItemSearchIndex::matchString(*item);
 
         bool match = true;
         for (const auto &ft : m_filter_terms)
@@ -4,6 +4,7 @@
 #pragma once
 
 #include <QAbstractListModel>
+#include <QBitArray>
 #include <QSortFilterProxyModel>
 #include <QtQml/qqmlregistration.h>
 
@@ -207,6 +208,7 @@ protected:
     const void *pointerAt(int index) const override;
     int pointerIndexOf(const void *pointer) const override;
 
+    void prepareFilter() override;
     bool filterAccepts(const void *pointer) const override;
     bool lessThan(const void *pointer1, const void *pointer2, int column, Qt::SortOrder order) const override;
 
@@ -228,6 +230,7 @@ private:
     bool            m_inv_filter = false;
     int             m_year_min_filter = 0;
     int             m_year_max_filter = 0;
+    QBitArray       m_filter_candidates; // see prepareFilter()
 
     friend class Core;
 };
@@ -3,8 +3,10 @@
 
 #include <memory>
 #include <array>
+#include <algorithm>
 
 #include <QBuffer>
+#include <QDataStream>
 #include <QSaveFile>
 #include <QDirIterator>
 #include <QCoreApplication>
@@ -18,6 +20,7 @@
 #include <QtCore/QLoggingCategory>
 
 #include "bricklink/core.h"
+#include "bricklink/database.h"
 #include "bricklink/io.h"
 #include "bricklink/order.h"
 #include "bricklink/order_p.h"
@@ -858,13 +861,43 @@ void Orders::reloadOrdersFromDatabase(const QString &userId)
                 "address TEXT,"
                 "phone TEXT,"
                 "orderDataFormat INTEGER," // enum OrderDataFormat
-                "orderData BLOB NOT NULL"
+                "orderData BLOB NOT NULL,"
+                "lotsFormat INTEGER,"      // OrdersPrivate::LotsFormat
+                "lotsDatabase INTEGER,"    // BrickLink database generation, msecsSinceEpoch
+                "lots BLOB"
                 ") WITHOUT ROWID;"))) {
             qCWarning(LogSql) << "Failed to create the 'orders' table in the orders database:"
                               << createOrdersQuery.lastError().text();
             d->m_db.close();
         }
+    }
+
+    if (d->m_db.isOpen()) {
+        static constexpr int DBVersion = 2;
+
+        QSqlQuery uvQuery(u"PRAGMA user_version;"_qs, d->m_db);
+        uvQuery.next();
+        auto userVersion = uvQuery.value(0).toInt();
+        uvQuery.finish();
+
+        // DB schema upgrade code goes here...
+        if (userVersion == 1) {
+            for (const auto &column : { u"lotsFormat INTEGER"_qs, u"lotsDatabase INTEGER"_qs,
+                                        u"lots BLOB"_qs }) {
+                QSqlQuery alterQuery(u"ALTER TABLE orders ADD COLUMN "_qs + column + u';', d->m_db);
+                if (alterQuery.lastError().isValid()) {
+                    qCWarning(LogSql) << "Failed to upgrade the orders database:"
+                                      << alterQuery.lastError().text();
+                    d->m_db.close();
+                    break;
+                }
+            }
+        }
+        if (d->m_db.isOpen() && (userVersion < DBVersion)) // brand new file or upgraded
+            QSqlQuery(u"PRAGMA user_version=%1;"_qs.arg(DBVersion), d->m_db);
+    }
 
+    if (d->m_db.isOpen()) {
         d->m_importQuery = QSqlQuery(d->m_db);
         if (!d->m_importQuery.prepare(QStringLiteral(
                 "INSERT INTO orders(id,type,otherParty,date,lastUpdated,shipping,insurance,additionalCharges1,additionalCharges2,credit,creditCoupon,orderTotal,usSalesTax,vatChargeBrickLink,currencyCode,grandTotal,paymentCurrencyCode,lotCount,itemCount,cost,status,paymentType,remarks,trackingNumber,paymentStatus,paymentLastUpdated,vatChargeSeller,countryCode,address,phone,orderDataFormat,orderData)"
@@ -881,7 +914,7 @@ void Orders::reloadOrdersFromDatabase(const QString &userId)
 
         d->m_loadXmlQuery = QSqlQuery(d->m_db);
         if (!d->m_loadXmlQuery.prepare(QStringLiteral(
-                "SELECT orderDataFormat,orderData"
+                "SELECT orderDataFormat,orderData,lotsFormat,lotsDatabase,lots"
                 " FROM orders WHERE id=:id;"))) {
             qCWarning(LogSql) << "Failed to prepare load xml query for the orders database:" << d->m_loadXmlQuery.lastError().text();
         }
@@ -896,7 +929,7 @@ void Orders::reloadOrdersFromDatabase(const QString &userId)
                 "INSERT INTO orders(id,type,otherParty,date,lastUpdated,shipping,insurance,additionalCharges1,additionalCharges2,credit,creditCoupon,orderTotal,usSalesTax,vatChargeBrickLink,currencyCode,grandTotal,paymentCurrencyCode,lotCount,itemCount,cost,status,paymentType,remarks,trackingNumber,paymentStatus,paymentLastUpdated,vatChargeSeller,countryCode,orderDataFormat,orderData)"
                 " VALUES(:id,:type,:otherParty,:date,:lastUpdated,:shipping,:insurance,:additionalCharges1,:additionalCharges2,:credit,:creditCoupon,:orderTotal,:usSalesTax,:vatChargeBrickLink,:currencyCode,:grandTotal,:paymentCurrencyCode,:lotCount,:itemCount,:cost,:status,:paymentType,:remarks,:trackingNumber,:paymentStatus,:paymentLastUpdated,:vatChargeSeller,:countryCode,:orderDataFormat,:orderData)"
                 " ON CONFLICT(id) DO UPDATE"
-                " SET type=excluded.type,otherParty=excluded.otherParty,date=excluded.date,lastUpdated=excluded.lastUpdated,shipping=excluded.shipping,insurance=excluded.insurance,additionalCharges1=excluded.additionalCharges1,additionalCharges2=excluded.additionalCharges2,credit=excluded.credit,creditCoupon=excluded.creditCoupon,orderTotal=excluded.orderTotal,usSalesTax=excluded.usSalesTax,vatChargeBrickLink=excluded.vatChargeBrickLink,currencyCode=excluded.currencyCode,grandTotal=excluded.grandTotal,paymentCurrencyCode=excluded.paymentCurrencyCode,lotCount=excluded.lotCount,itemCount=excluded.itemCount,cost=excluded.cost,status=excluded.status,paymentType=excluded.paymentType,remarks=excluded.remarks,trackingNumber=excluded.trackingNumber,paymentStatus=excluded.paymentStatus,paymentLastUpdated=excluded.paymentLastUpdated,vatChargeSeller=excluded.vatChargeSeller,countryCode=excluded.countryCode,orderDataFormat=excluded.orderDataFormat,orderData=excluded.orderData;"))) {
+                " SET type=excluded.type,otherParty=excluded.otherParty,date=excluded.date,lastUpdated=excluded.lastUpdated,shipping=excluded.shipping,insurance=excluded.insurance,additionalCharges1=excluded.additionalCharges1,additionalCharges2=excluded.additionalCharges2,credit=excluded.credit,creditCoupon=excluded.creditCoupon,orderTotal=excluded.orderTotal,usSalesTax=excluded.usSalesTax,vatChargeBrickLink=excluded.vatChargeBrickLink,currencyCode=excluded.currencyCode,grandTotal=excluded.grandTotal,paymentCurrencyCode=excluded.paymentCurrencyCode,lotCount=excluded.lotCount,itemCount=excluded.itemCount,cost=excluded.cost,status=excluded.status,paymentType=excluded.paymentType,remarks=excluded.remarks,trackingNumber=excluded.trackingNumber,paymentStatus=excluded.paymentStatus,paymentLastUpdated=excluded.paymentLastUpdated,vatChargeSeller=excluded.vatChargeSeller,countryCode=excluded.countryCode,orderDataFormat=excluded.orderDataFormat,orderData=excluded.orderData,lotsFormat=NULL,lotsDatabase=NULL,lots=NULL;"))) {
             qCWarning(LogSql) << "Failed to prepare save order query for the orders database:" << d->m_saveOrderQuery.lastError().text();
         }
 
@@ -907,33 +940,28 @@ void Orders::reloadOrdersFromDatabase(const QString &userId)
                 " SET updated=excluded.updated;"))) {
             qCWarning(LogSql) << "Failed to prepare save update query for the orders database:" << d->m_saveUpdatedQuery.lastError().text();
         }
+
+        d->m_saveLotsQuery = QSqlQuery(d->m_db);
+        if (!d->m_saveLotsQuery.prepare(QStringLiteral(
+                "UPDATE orders SET lotsFormat=:lotsFormat,lotsDatabase=:lotsDatabase,lots=:lots WHERE id=:id;"))) {
+            qCWarning(LogSql) << "Failed to prepare save lots query for the orders database:" << d->m_saveLotsQuery.lastError().text();
+        }
     }
 
     QDateTime lastUpdated;
 
     if (d->m_db.isOpen()) {
-        static constexpr int DBVersion = 1;
-
         {
             QSqlQuery jnlQuery(u"PRAGMA journal_mode = wal;"_qs, d->m_db);
             if (jnlQuery.lastError().isValid())
                 qCWarning(LogSql) << "Failed to set journaling mode to 'wal' on the orders database:"
                                   << jnlQuery.lastError();
         }
-        {
-            QSqlQuery uvQuery(u"PRAGMA user_version;"_qs, d->m_db);
-            uvQuery.next();
-            auto userVersion = uvQuery.value(0).toInt();
-            if (userVersion == 0) // brand new file, bump version
-                QSqlQuery(u"PRAGMA user_version=%1;"_qs.arg(DBVersion), d->m_db);
-        }
         {
             QSqlQuery updatedQuery(u"SELECT updated FROM status WHERE id=0;"_qs, d->m_db);
             if (updatedQuery.next())
                 lastUpdated = QDateTime::fromMSecsSinceEpoch(updatedQuery.value(0).toLongLong());
         }
-
-        // DB schema upgrade code goes here...
     }
 
     setUpdateStatus(lastUpdated.isValid() ? UpdateStatus::Ok : UpdateStatus::UpdateFailed);
@@ -1455,8 +1483,20 @@ LotList Orders::loadOrderLots(const Order *order) const
     if (!d->m_loadXmlQuery.next())
         throw Exception("could not find order %1 in database").arg(order->id());
 
+    // try the binary cache first: this avoids parsing the XML and resolving all the lots
+    const qint64 databaseGeneration = d->m_core->database()->lastUpdated().toMSecsSinceEpoch();
+
+    if ((d->m_loadXmlQuery.value(u"lotsFormat"_qs).toInt() == OrdersPrivate::LotsFormat)
+            && (d->m_loadXmlQuery.value(u"lotsDatabase"_qs).toLongLong() == databaseGeneration)) {
+        LotList lots = OrdersPrivate::restoreLots(d->m_loadXmlQuery.value(u"lots"_qs).toByteArray());
+        if (!lots.isEmpty())
+            return lots;
+    }
+
     auto format = OrdersPrivate::OrderDataFormat(d->m_loadXmlQuery.value(u"orderDataFormat"_qs).toInt());
     auto data = d->m_loadXmlQuery.value(u"orderData"_qs).toByteArray();
+    finishGuard.dismiss();
+    d->m_loadXmlQuery.finish();
 
     switch (format) {
     case OrdersPrivate::Format_XML:
@@ -1469,7 +1509,61 @@ LotList Orders::loadOrderLots(const Order *order) const
         break;
     }
     auto pr = IO::fromBrickLinkXML(data, IO::Hint::Order);
-    return pr.takeLots();
+    LotList lots = pr.takeLots();
+
+    // Only cache completely resolved lots: incomplete ones need to go through
+    // Core::resolveIncomplete() on every load
+    bool allResolved = !lots.isEmpty() && std::none_of(lots.cbegin(), lots.cend(), [](const Lot *lot) {
+        return lot->isIncomplete();
+    });
+    if (allResolved) {
+        d->m_saveLotsQuery.bindValue(u":id"_qs, order->id());
+        d->m_saveLotsQuery.bindValue(u":lotsFormat"_qs, OrdersPrivate::LotsFormat);
+        d->m_saveLotsQuery.bindValue(u":lotsDatabase"_qs, databaseGeneration);
+        d->m_saveLotsQuery.bindValue(u":lots"_qs, OrdersPrivate::saveLots(lots));
+
+        if (!d->m_saveLotsQuery.exec()) {
+            qCWarning(LogSql) << "Failed to cache the lots of order" << order->id() << "in the database:"
+                              << d->m_saveLotsQuery.lastError().text();
+        }
+        d->m_saveLotsQuery.finish();
+    }
+    return lots;
+}
+
+QByteArray OrdersPrivate::saveLots(const LotList &lots)
+{
+    QByteArray data;
+    QDataStream ds(&data, QIODevice::WriteOnly);
+    ds << QByteArray("OLOT") << qint32(LotsFormat) << quint32(lots.count());
+    for (const Lot *lot : lots)
+        lot->save(ds);
+    return data;
+}
+
+LotList OrdersPrivate::restoreLots(const QByteArray &data)
+{
+    QDataStream ds(data);
+
+    QByteArray tag;
+    qint32 version;
+    quint32 count = 0;
+    ds >> tag >> version >> count;
+    if ((ds.status() != QDataStream::Ok) || (tag != "OLOT") || (version != LotsFormat) || (count > 1000000))
+        return { };
+
+    LotList lots;
+    lots.reserve(count);
+    for (; count; --count) {
+        Lot *lot = Lot::restore(ds, 0);
+        if (!lot || lot->isIncomplete()) { // the database has changed after all
+            delete lot;
+            qDeleteAll(lots);
+            return { };
+        }
+        lots << lot;
+    }
+    return lots;
 }
 
 Order *Orders::order(int index) const
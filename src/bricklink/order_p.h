@@ -72,11 +72,20 @@ public:
     QSqlQuery m_saveAddressQuery;
     QSqlQuery m_saveOrderQuery;
     QSqlQuery m_saveUpdatedQuery;
+    QSqlQuery m_saveLotsQuery;
 
     enum OrderDataFormat {
         Format_XML = 0,
         Format_CompressedXML,
     };
+
+    // The 'lots' column caches the parsed and resolved lots of the order XML (which is the
+    // source of truth) as a Lot::save() stream. It is only valid if 'lotsFormat' matches and
+    // 'lotsDatabase' matches the generation date of the current BrickLink database.
+    static constexpr int LotsFormat = 1;
+
+    static QByteArray saveLots(const LotList &lots);
+    static LotList restoreLots(const QByteArray &data);
 };
 
 } // namespace BrickLink
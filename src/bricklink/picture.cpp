@@ -7,6 +7,7 @@
 #include <QtCore/QUrlQuery>
 #include <QtCore/QBuffer>
 #include <QtCore/QLoggingCategory>
+#include <QtCore/QThreadPool>
 #include <QtNetwork/QNetworkInformation>
 #include <QtSql/QSqlError>
 #include <QtSql/QSqlQuery>
@@ -15,6 +16,7 @@
 #include "bricklink/picture_p.h"
 #include "bricklink/item.h"
 #include "bricklink/core.h"
+#include "bricklink/sqlcache_p.h"
 #include "utility/appstatistics.h"
 #include "utility/transfer.h"
 
@@ -41,12 +43,35 @@ const QImage Picture::image() const
     return m_image;
 }
 
+QImage Picture::thumbnail(const QSize &boundingSize, qreal devicePixelRatio)
+{
+    if (m_image.isNull() || boundingSize.isEmpty())
+        return { };
+
+    const QSize bucket = PictureCachePrivate::thumbnailBucket(boundingSize);
+    const QSize size = PictureCachePrivate::thumbnailSize(m_image, bucket, devicePixelRatio);
+
+    for (const auto &thumbnail : std::as_const(m_thumbnails)) {
+        if ((thumbnail.size() == size) && qFuzzyCompare(thumbnail.devicePixelRatio(), devicePixelRatio))
+            return thumbnail;
+    }
+
+    // Not pre-scaled by a loader thread: the smooth thumbnail is created in the background
+    // (and the size is remembered for future loads). Until then, a fast scaled image has to do.
+    if (s_cache)
+        s_cache->d->thumbnailMissed(this, bucket, devicePixelRatio);
+    return PictureCachePrivate::createThumbnail(m_image, size, devicePixelRatio, Qt::FastTransformation);
+}
+
 int Picture::cost() const
 {
     if (m_image.isNull())
         return 1;
-    else
-        return int(m_image.sizeInBytes() / 1024);
+
+    qsizetype bytes = m_image.sizeInBytes();
+    for (const auto &thumbnail : m_thumbnails)
+        bytes += thumbnail.sizeInBytes();
+    return int(bytes / 1024);
 }
 
 void Picture::setIsValid(bool valid)
@@ -77,6 +102,7 @@ void Picture::setImage(const QImage &newImage)
 {
     if (newImage != m_image) {
         m_image = newImage;
+        m_thumbnails.clear();
         emit imageChanged(m_image);
     }
 }
@@ -112,6 +138,8 @@ PictureCache::PictureCache(Core *core, quint64 physicalMem)
     d->m_cacheStatId = AppStatistics::inst()->addSource(u"Pictures in memory cache"_qs);
     d->m_loadsStatId = AppStatistics::inst()->addSource(u"Pictures queued for disk load"_qs);
     d->m_savesStatId = AppStatistics::inst()->addSource(u"Pictures queued for disk save"_qs);
+    d->m_diskSizeStatId = AppStatistics::inst()->addSource(u"Picture disk cache size"_qs, u"MB"_qs);
+    d->m_diskEvictedStatId = AppStatistics::inst()->addSource(u"Pictures evicted from disk cache"_qs);
 
     // The max. pic cache size is at least 500MB. On 64bit systems, this gets expanded to a quarter
     // of the physical memory, but it is capped at 4GB
@@ -226,11 +254,11 @@ PictureCache::PictureCache(Core *core, quint64 physicalMem)
     }
 #endif
 
-    //TODO: on mobile: if DB size > maxSize, remove old entries until size <= maxSize
-
     for (int i = 0; i < 1 /*qMax(2, QThread::idealThreadCount() / 4)*/; ++i)
         d->m_threads.append(QThread::create(&PictureCachePrivate::saveThread, d, d->m_db.connectionName(), i));
-    for (int i = 0; i < qMax(2, QThread::idealThreadCount()); ++i)
+    d->m_loadThreadCount = qMax(2, QThread::idealThreadCount());
+    d->m_loadQueue = std::make_unique<PriorityWorkQueue<Picture *>>(d->m_loadThreadCount);
+    for (int i = 0; i < d->m_loadThreadCount; ++i)
         d->m_threads.append(QThread::create(&PictureCachePrivate::loadThread, d, d->m_db.connectionName(), i));
 
     for (auto *thread : d->m_threads)
@@ -239,15 +267,18 @@ PictureCache::PictureCache(Core *core, quint64 physicalMem)
 
 PictureCache::~PictureCache()
 {
+    // the results of already finished jobs are still queued for q, but those get discarded
+    d->m_thumbnailPool.waitForDone();
     d->m_stop = true;
-    d->m_loadMutex.lock();
-    d->m_loadTrigger.wakeAll();
-    d->m_loadMutex.unlock();
+    d->m_loadQueue->abort();
     d->m_saveMutex.lock();
     d->m_saveTrigger.wakeAll();
     d->m_saveMutex.unlock();
     for (auto *thread : d->m_threads)
         thread->wait();
+    const auto notLoaded = d->m_loadQueue->takeAll();
+    for (auto *pic : notLoaded)
+        pic->release();
     d->m_db.close();
     delete d;
     Picture::s_cache = nullptr;
@@ -258,6 +289,15 @@ void PictureCache::setUpdateInterval(int interval)
     d->m_updateInterval = interval;
 }
 
+void PictureCache::setDiskCacheLimit(qint64 bytes)
+{
+    if (d->m_diskCacheLimit.fetchAndStoreRelaxed(bytes) != bytes) {
+        QMutexLocker locker(&d->m_saveMutex);
+        d->m_diskMaintenanceNeeded = true;
+        d->m_saveTrigger.wakeAll();
+    }
+}
+
 void PictureCache::clearCache()
 {
     // Ideally we would just clear() the caches here, but there could be ref'ed objects
@@ -408,6 +448,65 @@ bool PictureCachePrivate::imageFromData(QImage &img, const QByteArray &data)
     return valid;
 }
 
+QSize PictureCachePrivate::thumbnailBucket(const QSize &boundingSize)
+{
+    auto bucket = [](int v) { return (v < 16) ? v : (v & ~7); };
+    return { bucket(boundingSize.width()), bucket(boundingSize.height()) };
+}
+
+QSize PictureCachePrivate::thumbnailSize(const QImage &img, const QSize &bucket, qreal dpr)
+{
+    return img.size().scaled(bucket * dpr, Qt::KeepAspectRatio);
+}
+
+QImage PictureCachePrivate::createThumbnail(const QImage &img, const QSize &size, qreal dpr,
+                                            Qt::TransformationMode mode)
+{
+    if (img.isNull() || size.isEmpty())
+        return { };
+
+    // premultiplied (or opaque) 32bit images can be blitted without any conversion
+    auto format = img.hasAlphaChannel() ? QImage::Format_ARGB32_Premultiplied : QImage::Format_RGB32;
+    QImage thumbnail = img.scaled(size, Qt::IgnoreAspectRatio, mode).convertToFormat(format);
+    thumbnail.setDevicePixelRatio(dpr);
+    return thumbnail;
+}
+
+void PictureCachePrivate::thumbnailMissed(Picture *pic, const QSize &bucket, qreal dpr)
+{
+    m_thumbnailMutex.lock();
+    std::pair<QSize, qreal> thumbnailSize { bucket, dpr };
+    if (m_thumbnailSizes.isEmpty() || (m_thumbnailSizes.constLast() != thumbnailSize)) {
+        m_thumbnailSizes.removeOne(thumbnailSize);
+        if (m_thumbnailSizes.size() >= MaxThumbnails)
+            m_thumbnailSizes.removeFirst();
+        m_thumbnailSizes.append(thumbnailSize);
+    }
+    m_thumbnailMutex.unlock();
+
+    // only one background scaling job per picture: other sizes will be handled on the next paint
+    if (pic->m_thumbnailPending)
+        return;
+    pic->m_thumbnailPending = true;
+    pic->addRef();
+
+    m_thumbnailPool.start([this, pic, image = pic->m_image, bucket, dpr]() {
+        auto thumbnail = createThumbnail(image, PictureCachePrivate::thumbnailSize(image, bucket, dpr), dpr);
+
+        QMetaObject::invokeMethod(q, [this, pic, image, thumbnail]() {
+            pic->m_thumbnailPending = false;
+            if (!thumbnail.isNull() && (pic->m_image.cacheKey() == image.cacheKey())) {
+                if (pic->m_thumbnails.size() >= MaxThumbnails)
+                    pic->m_thumbnails.removeFirst();
+                pic->m_thumbnails.append(thumbnail);
+                m_cache.setObjectCost(cacheKey(pic->item(), pic->color()), pic->cost());
+                emit q->pictureUpdated(pic);
+            }
+            pic->release();
+        }, Qt::QueuedConnection);
+    });
+}
+
 bool PictureCachePrivate::isUpdateNeeded(Picture *pic) const
 {
     return (m_updateInterval > 0)
@@ -421,31 +520,15 @@ void PictureCachePrivate::load(Picture *pic, bool highPriority)
         return;
 
     pic->addRef();
-    m_loadMutex.lock();
-    m_loadQueue.insert(highPriority ? 0 : m_loadQueue.size(),
-                       { pic, highPriority ? LoadHighPriority : LoadLowPriority });
-    m_loadTrigger.wakeOne();
-    auto queueSize = m_loadQueue.size();
-    m_loadMutex.unlock();
-
-    AppStatistics::inst()->update(m_loadsStatId, queueSize);
+    if (!m_loadQueue->add(pic, highPriority))
+        pic->release(); // already queued
+    AppStatistics::inst()->update(m_loadsStatId, m_loadQueue->size());
 }
 
 void PictureCachePrivate::reprioritize(Picture *pic, bool highPriority)
 {
-    if (!pic)
-        return;
-
-    m_loadMutex.lock();
-    for (auto i = 0; i < m_loadQueue.size(); ++i) {
-        auto &lq = m_loadQueue[i];
-        if (lq.first == pic) {
-            lq.second = highPriority ? LoadHighPriority : LoadLowPriority;
-            m_loadQueue.move(i, highPriority ? 0 : m_loadQueue.size());
-            break;
-        }
-    }
-    m_loadMutex.unlock();
+    if (pic)
+        m_loadQueue->reprioritize(pic, highPriority);
 }
 
 void PictureCachePrivate::save(Picture *pic)
@@ -468,93 +551,138 @@ void PictureCachePrivate::loadThread(QString dbName, int index)
     auto db = QSqlDatabase::cloneDatabase(dbName, dbName + u"_Reader_" + QString::number(index));
     db.open();
 
+    // We always bind MaxLoadBatchSize ids: smaller batches are padded by repeating the first id,
+    // so a single prepared statement is enough.
+    QString placeholders = u"?"_qs;
+    for (qsizetype i = 1; i < MaxLoadBatchSize; ++i)
+        placeholders.append(u",?"_qs);
+
     QSqlQuery loadQuery(db);
-    loadQuery.prepare(u"SELECT updated,data FROM pic WHERE id=:id;"_qs);
+    loadQuery.prepare(u"SELECT id,updated,data FROM pic WHERE id IN (" + placeholders + u");");
 
     while (!m_stop) {
-        QMutexLocker locker(&m_loadMutex);
-        if (m_loadQueue.isEmpty())
-            m_loadTrigger.wait(&m_loadMutex);
-
-        if (m_stop) {
-            for (auto [pic, type] : m_loadQueue)
-                pic->release();
+        // there are multiple loader threads, so this only returns our fair share of the queue
+        const auto batch = m_loadQueue->take(index, MaxLoadBatchSize);
+        if (batch.isEmpty())
             continue;
-        }
 
-        if (!m_loadQueue.isEmpty()) {
-            auto [pic, loadType] = m_loadQueue.takeFirst();
-            auto queueSize = m_loadQueue.size();
-            locker.unlock();
+        AppStatistics::inst()->update(m_loadsStatId, m_loadQueue->size());
 
-            AppStatistics::inst()->update(m_loadsStatId, queueSize);
+        QStringList dbTags;
+        dbTags.reserve(batch.size());
+        for (const auto &[pic, highPriority] : batch)
+            dbTags.append(databaseTag(pic));
 
-            bool loaded = false;
-            QDateTime lastUpdated;
-            QImage img;
-            bool highPriority = (loadType == LoadHighPriority);
-            bool convertedFromOldCache = false;
+        QHash<QString, std::pair<QDateTime, QByteArray>> dbRows;
 
-            if (db.isOpen()) {
-                loadQuery.bindValue(u":id"_qs, databaseTag(pic));
-
-                loadQuery.exec();
-                if (loadQuery.next()) {
-                    lastUpdated = loadQuery.isNull(0) ? QDateTime()
-                                                      : QDateTime::fromMSecsSinceEpoch(loadQuery.value(0).toLongLong());
-                    auto data = loadQuery.value(1).toByteArray();
-                    loaded = imageFromData(img, data);
+        if (db.isOpen()) {
+            for (qsizetype i = 0; i < MaxLoadBatchSize; ++i)
+                loadQuery.bindValue(int(i), dbTags.at((i < dbTags.size()) ? i : 0));
+
+            if (loadQuery.exec()) {
+                while (loadQuery.next()) {
+                    auto lastUpdated = loadQuery.isNull(1) ? QDateTime()
+                                                           : QDateTime::fromMSecsSinceEpoch(loadQuery.value(1).toLongLong());
+                    dbRows.insert(loadQuery.value(0).toString(),
+                                  { lastUpdated, loadQuery.value(2).toByteArray() });
                 }
-                loadQuery.finish();
+            } else {
+                qCWarning(LogSql) << "Failed to load pictures:" << loadQuery.lastError().text();
+            }
+            loadQuery.finish();
+        }
+
+        m_thumbnailMutex.lock();
+        const auto thumbnailSizes = m_thumbnailSizes;
+        m_thumbnailMutex.unlock();
+
+        QVector<LoadResult> results;
+        results.reserve(batch.size());
+
+        for (qsizetype i = 0; i < batch.size(); ++i) {
+            LoadResult r;
+            r.pic = batch.at(i).first;
+            r.highPriority = batch.at(i).second;
+
+            if (auto it = dbRows.constFind(dbTags.at(i)); it != dbRows.cend()) {
+                r.lastUpdated = it->first;
+                r.loaded = imageFromData(r.image, it->second);
             }
             // try the old filesystem based cache
-            if (!loaded) {
-                bool large = (!pic->color());
-                bool hasColors = pic->item()->itemType()->hasColors();
-                QFile *f = m_core->dataReadFile(large ? u"large.jpg" : u"normal.png", pic->item(),
-                                                (!large && hasColors) ? pic->color() : nullptr);
+            if (!r.loaded) {
+                bool large = (!r.pic->color());
+                bool hasColors = r.pic->item()->itemType()->hasColors();
+                QFile *f = m_core->dataReadFile(large ? u"large.jpg" : u"normal.png", r.pic->item(),
+                                                (!large && hasColors) ? r.pic->color() : nullptr);
                 if (f && f->isOpen()) {
-                    lastUpdated = f->fileTime(QFile::FileModificationTime);
+                    r.lastUpdated = f->fileTime(QFile::FileModificationTime);
                     if (f->size() > 0)
-                        convertedFromOldCache = loaded = imageFromData(img, f->readAll());
+                        r.convertedFromOldCache = r.loaded = imageFromData(r.image, f->readAll());
                     f->remove();
                 }
                 delete f;
             }
-
-            pic->addRef(); // the release will happen on the main thread (see the invokeMethod below)
-            QMetaObject::invokeMethod(m_core, [=, this, pic=pic]() { // clang bug: P1091R3
-                if (loaded) {
-                    pic->setLastUpdated(lastUpdated);
-                    pic->setImage(img);
-
-                    // update the last accessed time stamp
-                    pic->addRef();
-                    m_saveMutex.lock();
-                    m_saveQueue.append({ pic, convertedFromOldCache ? SaveData : SaveAccessTimeOnly });
-                    m_saveTrigger.wakeOne();
-                    m_saveMutex.unlock();
+            // scaling is expensive, so do it here instead of in the UI's paint code
+            if (r.loaded && !r.image.isNull()) {
+                for (const auto &ts : thumbnailSizes) {
+                    const qreal dpr = ts.second;
+                    const QSize size = thumbnailSize(r.image, ts.first, dpr);
+                    auto it = std::find_if(r.thumbnails.cbegin(), r.thumbnails.cend(), [=](const QImage &t) {
+                        return (t.size() == size) && qFuzzyCompare(t.devicePixelRatio(), dpr);
+                    });
+                    if (it == r.thumbnails.cend())
+                        r.thumbnails.append(createThumbnail(r.image, size, dpr));
                 }
-                pic->setIsValid(loaded);
-                pic->setUpdateStatus(UpdateStatus::Ok);
+            }
+            results.append(r);
+        }
 
-                if (pic->m_updateAfterLoad || isUpdateNeeded(pic))  {
-                    pic->m_updateAfterLoad = false;
-                    q->updatePicture(pic, highPriority);
-                }
-                if (loaded && img.isNull())
-                    pic->setIsValid(false);
+        // the refs from load() are handed over and will be released on the main thread
+        QMetaObject::invokeMethod(m_core, [this, results = std::move(results)]() {
+            loadFinished(results);
+        }, Qt::QueuedConnection);
+    }
+    db.close();
+}
 
-                m_cache.setObjectCost(cacheKey(pic->item(), pic->color()), pic->cost());
+void PictureCachePrivate::loadFinished(const QVector<LoadResult> &results)
+{
+    QVector<std::pair<Picture *, SaveType>> saves;
 
-                emit q->pictureUpdated(pic);
-                pic->release();
-            }, Qt::QueuedConnection);
+    for (const auto &r : results) {
+        Picture *pic = r.pic;
 
-            pic->release();
+        if (r.loaded) {
+            pic->setLastUpdated(r.lastUpdated);
+            pic->setImage(r.image);
+            pic->m_thumbnails = r.thumbnails;
+
+            // update the last accessed time stamp
+            pic->addRef();
+            saves.append({ pic, r.convertedFromOldCache ? SaveData : SaveAccessTimeOnly });
         }
+        pic->setIsValid(r.loaded);
+        pic->setUpdateStatus(UpdateStatus::Ok);
+
+        if (pic->m_updateAfterLoad || isUpdateNeeded(pic))  {
+            pic->m_updateAfterLoad = false;
+            q->updatePicture(pic, r.highPriority);
+        }
+        if (r.loaded && r.image.isNull())
+            pic->setIsValid(false);
+
+        m_cache.setObjectCost(cacheKey(pic->item(), pic->color()), pic->cost());
+
+        emit q->pictureUpdated(pic);
+        pic->release();
+    }
+
+    if (!saves.isEmpty()) {
+        m_saveMutex.lock();
+        m_saveQueue.append(saves);
+        m_saveTrigger.wakeOne();
+        m_saveMutex.unlock();
     }
-    db.close();
 }
 
 void PictureCachePrivate::saveThread(QString dbName, int index)
@@ -570,9 +698,15 @@ void PictureCachePrivate::saveThread(QString dbName, int index)
     QSqlQuery accessQuery(db);
     accessQuery.prepare(u"UPDATE pic SET accessed=:accessed WHERE id=:id;"_qs);
 
+    SqlCache::setup(db, u"pic"_qs);
+    int savesSinceMaintenance = 0;
+
     while (!m_stop) {
+        if (m_diskMaintenanceNeeded.testAndSetRelaxed(1, 0))
+            diskMaintenance(db);
+
         QMutexLocker locker(&m_saveMutex);
-        if (m_saveQueue.isEmpty())
+        if (m_saveQueue.isEmpty() && !m_diskMaintenanceNeeded.loadRelaxed())
             m_saveTrigger.wait(&m_saveMutex);
 
         if (!m_saveQueue.isEmpty()) {
@@ -640,12 +774,30 @@ void PictureCachePrivate::saveThread(QString dbName, int index)
                     pic->release();
                 }
                 db.commit();
+
+                savesSinceMaintenance += int(imageDataHash.size());
+                if (savesSinceMaintenance >= DiskMaintenanceInterval) {
+                    savesSinceMaintenance = 0;
+                    m_diskMaintenanceNeeded = true;
+                }
             }
         }
     }
     db.close();
 }
 
+void PictureCachePrivate::diskMaintenance(QSqlDatabase &db)
+{
+    auto result = SqlCache::maintain(db, u"pic"_qs, m_diskCacheLimit.loadRelaxed(), m_stop);
+
+    if (result.evictedCount) {
+        m_diskEvictedCount += result.evictedCount;
+        qCInfo(LogCache) << "Evicted" << result.evictedCount << "entries from the picture disk cache";
+    }
+    AppStatistics::inst()->update(m_diskSizeStatId, result.size / 1'000'000);
+    AppStatistics::inst()->update(m_diskEvictedStatId, m_diskEvictedCount);
+}
+
 void PictureCachePrivate::transferJobFinished(TransferJob *j, Picture *pic)
 {
     Q_ASSERT(pic && (j == pic->m_transferJob));
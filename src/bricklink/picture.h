@@ -4,6 +4,7 @@
 #pragma once
 
 #include <QtCore/QDateTime>
+#include <QtCore/QVector>
 #include <QtGui/QImage>
 #include <QtQml/qqmlregistration.h>
 
@@ -41,6 +42,7 @@ public:
     UpdateStatus updateStatus() const { return m_updateStatus; }
 
     const QImage image() const;
+    QImage thumbnail(const QSize &boundingSize, qreal devicePixelRatio);
 
     int cost() const;
 
@@ -63,14 +65,16 @@ private:
 
     QDateTime    m_lastUpdated;
 
-    bool         m_valid           : 1 = false;
-    bool         m_updateAfterLoad : 1 = false;
-    UpdateStatus m_updateStatus    : 3 = UpdateStatus::Ok;
-    uint         m_reserved        : 27 = 0;
+    bool         m_valid            : 1 = false;
+    bool         m_updateAfterLoad  : 1 = false;
+    bool         m_thumbnailPending : 1 = false;
+    UpdateStatus m_updateStatus     : 3 = UpdateStatus::Ok;
+    uint         m_reserved         : 26 = 0;
 
     TransferJob *m_transferJob = nullptr;
 
     QImage       m_image;
+    QVector<QImage> m_thumbnails;
 
     static PictureCache *s_cache;
 
@@ -97,6 +101,7 @@ public:
     ~PictureCache() override;
 
     void setUpdateInterval(int interval);
+    void setDiskCacheLimit(qint64 bytes);
     void clearCache();
     QPair<int, int> cacheStats() const;
 
@@ -111,6 +116,8 @@ signals:
 
 private:
     PictureCachePrivate *d;
+
+    friend class Picture;
 };
 
 } // namespace BrickLink
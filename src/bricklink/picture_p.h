@@ -3,13 +3,19 @@
 
 #pragma once
 
+#include <memory>
+
 #include <QtCore/QByteArray>
+#include <QtCore/QDateTime>
 #include <QtCore/QAtomicInt>
 #include <QtCore/QMutex>
+#include <QtCore/QThreadPool>
 #include <QtCore/QWaitCondition>
 #include <QtCore/QVector>
 #include <QtSql/QSqlDatabase>
+#include <QtGui/QImage>
 
+#include "utility/priorityworkqueue.h"
 #include "utility/q3cache.h"
 #include "global.h"
 
@@ -24,26 +30,40 @@ class PictureCachePrivate
 {
 public:
     QAtomicInt m_stop = false;
-    QMutex m_loadMutex;
     QMutex m_saveMutex;
-    QWaitCondition m_loadTrigger;
     QWaitCondition m_saveTrigger;
 
-    enum LoadType {
-        LoadHighPriority,
-        LoadLowPriority,
-    };
-
     enum SaveType {
         SaveData,
         SaveAccessTimeOnly,
     };
 
-    QVector<std::pair<Picture *, LoadType>> m_loadQueue;
+    struct LoadResult {
+        Picture *pic = nullptr;
+        bool highPriority = false;
+        bool loaded = false;
+        bool convertedFromOldCache = false;
+        QDateTime lastUpdated;
+        QImage image;
+        QVector<QImage> thumbnails;
+    };
+
+    // the max. number of pictures a loader thread fetches from the database in one query
+    static constexpr qsizetype MaxLoadBatchSize = 64;
+
+    // the thumbnail buckets and device pixel ratios recently requested by the UI: the loader
+    // threads pre-scale every picture for these
+    static constexpr qsizetype MaxThumbnails = 3;
+    QMutex m_thumbnailMutex;
+    QVector<std::pair<QSize, qreal>> m_thumbnailSizes;
+    QThreadPool m_thumbnailPool; // the background scaling jobs reference this object
+
+    std::unique_ptr<PriorityWorkQueue<Picture *>> m_loadQueue;
     QVector<std::pair<Picture *, SaveType>> m_saveQueue;
     QString m_dbName;
     QSqlDatabase m_db;
     QVector<QThread *> m_threads;
+    int m_loadThreadCount = 0;
 
     int m_updateInterval = 0;
     Q3Cache<quint32, Picture> m_cache;
@@ -53,16 +73,34 @@ public:
     int m_loadsStatId = -1;
     int m_savesStatId = -1;
 
+    // the disk space is managed by the saver thread
+    static constexpr int DiskMaintenanceInterval = 1000; // check the limit every n saves
+    QAtomicInteger<qint64> m_diskCacheLimit = 0; // in bytes, 0 means unlimited
+    QAtomicInt m_diskMaintenanceNeeded = true;
+    qsizetype m_diskEvictedCount = 0;
+    int m_diskSizeStatId = -1;
+    int m_diskEvictedStatId = -1;
+
     static quint32 cacheKey(const Item *item, const Color *color);
     static QString databaseTag(Picture *pic);
     static bool imageFromData(QImage &img, const QByteArray &data);
+    // Thumbnails are created for size buckets instead of the exact cell sizes, so resizing a
+    // column or zooming only rarely needs new ones. Buckets are rounded down: a thumbnail
+    // always fits into the requested size.
+    static QSize thumbnailBucket(const QSize &boundingSize);
+    static QSize thumbnailSize(const QImage &img, const QSize &bucket, qreal dpr);
+    static QImage createThumbnail(const QImage &img, const QSize &size, qreal dpr,
+                                  Qt::TransformationMode mode = Qt::SmoothTransformation);
+    void thumbnailMissed(Picture *pic, const QSize &bucket, qreal dpr);
     bool isUpdateNeeded(Picture *pic) const;
 
     void load(Picture *pic, bool highPriority);
     void reprioritize(Picture *pic, bool highPriority);
     void save(Picture *pic);
     void loadThread(QString dbName, int index);
+    void loadFinished(const QVector<LoadResult> &results);
     void saveThread(QString dbName, int index);
+    void diskMaintenance(QSqlDatabase &db);
     void transferJobFinished(TransferJob *j, Picture *pic);
 };
 
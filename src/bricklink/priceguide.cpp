@@ -2,6 +2,11 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
 #include <QtCore/QLocale>
 #include <QtCore/QFile>
 #include <QtCore/QRegularExpression>
@@ -25,6 +30,7 @@
 #include "bricklink/core.h"
 #include "bricklink/item.h"
 #include "bricklink/color.h"
+#include "bricklink/sqlcache_p.h"
 
 Q_DECLARE_LOGGING_CATEGORY(LogCache)
 Q_DECLARE_LOGGING_CATEGORY(LogSql)
@@ -42,6 +48,8 @@ PriceGuide::PriceGuide(const Item *item, const Color *color, VatType vatType)
 
 PriceGuide::~PriceGuide()
 {
+    if (s_cache)
+        s_cache->d->retire(this);
     cancelUpdate();
 }
 
@@ -81,6 +89,224 @@ void PriceGuide::cancelUpdate()
         s_cache->cancelPriceGuideUpdate(this);
 }
 
+int PriceGuide::cost() const
+{
+    // the cache budget is in bytes
+    return int(sizeof(PriceGuide)) + PriceGuideCachePrivate::PerEntryOverhead;
+}
+
+quint32 PriceGuide::Data::toFixedPoint(double price)
+{
+    if (!(price > 0)) // also catches NaN
+        return 0;
+    return quint32(std::min(std::round(price * PriceScale), double(std::numeric_limits<quint32>::max())));
+}
+
+/* The database blob starts with a bit mask of the time/condition combinations that have any
+   data, followed by quantity, lots and the 4 fixed-point prices for each of these combinations,
+   all as LEB128 varints. A typical price guide needs 20 to 40 bytes instead of 160.
+*/
+QByteArray PriceGuide::Data::encode() const
+{
+    static constexpr int CC = int(Condition::Count);
+    static constexpr int TC = int(Time::Count) * CC;
+    static constexpr int PC = int(Price::Count);
+
+    auto appendVarint = [](char *&p, quint32 v) {
+        while (v >= 0x80) {
+            *p++ = char((v & 0x7f) | 0x80);
+            v >>= 7;
+        }
+        *p++ = char(v);
+    };
+
+    char buffer[1 + TC * (2 + PC) * 5];
+    char *p = buffer + 1;
+    quint8 mask = 0;
+
+    for (int i = 0; i < TC; ++i) {
+        const quint32 q = quantities[i / CC][i % CC];
+        const quint32 l = lots[i / CC][i % CC];
+        const quint32 *pr = prices[i / CC][i % CC];
+        if (!q && !l && std::all_of(pr, pr + PC, [](quint32 v) { return !v; }))
+            continue;
+
+        mask |= quint8(1 << i);
+        appendVarint(p, q);
+        appendVarint(p, l);
+        for (int j = 0; j < PC; ++j)
+            appendVarint(p, pr[j]);
+    }
+    buffer[0] = char(mask);
+    return QByteArray(buffer, p - buffer);
+}
+
+namespace {
+
+// version 1 of the database stored PriceGuide::Data as a raw struct with doubles for the prices
+struct DataV1
+{
+    qint32 quantities [int(Time::Count)][int(Condition::Count)];
+    qint32 lots       [int(Time::Count)][int(Condition::Count)];
+    double prices     [int(Time::Count)][int(Condition::Count)][int(Price::Count)];
+};
+Q_STATIC_ASSERT(sizeof(DataV1) == 160);
+
+} // namespace
+
+static void convertFromVersion1(const QByteArray &blob, PriceGuide::Data &data)
+{
+    DataV1 v1;
+    std::memcpy(&v1, blob.constData(), sizeof(DataV1));
+
+    for (int t = 0; t < int(Time::Count); ++t) {
+        for (int c = 0; c < int(Condition::Count); ++c) {
+            data.quantities[t][c] = quint32(std::max(0, v1.quantities[t][c]));
+            data.lots[t][c] = quint32(std::max(0, v1.lots[t][c]));
+            for (int p = 0; p < int(Price::Count); ++p)
+                data.prices[t][c][p] = PriceGuide::Data::toFixedPoint(v1.prices[t][c][p]);
+        }
+    }
+}
+
+bool PriceGuide::Data::decode(const QByteArray &blob)
+{
+    static constexpr int CC = int(Condition::Count);
+    static constexpr int TC = int(Time::Count) * CC;
+    static constexpr int PC = int(Price::Count);
+
+    // Not yet converted by PriceGuideCachePrivate::upgradeDatabaseFromVersion1(). A varint
+    // encoded blob is always shorter than that.
+    if (blob.size() == qsizetype(sizeof(DataV1))) {
+        convertFromVersion1(blob, *this);
+        return true;
+    }
+
+    const auto *p = reinterpret_cast<const quint8 *>(blob.constData());
+    const auto *end = p + blob.size();
+
+    auto readVarint = [&p, end](quint32 &v) {
+        v = 0;
+        for (int shift = 0; (p < end) && (shift < 32); shift += 7) {
+            const quint8 b = *p++;
+            v |= quint32(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return true;
+        }
+        return false;
+    };
+
+    *this = { };
+    if (p == end)
+        return false;
+    const quint8 mask = *p++;
+    if (mask >> TC)
+        return false;
+
+    for (int i = 0; i < TC; ++i) {
+        if (!(mask & (1 << i)))
+            continue;
+        if (!readVarint(quantities[i / CC][i % CC]) || !readVarint(lots[i / CC][i % CC]))
+            return false;
+        for (int j = 0; j < PC; ++j) {
+            if (!readVarint(prices[i / CC][i % CC][j]))
+                return false;
+        }
+    }
+    return (p == end);
+}
+
+
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////////////////
+
+
+void CompactPriceGuideCache::setMaxSize(qsizetype bytes)
+{
+    m_maxSize = bytes;
+    trim();
+}
+
+void CompactPriceGuideCache::add(quint64 key, const QDateTime &lastUpdated, const PriceGuide::Data &data)
+{
+    const QByteArray blob = data.encode();
+    // the mask plus 6 varints of at most 5 bytes for each time/condition combination
+    if ((blob.size() > 255) || ((m_arena.size() + RecordHeaderSize + blob.size()) > std::numeric_limits<quint32>::max()))
+        return;
+
+    const auto updated = quint32(lastUpdated.isValid()
+                                 ? std::clamp(lastUpdated.toSecsSinceEpoch(), qint64(1),
+                                              qint64(std::numeric_limits<quint32>::max()))
+                                 : 0);
+    char header[RecordHeaderSize];
+    std::memcpy(header, &key, 8);
+    std::memcpy(header + 8, &updated, 4);
+    header[12] = char(quint8(blob.size()));
+
+    // an older record for the same key just becomes stale
+    m_index.insert(key, quint32(m_arena.size()));
+    m_arena.append(header, RecordHeaderSize).append(blob);
+    trim();
+}
+
+bool CompactPriceGuideCache::take(quint64 key, QDateTime &lastUpdated, PriceGuide::Data &data)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end())
+        return false;
+    const qsizetype offset = *it;
+    m_index.erase(it);
+
+    quint32 updated = 0;
+    std::memcpy(&updated, m_arena.constData() + offset + 8, 4);
+    const auto blobSize = recordSize(offset) - RecordHeaderSize;
+
+    PriceGuide::Data decoded;
+    if (!decoded.decode(m_arena.mid(offset + RecordHeaderSize, blobSize)))
+        return false;
+    data = decoded;
+    lastUpdated = updated ? QDateTime::fromSecsSinceEpoch(updated) : QDateTime { };
+    return true;
+}
+
+void CompactPriceGuideCache::clear()
+{
+    m_arena.clear();
+    m_head = 0;
+    m_index.clear();
+}
+
+void CompactPriceGuideCache::trim()
+{
+    while ((size() > m_maxSize) && (m_head < m_arena.size())) {
+        auto it = m_index.find(recordKey(m_head));
+        if ((it != m_index.end()) && (*it == quint32(m_head)))
+            m_index.erase(it);
+        m_head += recordSize(m_head);
+    }
+
+    // get rid of the dropped records, once they take up more than half of the arena
+    if (m_head > (m_arena.size() / 2)) {
+        m_arena.remove(0, m_head);
+        for (auto &offset : m_index)
+            offset -= quint32(m_head);
+        m_head = 0;
+    }
+}
+
+qsizetype CompactPriceGuideCache::recordSize(qsizetype offset) const
+{
+    return RecordHeaderSize + quint8(m_arena.at(offset + 12));
+}
+
+quint64 CompactPriceGuideCache::recordKey(qsizetype offset) const
+{
+    quint64 key = 0;
+    std::memcpy(&key, m_arena.constData() + offset, 8);
+    return key;
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////
@@ -91,6 +317,12 @@ PriceGuideRetrieverInterface::PriceGuideRetrieverInterface(QObject *parent)
     : QObject(parent)
 { }
 
+void PriceGuideRetrieverInterface::cancelMultiple(const QVector<PriceGuide *> &pgs)
+{
+    for (auto *pg : pgs)
+        cancel(pg);
+}
+
 
 ///////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////
@@ -234,12 +466,12 @@ bool SingleHTMLScrapePGRetriever::parseHtml(const QByteArray &ba, PriceGuide::Da
             if ((ti == -1) || (ci == -1))
                 continue;
 
-            result.lots[ti][ci]                         = en_US.toInt(m.captured(2));
-            result.quantities[ti][ci]                   = en_US.toInt(m.captured(3));
-            result.prices[ti][ci][int(Price::Lowest)]   = en_US.toDouble(m.captured(4));
-            result.prices[ti][ci][int(Price::Average)]  = en_US.toDouble(m.captured(5));
-            result.prices[ti][ci][int(Price::WAverage)] = en_US.toDouble(m.captured(6));
-            result.prices[ti][ci][int(Price::Highest)]  = en_US.toDouble(m.captured(7));
+            result.lots[ti][ci]                         = en_US.toUInt(m.captured(2));
+            result.quantities[ti][ci]                   = en_US.toUInt(m.captured(3));
+            result.prices[ti][ci][int(Price::Lowest)]   = PriceGuide::Data::toFixedPoint(en_US.toDouble(m.captured(4)));
+            result.prices[ti][ci][int(Price::Average)]  = PriceGuide::Data::toFixedPoint(en_US.toDouble(m.captured(5)));
+            result.prices[ti][ci][int(Price::WAverage)] = PriceGuide::Data::toFixedPoint(en_US.toDouble(m.captured(6)));
+            result.prices[ti][ci][int(Price::Highest)]  = PriceGuide::Data::toFixedPoint(en_US.toDouble(m.captured(7)));
 
             ++matchCounter;
             startPos = matchEnd;
@@ -289,16 +521,11 @@ void BatchedAffiliateAPIPGRetriever::fetch(PriceGuide *pg, bool highPriority)
 
     bool wrongVatType = (pg->vatType() != m_nextBatchVatType);
     auto &queue = wrongVatType ? m_wrongVatTypeQueue : m_nextBatch;
-    auto &prioSize = wrongVatType ? m_wrongVatTypeQueuePrioritySize : m_nextBatchPrioritySize;
 
     // check if the pg is already scheduled for the next batch and if we need to up the priority
-    auto it = std::find_if(queue.cbegin(), queue.cend(), [pg](const auto &pair) {
-        return (pair.first == pg);
-    });
-    if (it != queue.cend()) {
-        auto index = std::distance(queue.cbegin(), it);
-        if (index >= prioSize)
-            queue.move(index, prioSize++);
+    if (queue.contains(pg)) {
+        if (highPriority)
+            queue.promote(pg);
         return;
     }
 
@@ -306,11 +533,7 @@ void BatchedAffiliateAPIPGRetriever::fetch(PriceGuide *pg, bool highPriority)
 
     QElapsedTimer now;
     now.start();
-
-    if (highPriority)
-        queue.emplace(prioSize++, pg, now);
-    else
-        queue.emplace_back(pg, now);
+    queue.append(pg, now, highPriority);
 
     check();
 }
@@ -322,17 +545,28 @@ void BatchedAffiliateAPIPGRetriever::cancel(PriceGuide *pg)
 
     bool wrongVatType = (pg->vatType() != m_nextBatchVatType);
     auto &queue = wrongVatType ? m_wrongVatTypeQueue : m_nextBatch;
-    auto &prioSize = wrongVatType ? m_wrongVatTypeQueuePrioritySize : m_nextBatchPrioritySize;
 
-    auto it = std::find_if(queue.cbegin(), queue.cend(), [pg](const auto &pair) {
-        return (pair.first == pg);
-    });
-    if (it != queue.cend()) {
-        auto index = std::distance(queue.cbegin(), it);
-        if (index < prioSize)
-            --prioSize;
-        queue.removeAt(index);
+    if (queue.remove(pg)) {
+        emit failed(pg, u"aborted"_qs);
+        pg->release();
+    }
+}
 
+void BatchedAffiliateAPIPGRetriever::cancelMultiple(const QVector<PriceGuide *> &pgs)
+{
+    QVector<PriceGuide *> canceled;
+    bool abortCurrent = false;
+
+    for (auto *pg : pgs) {
+        if (m_nextBatch.remove(pg) || m_wrongVatTypeQueue.remove(pg))
+            canceled.append(pg);
+        else if (m_currentBatch.contains(pg))
+            abortCurrent = true;
+    }
+    if (abortCurrent && m_currentJob)
+        m_currentJob->abort();
+
+    for (auto *pg : std::as_const(canceled)) {
         emit failed(pg, u"aborted"_qs);
         pg->release();
     }
@@ -343,16 +577,18 @@ void BatchedAffiliateAPIPGRetriever::cancelAll()
     if (m_currentJob)
         m_currentJob->abort();
 
-    const auto list = m_wrongVatTypeQueue + m_nextBatch;
+    QVector<PriceGuide *> list;
+    list.reserve(m_wrongVatTypeQueue.size() + m_nextBatch.size());
+    auto collect = [&list](PriceGuide *pg, const QElapsedTimer &, bool) { list.append(pg); };
+    m_wrongVatTypeQueue.forEach(collect);
+    m_nextBatch.forEach(collect);
 
     m_wrongVatTypeQueue.clear();
     m_nextBatch.clear();
-    m_wrongVatTypeQueuePrioritySize = 0;
-    m_nextBatchPrioritySize = 0;
 
-    for (const auto &pair : list) {
-        emit failed(pair.first, u"aborted"_qs);
-        pair.first->release();
+    for (auto *pg : std::as_const(list)) {
+        emit failed(pg, u"aborted"_qs);
+        pg->release();
     }
 }
 
@@ -361,38 +597,33 @@ void BatchedAffiliateAPIPGRetriever::check()
     if (m_currentBatch.isEmpty() && !m_currentJob) {
         if (m_nextBatch.isEmpty() && !m_wrongVatTypeQueue.isEmpty()) {
             // switch vatType to the request with the highest priority
-            m_nextBatchVatType = m_wrongVatTypeQueue.constFirst().first->vatType();
-
-            // move all requests with the same vatType to nextBatch
-            qsizetype highPrioMoved = 0;
-            for (auto i = 0; i < m_wrongVatTypeQueue.size(); ++i) {
-                auto [pg, age] = m_wrongVatTypeQueue.at(i);
-                if (pg->vatType() == m_nextBatchVatType) {
-                    if (i < m_wrongVatTypeQueuePrioritySize)
-                        ++highPrioMoved;
-                    m_nextBatch.emplace_back(pg, age);
-                    // just tag now, as we can't remove directly: this would mess up the indices
-                    m_wrongVatTypeQueue[i].first = nullptr;
+            Queue remaining;
+            bool first = true;
+
+            // move all requests with the same vatType to nextBatch, keeping their order
+            m_wrongVatTypeQueue.forEach([&](PriceGuide *pg, const QElapsedTimer &age, bool highPriority) {
+                if (first) {
+                    m_nextBatchVatType = pg->vatType();
+                    first = false;
                 }
-            }
-            m_nextBatchPrioritySize = highPrioMoved;
-            m_wrongVatTypeQueuePrioritySize -= highPrioMoved;
-            // finally remove all the tagged entries
-            m_wrongVatTypeQueue.removeIf([](const auto &pair) { return pair.first == nullptr; });
+                if (pg->vatType() == m_nextBatchVatType)
+                    m_nextBatch.append(pg, age, highPriority);
+                else
+                    remaining.append(pg, age, highPriority);
+            });
+            m_wrongVatTypeQueue = std::move(remaining);
         }
 
         qsizetype nextSize = m_nextBatch.size();
-        qint64 nextAge = (m_nextBatchPrioritySize >= nextSize)
-                ? 0 : m_nextBatch.at(m_nextBatchPrioritySize).second.elapsed();
-        qint64 nextPriorityAge = (m_nextBatchPrioritySize <= 0)
-                ? 0 : m_nextBatch.at(0).second.elapsed();
+        qint64 nextAge = m_nextBatch.age();
+        qint64 nextPriorityAge = m_nextBatch.priorityAge();
 
         if ((nextSize >= MaxBatchSize) || (qMax(nextAge, nextPriorityAge) > MaxBatchAgeMSec)) {
             auto batchSize = qMin(nextSize, MaxBatchSize);
             QJsonArray array;
 
             for (auto i = 0; i < batchSize; ++i) {
-                auto *pg = m_nextBatch.at(i).first;
+                auto *pg = m_nextBatch.takeFirst().first;
                 const QString itemId = QLatin1String(pg->item()->id());
                 const QString typeId = itemTypeApiId(pg->item()->itemType());
                 int colorId = int(pg->color()->id());
@@ -407,8 +638,6 @@ void BatchedAffiliateAPIPGRetriever::check()
                                    } },
                              });
             }
-            m_nextBatch.remove(0, batchSize);
-            m_nextBatchPrioritySize -= qMin(m_nextBatchPrioritySize, batchSize);
 
             const auto json = QJsonDocument(array).toJson(QJsonDocument::Compact);
 
@@ -424,7 +653,7 @@ void BatchedAffiliateAPIPGRetriever::check()
             m_currentJob = TransferJob::postContent(url, u"application/json"_qs, json);
             m_currentJob->setUserData("batchedPriceGuide", true);
 
-            m_core->retrieve(m_currentJob, m_nextBatchPrioritySize > 0);
+            m_core->retrieve(m_currentJob, m_nextBatch.prioritySize() > 0);
         } else if (nextSize) {
             auto nextCheck = std::max(0LL, (MaxBatchAgeMSec - std::max(nextAge, nextPriorityAge)));
             m_batchTimer->setInterval(int(nextCheck));
@@ -480,14 +709,19 @@ void BatchedAffiliateAPIPGRetriever::transferJobFinished(TransferJob *j)
                 PriceGuide::Data pgdata;
                 auto parsePGJson = [&](QStringView key, int time, int cond) {
                     auto obj = item[key].toObject();
-                    pgdata.quantities[time][cond] = obj[u"unit_quantity"].toInt();
-                    pgdata.lots[time][cond] = obj[u"total_quantity"].toInt();
-                    pgdata.prices[time][cond][int(Price::Lowest)] = obj[u"min_price"].toString().toDouble();
-                    pgdata.prices[time][cond][int(Price::Highest)] = obj[u"max_price"].toString().toDouble();
-                    pgdata.prices[time][cond][int(Price::Average)] = pgdata.lots[time][cond]
-                            ? (obj[u"total_price"].toString().toDouble() / pgdata.lots[time][cond]) : 0;
-                    pgdata.prices[time][cond][int(Price::WAverage)] =  pgdata.quantities[time][cond]
-                            ? (obj[u"total_qty_price"].toString().toDouble() / pgdata.quantities[time][cond]) : 0;
+                    const quint32 quantity = quint32(std::max(0, obj[u"unit_quantity"].toInt()));
+                    const quint32 lots = quint32(std::max(0, obj[u"total_quantity"].toInt()));
+                    const double minPrice = obj[u"min_price"].toString().toDouble();
+                    const double maxPrice = obj[u"max_price"].toString().toDouble();
+                    const double avgPrice = lots ? (obj[u"total_price"].toString().toDouble() / lots) : 0;
+                    const double qavgPrice = quantity ? (obj[u"total_qty_price"].toString().toDouble() / quantity) : 0;
+
+                    pgdata.quantities[time][cond] = quantity;
+                    pgdata.lots[time][cond] = lots;
+                    pgdata.prices[time][cond][int(Price::Lowest)] = PriceGuide::Data::toFixedPoint(minPrice);
+                    pgdata.prices[time][cond][int(Price::Highest)] = PriceGuide::Data::toFixedPoint(maxPrice);
+                    pgdata.prices[time][cond][int(Price::Average)] = PriceGuide::Data::toFixedPoint(avgPrice);
+                    pgdata.prices[time][cond][int(Price::WAverage)] = PriceGuide::Data::toFixedPoint(qavgPrice);
                 };
 
                 parsePGJson(u"inventory_new",  int(Time::Current), int(Condition::New));
@@ -558,10 +792,14 @@ PriceGuideCache::PriceGuideCache(Core *core)
     PriceGuide::s_cache = this;
 
     d->m_cacheStatId = AppStatistics::inst()->addSource(u"Price-guides in memory cache"_qs);
+    d->m_compactCacheStatId = AppStatistics::inst()->addSource(u"Price-guides in compact memory cache"_qs);
     d->m_loadsStatId = AppStatistics::inst()->addSource(u"Price-guides queued for disk load"_qs);
     d->m_savesStatId = AppStatistics::inst()->addSource(u"Price-guides queued for disk save"_qs);
+    d->m_diskSizeStatId = AppStatistics::inst()->addSource(u"Price-guide disk cache size"_qs, u"MB"_qs);
+    d->m_diskEvictedStatId = AppStatistics::inst()->addSource(u"Price-guides evicted from disk cache"_qs);
 
-    d->m_cache.setMaxCost(5000); // each priceguide has a cost of 1
+    d->m_cache.setMaxCost(PriceGuideCachePrivate::MemoryCacheLimit); // each priceguide has the cost of memory used in bytes
+    d->m_compactCache.setMaxSize(PriceGuideCachePrivate::CompactCacheLimit);
 
     QString batchApiKey;
 #if defined(BS_BRICKLINK_AFFILIATE_API_KEY)
@@ -582,6 +820,12 @@ PriceGuideCache::PriceGuideCache(Core *core)
             this, [this](PriceGuide *pg, const QString &errorString) {
         d->retrieveFailed(pg, errorString);
     });
+    connect(this, &PriceGuideCache::priceGuideUpdated,
+            this, [this](PriceGuide *pg) {
+        d->prefetchUpdated(pg);
+    });
+
+    d->m_bulkLoadPool.setMaxThreadCount(1);
 
     d->m_dbName = core->dataPath() + u"priceguide_cache.sqlite"_qs;
     d->m_db = QSqlDatabase::addDatabase(u"QSQLITE"_qs, u"PriceGuideCache"_qs);
@@ -608,7 +852,7 @@ PriceGuideCache::PriceGuideCache(Core *core)
     }
 
     if (d->m_db.isOpen()) {
-        static constexpr int DBVersion = 1;
+        static constexpr int DBVersion = 2;
 
         {
             QSqlQuery jnlQuery(u"PRAGMA journal_mode = wal;"_qs, d->m_db);
@@ -620,16 +864,22 @@ PriceGuideCache::PriceGuideCache(Core *core)
             QSqlQuery uvQuery(u"PRAGMA user_version"_qs, d->m_db);
             uvQuery.next();
             auto userVersion = uvQuery.value(0).toInt();
-            if (userVersion == 0) // brand new file, bump version
+            uvQuery.finish();
+
+            if (userVersion == 1) {
+                // converting takes a while, so the writer thread does it in the background
+                d->m_upgradeFromVersion1 = true;
+            } else if (userVersion < DBVersion) { // brand new file, bump version
                 QSqlQuery(u"PRAGMA user_version=%1"_qs.arg(DBVersion), d->m_db);
+            }
         }
-
-        // DB schema upgrade code goes here...
     }
 
     for (int i = 0; i < 1; ++i) // one writer should be enough
         d->m_threads.append(QThread::create(&PriceGuideCachePrivate::saveThread, d, d->m_db.connectionName(), i));
-    for (int i = 0; i < QThread::idealThreadCount(); ++i)
+    d->m_loadThreadCount = QThread::idealThreadCount();
+    d->m_loadQueue = std::make_unique<PriorityWorkQueue<PriceGuide *>>(d->m_loadThreadCount);
+    for (int i = 0; i < d->m_loadThreadCount; ++i)
         d->m_threads.append(QThread::create(&PriceGuideCachePrivate::loadThread, d, d->m_db.connectionName(), i));
 
     for (auto *thread : d->m_threads)
@@ -639,15 +889,18 @@ PriceGuideCache::PriceGuideCache(Core *core)
 PriceGuideCache::~PriceGuideCache()
 {
     d->m_stop = true;
-    d->m_loadMutex.lock();
-    d->m_loadTrigger.wakeAll();
-    d->m_loadMutex.unlock();
+    d->m_loadQueue->abort();
     d->m_saveMutex.lock();
     d->m_saveTrigger.wakeAll();
     d->m_saveMutex.unlock();
     for (auto *thread : d->m_threads)
         thread->wait();
+    d->m_bulkLoadPool.waitForDone();
+    const auto notLoaded = d->m_loadQueue->takeAll();
+    for (auto *pg : notLoaded)
+        pg->release();
     d->m_db.close();
+    d->m_compactCacheEnabled = false;
     delete d;
     PriceGuide::s_cache = nullptr;
 }
@@ -657,6 +910,15 @@ void PriceGuideCache::setUpdateInterval(int interval)
     d->m_updateInterval = interval;
 }
 
+void PriceGuideCache::setDiskCacheLimit(qint64 bytes)
+{
+    if (d->m_diskCacheLimit.fetchAndStoreRelaxed(bytes) != bytes) {
+        QMutexLocker locker(&d->m_saveMutex);
+        d->m_diskMaintenanceNeeded = true;
+        d->m_saveTrigger.wakeAll();
+    }
+}
+
 void PriceGuideCache::clearCache()
 {
     // Ideally we would just clear() the caches here, but there could be ref'ed objects
@@ -665,11 +927,15 @@ void PriceGuideCache::clearCache()
 
     auto leakControl = [](PriceGuide *pg) { Ref::addZombieRef(pg); };
 
+    d->m_compactCacheEnabled = false;
     if (auto leakedCount = d->m_cache.clearRecursive(leakControl)) {
         qCWarning(LogCache) << "PriceGuide cache:" << leakedCount
                             << "objects still have a reference after clearing";
     }
+    d->m_compactCacheEnabled = true;
+    d->m_compactCache.clear();
     AppStatistics::inst()->update(d->m_cacheStatId, d->m_cache.count());
+    AppStatistics::inst()->update(d->m_compactCacheStatId, d->m_compactCache.count());
 }
 
 QPair<int, int> PriceGuideCache::cacheStats() const
@@ -695,19 +961,22 @@ PriceGuide *PriceGuideCache::priceGuide(const Item *item, const Color *color, Va
 
     if (!pg) {
         pg = new PriceGuide(item, color, vatType);
-        if (!d->m_cache.insert(key, pg)) {
+        if (!d->m_cache.insert(key, pg, pg->cost())) {
             qCWarning(LogCache, "Can not add priceguide to cache (cache max/cur: %d/%d, cost: %d)",
-                      int(d->m_cache.maxCost()), int(d->m_cache.totalCost()), 1);
+                      int(d->m_cache.maxCost()), int(d->m_cache.totalCost()), pg->cost());
             return nullptr;
         }
         AppStatistics::inst()->update(d->m_cacheStatId, d->m_cache.count());
+
+        if (d->restore(key, pg, highPriority))
+            needToLoad = false;
     }
 
     if (needToLoad) {
         pg->setUpdateStatus(UpdateStatus::Loading);
         d->load(pg, highPriority);
-
-        //TODO reprioritize?
+    } else if (highPriority && (pg->updateStatus() == UpdateStatus::Loading)) {
+        d->reprioritize(pg, true);
     }
 
     return pg;
@@ -745,6 +1014,93 @@ void PriceGuideCache::cancelAllPriceGuideUpdates()
     d->m_retriever->cancelAll();
 }
 
+PriceGuideCache::Prefetch PriceGuideCache::prefetch(std::span<const std::pair<const Item *, const Color *>> keys,
+                                                  VatType vatType, bool forceUpdate)
+{
+    Prefetch prefetch;
+    prefetch.id = d->m_nextPrefetchId++;
+    prefetch.priceGuides.reserve(qsizetype(keys.size()));
+
+    const bool vatTypeSupported = supportedVatTypes().contains(vatType);
+    QHash<quint64, PriceGuide *> unique;
+    QVector<PriceGuide *> toLoad;
+
+    for (const auto &[item, color] : keys) {
+        PriceGuide *pg = nullptr;
+
+        if (item && color && vatTypeSupported) {
+            auto key = PriceGuideCachePrivate::cacheKey(item, color, vatType);
+            pg = unique.value(key);
+
+            if (!pg) {
+                pg = d->m_cache[key];
+                bool needToLoad = !pg || (!pg->isValid() && (pg->updateStatus() == UpdateStatus::UpdateFailed));
+
+                if (!pg) {
+                    pg = new PriceGuide(item, color, vatType);
+                    if (!d->m_cache.insert(key, pg, pg->cost())) {
+                        qCWarning(LogCache, "Can not add priceguide to cache (cache max/cur: %d/%d, cost: %d)",
+                                  int(d->m_cache.maxCost()), int(d->m_cache.totalCost()), pg->cost());
+                        pg = nullptr;
+                    } else if (d->restore(key, pg, false)) {
+                        needToLoad = false;
+                    }
+                }
+                if (pg) {
+                    if (needToLoad) {
+                        pg->setUpdateStatus(UpdateStatus::Loading);
+                        toLoad.append(pg);
+                    }
+                    unique.insert(key, pg);
+                }
+            }
+        }
+        if (pg)
+            pg->addRef(); // before the next insert() might trim the cache
+        prefetch.priceGuides.append(pg);
+    }
+    AppStatistics::inst()->update(d->m_cacheStatId, d->m_cache.count());
+
+    if (!toLoad.isEmpty())
+        d->bulkLoad(toLoad);
+
+    PriceGuideCachePrivate::PrefetchRequest request;
+    for (auto *pg : std::as_const(unique)) {
+        if (forceUpdate)
+            updatePriceGuide(pg, false);
+
+        if ((pg->updateStatus() == UpdateStatus::Loading) || (pg->updateStatus() == UpdateStatus::Updating))
+            request.pending.insert(pg);
+    }
+    request.total = int(unique.size());
+
+    if (request.pending.isEmpty()) {
+        // the caller needs a chance to connect to the signal first
+        QMetaObject::invokeMethod(this, [this, id = prefetch.id]() {
+            emit prefetchFinished(id);
+        }, Qt::QueuedConnection);
+    } else {
+        d->m_prefetches.insert(prefetch.id, request);
+    }
+    return prefetch;
+}
+
+void PriceGuideCache::cancelPrefetch(int prefetchId)
+{
+    const auto request = d->m_prefetches.take(prefetchId);
+    if (request.pending.isEmpty())
+        return;
+
+    QVector<PriceGuide *> updating;
+    for (auto *pg : request.pending) {
+        if (pg->updateStatus() == UpdateStatus::Updating)
+            updating.append(pg);
+    }
+    d->m_retriever->cancelMultiple(updating);
+
+    emit prefetchFinished(prefetchId);
+}
+
 QString PriceGuideCache::retrieverName() const
 {
     return d->m_retriever->name();
@@ -833,20 +1189,53 @@ bool PriceGuideCachePrivate::isUpdateNeeded(PriceGuide *pg) const
                 || (pg->lastUpdated().secsTo(QDateTime::currentDateTime()) > m_updateInterval));
 }
 
+void PriceGuideCachePrivate::retire(const PriceGuide *pg)
+{
+    if (m_compactCacheEnabled && pg->m_valid && (pg->m_updateStatus == UpdateStatus::Ok)) {
+        m_compactCache.add(cacheKey(pg->item(), pg->color(), pg->vatType()), pg->m_lastUpdated,
+                           pg->m_data);
+        AppStatistics::inst()->update(m_compactCacheStatId, m_compactCache.count());
+    }
+}
+
+bool PriceGuideCachePrivate::restore(quint64 key, PriceGuide *pg, bool highPriority)
+{
+    QDateTime lastUpdated;
+    if (!m_compactCache.take(key, lastUpdated, pg->m_data))
+        return false;
+    AppStatistics::inst()->update(m_compactCacheStatId, m_compactCache.count());
+
+    pg->m_lastUpdated = lastUpdated;
+    pg->m_valid = true;
+    pg->m_updateStatus = UpdateStatus::Ok;
+
+    // update the last accessed time stamp, just like after loading from disk
+    pg->addRef();
+    m_saveMutex.lock();
+    m_saveQueue.append({ pg, SaveAccessTimeOnly });
+    m_saveTrigger.wakeOne();
+    m_saveMutex.unlock();
+
+    if (isUpdateNeeded(pg))
+        q->updatePriceGuide(pg, highPriority);
+    return true;
+}
+
 void PriceGuideCachePrivate::load(PriceGuide *pg, bool highPriority)
 {
     if (!pg)
         return;
 
     pg->addRef();
-    m_loadMutex.lock();
-    m_loadQueue.insert(highPriority ? 0 : m_loadQueue.size(),
-                       { pg, highPriority ? LoadHighPriority : LoadLowPriority });
-    m_loadTrigger.wakeOne();
-    auto queueSize = m_loadQueue.size();
-    m_loadMutex.unlock();
+    if (!m_loadQueue->add(pg, highPriority))
+        pg->release(); // already queued
+    AppStatistics::inst()->update(m_loadsStatId, m_loadQueue->size());
+}
 
-    AppStatistics::inst()->update(m_loadsStatId, queueSize);
+void PriceGuideCachePrivate::reprioritize(PriceGuide *pg, bool highPriority)
+{
+    if (pg)
+        m_loadQueue->reprioritize(pg, highPriority);
 }
 
 void PriceGuideCachePrivate::save(PriceGuide *pg)
@@ -869,78 +1258,203 @@ void PriceGuideCachePrivate::loadThread(QString dbName, int index)
     auto db = QSqlDatabase::cloneDatabase(dbName, dbName + u"_Reader_" + QString::number(index));
     db.open();
 
+    // We always bind MaxLoadBatchSize ids: smaller batches are padded by repeating the first id,
+    // so a single prepared statement is enough.
+    QString placeholders = u"?"_qs;
+    for (qsizetype i = 1; i < MaxLoadBatchSize; ++i)
+        placeholders.append(u",?"_qs);
+
     QSqlQuery loadQuery(db);
-    loadQuery.prepare(u"SELECT updated,data FROM pg WHERE id=:id;"_qs);
+    loadQuery.prepare(u"SELECT id,updated,data FROM pg WHERE id IN (" + placeholders + u");");
 
     while (!m_stop) {
-        QMutexLocker locker(&m_loadMutex);
-        if (m_loadQueue.isEmpty())
-            m_loadTrigger.wait(&m_loadMutex);
-
-        if (m_stop) {
-            for (auto [pg, type] : m_loadQueue)
-                pg->release();
+        // there are multiple loader threads, so this only returns our fair share of the queue
+        const auto batch = m_loadQueue->take(index, MaxLoadBatchSize);
+        if (batch.isEmpty())
             continue;
-        }
 
-        // alternate between loading and saving in order to not starve one queue
-        if (!m_loadQueue.isEmpty()) {
-            auto [pg, loadType] = m_loadQueue.takeFirst();
-            auto queueSize = m_loadQueue.size();
-            locker.unlock();
+        AppStatistics::inst()->update(m_loadsStatId, m_loadQueue->size());
 
-            AppStatistics::inst()->update(m_loadsStatId, queueSize);
+        QStringList dbTags;
+        dbTags.reserve(batch.size());
+        for (const auto &[pg, highPriority] : batch)
+            dbTags.append(databaseTag(pg, m_retriever));
 
-            bool loaded = false;
-            QDateTime lastUpdated;
-            QByteArray data;
-            bool highPriority = (loadType == LoadHighPriority);
+        QHash<QString, std::pair<QDateTime, QByteArray>> dbRows;
 
-            if (db.isOpen()) {
-                loadQuery.bindValue(u":id"_qs, databaseTag(pg, m_retriever));
-
-                loadQuery.exec();
-                if (loadQuery.next()) {
-                    lastUpdated = loadQuery.isNull(0) ? QDateTime()
-                                                      : QDateTime::fromMSecsSinceEpoch(loadQuery.value(0).toLongLong());
-                    data = loadQuery.value(1).toByteArray();
-                    loaded = data.isEmpty() || (data.size() == sizeof(PriceGuide::Data));
+        if (db.isOpen()) {
+            for (qsizetype i = 0; i < MaxLoadBatchSize; ++i)
+                loadQuery.bindValue(int(i), dbTags.at((i < dbTags.size()) ? i : 0));
+
+            if (loadQuery.exec()) {
+                while (loadQuery.next()) {
+                    auto lastUpdated = loadQuery.isNull(1) ? QDateTime()
+                                                           : QDateTime::fromMSecsSinceEpoch(loadQuery.value(1).toLongLong());
+                    dbRows.insert(loadQuery.value(0).toString(),
+                                  { lastUpdated, loadQuery.value(2).toByteArray() });
                 }
-                loadQuery.finish();
+            } else {
+                qCWarning(LogSql) << "Failed to load price guides:" << loadQuery.lastError().text();
             }
-            pg->addRef(); // the release will happen on the main thread (see the invokeMethod below)
-            QMetaObject::invokeMethod(m_core, [=, this, pg=pg]() { // clang bug: P1091R3
-                if (loaded) {
-                    pg->setLastUpdated(lastUpdated);
-                    std::memcpy(&pg->m_data, data, sizeof(PriceGuide::Data));
-
-                    // update the last accessed time stamp
-                    pg->addRef();
-                    m_saveMutex.lock();
-                    m_saveQueue.append({ pg, SaveAccessTimeOnly });
-                    m_saveTrigger.wakeOne();
-                    m_saveMutex.unlock();
-                }
-                pg->setIsValid(loaded);
-                pg->setUpdateStatus(UpdateStatus::Ok);
+            loadQuery.finish();
+        }
 
-                if (pg->m_updateAfterLoad || isUpdateNeeded(pg))  {
-                    pg->m_updateAfterLoad = false;
-                    q->updatePriceGuide(pg, highPriority);
-                }
-                if (loaded && data.isEmpty())
-                    pg->setIsValid(false);
+        QVector<LoadResult> results;
+        results.reserve(batch.size());
 
-                emit q->priceGuideUpdated(pg);
-                pg->release();
-            }, Qt::QueuedConnection);
+        for (qsizetype i = 0; i < batch.size(); ++i) {
+            LoadResult r;
+            r.pg = batch.at(i).first;
+            r.highPriority = batch.at(i).second;
 
-            pg->release();
+            if (auto it = dbRows.constFind(dbTags.at(i)); it != dbRows.cend()) {
+                r.lastUpdated = it->first;
+                r.hasData = !it->second.isEmpty();
+                r.loaded = !r.hasData || r.data.decode(it->second);
+            }
+            results.append(r);
         }
+
+        // the refs from load() are handed over and will be released on the main thread
+        QMetaObject::invokeMethod(m_core, [this, results = std::move(results)]() {
+            loadFinished(results);
+        }, Qt::QueuedConnection);
     }
     db.close();
 }
 
+void PriceGuideCachePrivate::bulkLoad(const QVector<PriceGuide *> &pgs)
+{
+    // the refs are handed over to loadFinished() on the main thread
+    QStringList dbTags;
+    dbTags.reserve(pgs.size());
+    for (auto *pg : pgs) {
+        pg->addRef();
+        dbTags.append(databaseTag(pg, m_retriever));
+    }
+
+    const QString dbName = m_db.connectionName();
+    const QString connectionName = dbName + u"_BulkReader_" + QString::number(++m_bulkLoadCount);
+
+    m_bulkLoadPool.start([=, this]() {
+        QHash<QString, std::pair<QDateTime, QByteArray>> dbRows;
+
+        {
+            auto db = QSqlDatabase::cloneDatabase(dbName, connectionName);
+            db.open();
+
+            // way too many ids for an IN (...) clause: join against a temporary table instead
+            QSqlQuery query(db);
+            if (db.isOpen() && !m_stop
+                    && query.exec(u"CREATE TEMP TABLE prefetch (id TEXT NOT NULL PRIMARY KEY) WITHOUT ROWID;"_qs)) {
+                db.transaction();
+                query.prepare(u"INSERT OR IGNORE INTO prefetch(id) VALUES(?);"_qs);
+                query.addBindValue(QVariantList(dbTags.cbegin(), dbTags.cend()));
+                query.execBatch();
+                db.commit();
+
+                if (query.exec(u"SELECT pg.id,pg.updated,pg.data FROM prefetch JOIN pg ON pg.id = prefetch.id;"_qs)) {
+                    while (query.next()) {
+                        auto lastUpdated = query.isNull(1) ? QDateTime()
+                                                           : QDateTime::fromMSecsSinceEpoch(query.value(1).toLongLong());
+                        dbRows.insert(query.value(0).toString(), { lastUpdated, query.value(2).toByteArray() });
+                    }
+                }
+            }
+            if (query.lastError().isValid())
+                qCWarning(LogSql) << "Failed to bulk load price guides:" << query.lastError().text();
+            query.finish();
+            query.exec(u"DROP TABLE IF EXISTS temp.prefetch;"_qs);
+            db.close();
+        }
+        QSqlDatabase::removeDatabase(connectionName);
+
+        QVector<LoadResult> results;
+        results.reserve(pgs.size());
+
+        for (qsizetype i = 0; i < pgs.size(); ++i) {
+            LoadResult r;
+            r.pg = pgs.at(i);
+            // a prefetch is a bulk operation: interactive requests have to be able to overtake it
+            r.highPriority = false;
+
+            if (auto it = dbRows.constFind(dbTags.at(i)); it != dbRows.cend()) {
+                r.lastUpdated = it->first;
+                r.hasData = !it->second.isEmpty();
+                r.loaded = !r.hasData || r.data.decode(it->second);
+            }
+            results.append(r);
+        }
+
+        QMetaObject::invokeMethod(m_core, [this, results = std::move(results)]() {
+            loadFinished(results);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void PriceGuideCachePrivate::prefetchUpdated(PriceGuide *pg)
+{
+    if (m_prefetches.isEmpty() || !pg || (pg->updateStatus() == UpdateStatus::Loading)
+            || (pg->updateStatus() == UpdateStatus::Updating)) {
+        return;
+    }
+
+    // the slots might start or cancel prefetches, so don't emit while iterating
+    QVector<std::tuple<int, int, int>> progress;
+    for (auto it = m_prefetches.begin(); it != m_prefetches.end(); ) {
+        if (it->pending.remove(pg)) {
+            progress.emplace_back(it.key(), it->total - int(it->pending.size()), it->total);
+            if (it->pending.isEmpty()) {
+                it = m_prefetches.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+    for (const auto &[id, done, total] : progress) {
+        emit q->prefetchProgress(id, done, total);
+        if (done == total)
+            emit q->prefetchFinished(id);
+    }
+}
+
+void PriceGuideCachePrivate::loadFinished(const QVector<LoadResult> &results)
+{
+    QVector<std::pair<PriceGuide *, SaveType>> saves;
+
+    for (const auto &r : results) {
+        PriceGuide *pg = r.pg;
+
+        if (r.loaded) {
+            pg->setLastUpdated(r.lastUpdated);
+            if (r.hasData)
+                pg->m_data = r.data;
+
+            // update the last accessed time stamp
+            pg->addRef();
+            saves.append({ pg, SaveAccessTimeOnly });
+        }
+        pg->setIsValid(r.loaded);
+        pg->setUpdateStatus(UpdateStatus::Ok);
+
+        if (pg->m_updateAfterLoad || isUpdateNeeded(pg))  {
+            pg->m_updateAfterLoad = false;
+            q->updatePriceGuide(pg, r.highPriority);
+        }
+        if (r.loaded && !r.hasData)
+            pg->setIsValid(false);
+
+        emit q->priceGuideUpdated(pg);
+        pg->release();
+    }
+
+    if (!saves.isEmpty()) {
+        m_saveMutex.lock();
+        m_saveQueue.append(saves);
+        m_saveTrigger.wakeOne();
+        m_saveMutex.unlock();
+    }
+}
 
 void PriceGuideCachePrivate::saveThread(QString dbName, int index)
 {
@@ -955,9 +1469,26 @@ void PriceGuideCachePrivate::saveThread(QString dbName, int index)
     QSqlQuery accessQuery(db);
     accessQuery.prepare(u"UPDATE pg SET accessed=:accessed WHERE id=:id;"_qs);
 
+    SqlCache::setup(db, u"pg"_qs);
+    int savesSinceMaintenance = 0;
+
+    if (m_upgradeFromVersion1 && db.isOpen()) {
+        // the loader threads can cope with unconverted entries in the meantime
+        if (upgradeDatabaseFromVersion1(db, m_stop)) {
+            QSqlQuery(u"PRAGMA user_version=2"_qs, db);
+        } else if (!m_stop) {
+            qCWarning(LogSql) << "Failed to upgrade the price-guide database, clearing it";
+            QSqlQuery(u"DELETE FROM pg;"_qs, db);
+            QSqlQuery(u"PRAGMA user_version=2"_qs, db);
+        }
+    }
+
     while (!m_stop) {
+        if (m_diskMaintenanceNeeded.testAndSetRelaxed(1, 0))
+            diskMaintenance(db);
+
         QMutexLocker locker(&m_saveMutex);
-        if (m_saveQueue.isEmpty())
+        if (m_saveQueue.isEmpty() && !m_diskMaintenanceNeeded.loadRelaxed())
             m_saveTrigger.wait(&m_saveMutex);
 
         if (!m_saveQueue.isEmpty()) {
@@ -993,8 +1524,7 @@ void PriceGuideCachePrivate::saveThread(QString dbName, int index)
                         saveQuery.bindValue(u":id"_qs, dbTag);
                         saveQuery.bindValue(u":updated"_qs, lastUpdated);
                         saveQuery.bindValue(u":accessed"_qs, now);
-                        saveQuery.bindValue(u":data"_qs, QByteArray::fromRawData(reinterpret_cast<const char *>(&pg->m_data),
-                                                                                 sizeof(PriceGuide::Data)));
+                        saveQuery.bindValue(u":data"_qs, pg->m_data.encode());
                         if (!saveQuery.exec()) {
                             qCWarning(LogSql) << "Failed to save price-guide data:"
                                               << saveQuery.lastError().text();
@@ -1004,12 +1534,76 @@ void PriceGuideCachePrivate::saveThread(QString dbName, int index)
                     pg->release();
                 }
                 db.commit();
+
+                savesSinceMaintenance += int(std::count_if(saveQueueCopy.cbegin(), saveQueueCopy.cend(),
+                                                           [](const auto &sq) { return sq.second == SaveData; }));
+                if (savesSinceMaintenance >= DiskMaintenanceInterval) {
+                    savesSinceMaintenance = 0;
+                    m_diskMaintenanceNeeded = true;
+                }
             }
         }
     }
     db.close();
 }
 
+bool PriceGuideCachePrivate::upgradeDatabaseFromVersion1(QSqlDatabase &db, const QAtomicInt &stop)
+{
+    QSqlQuery selectQuery(db);
+    QSqlQuery updateQuery(db);
+    if (!selectQuery.prepare(u"SELECT id,data FROM pg WHERE length(data) = %1 LIMIT 5000;"_qs.arg(int(sizeof(DataV1))))
+            || !updateQuery.prepare(u"UPDATE pg SET data=? WHERE id=?;"_qs)) {
+        return false;
+    }
+
+    // The converted blobs are much smaller, so they will not be selected again. Every chunk is
+    // committed on its own: if we are stopped, the next start just continues.
+    qsizetype convertedCount = 0;
+    while (!stop.loadRelaxed()) {
+        QVector<std::pair<QString, QByteArray>> rows;
+        if (!selectQuery.exec())
+            return false;
+        while (selectQuery.next())
+            rows.emplace_back(selectQuery.value(0).toString(), selectQuery.value(1).toByteArray());
+        selectQuery.finish();
+
+        if (rows.isEmpty()) {
+            qCInfo(LogSql) << "Converted" << convertedCount << "entries in the price-guide database to the compact format";
+            return true;
+        }
+
+        db.transaction();
+        for (const auto &[id, blob] : std::as_const(rows)) {
+            PriceGuide::Data data;
+            convertFromVersion1(blob, data);
+
+            updateQuery.bindValue(0, data.encode());
+            updateQuery.bindValue(1, id);
+            if (!updateQuery.exec()) {
+                db.rollback();
+                return false;
+            }
+            updateQuery.finish();
+        }
+        if (!db.commit())
+            return false;
+        convertedCount += rows.size();
+    }
+    return false;
+}
+
+void PriceGuideCachePrivate::diskMaintenance(QSqlDatabase &db)
+{
+    auto result = SqlCache::maintain(db, u"pg"_qs, m_diskCacheLimit.loadRelaxed(), m_stop);
+
+    if (result.evictedCount) {
+        m_diskEvictedCount += result.evictedCount;
+        qCInfo(LogCache) << "Evicted" << result.evictedCount << "entries from the price-guide disk cache";
+    }
+    AppStatistics::inst()->update(m_diskSizeStatId, result.size / 1'000'000);
+    AppStatistics::inst()->update(m_diskEvictedStatId, m_diskEvictedCount);
+}
+
 void PriceGuideCachePrivate::retrieveFinished(PriceGuide *pg, const PriceGuide::Data &data)
 {
     pg->setLastUpdated(QDateTime::currentDateTime());
@@ -1027,10 +1621,10 @@ void PriceGuideCachePrivate::retrieveFinished(PriceGuide *pg, const PriceGuide::
 
             qInfo().noquote() << time[t] << cond[c] << u"%1 (%2) %3 %4 %5 %6"_qs
                                  .arg(data.quantities[t][c], 7).arg(data.lots[t][c], 7)
-                                 .arg(data.prices[t][c][0], 7, 'f', 4)
-                    .arg(data.prices[t][c][1], 8, 'f', 4)
-                    .arg(data.prices[t][c][2], 8, 'f', 4)
-                    .arg(data.prices[t][c][3], 8, 'f', 4);
+                                 .arg(PriceGuide::Data::fromFixedPoint(data.prices[t][c][0]), 7, 'f', 4)
+                    .arg(PriceGuide::Data::fromFixedPoint(data.prices[t][c][1]), 8, 'f', 4)
+                    .arg(PriceGuide::Data::fromFixedPoint(data.prices[t][c][2]), 8, 'f', 4)
+                    .arg(PriceGuide::Data::fromFixedPoint(data.prices[t][c][3]), 8, 'f', 4);
         }
     }
 #endif
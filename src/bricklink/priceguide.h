@@ -3,7 +3,10 @@
 
 #pragma once
 
+#include <span>
+
 #include <QtCore/QDateTime>
+#include <QtCore/QVector>
 #include <QtQml/qqmlregistration.h>
 
 #include "bricklink/global.h"
@@ -41,9 +44,9 @@ public:
     bool isValid() const              { return m_valid; }
     UpdateStatus updateStatus() const { return m_updateStatus; }
 
-    Q_INVOKABLE int quantity(BrickLink::Time t, BrickLink::Condition c) const           { return m_data.quantities[int(t)][int(c)]; }
-    Q_INVOKABLE int lots(BrickLink::Time t, BrickLink::Condition c) const               { return m_data.lots[int(t)][int(c)]; }
-    Q_INVOKABLE double price(BrickLink::Time t, BrickLink::Condition c, BrickLink::Price p) const  { return m_data.prices[int(t)][int(c)][int(p)]; }
+    Q_INVOKABLE int quantity(BrickLink::Time t, BrickLink::Condition c) const           { return int(m_data.quantities[int(t)][int(c)]); }
+    Q_INVOKABLE int lots(BrickLink::Time t, BrickLink::Condition c) const               { return int(m_data.lots[int(t)][int(c)]); }
+    Q_INVOKABLE double price(BrickLink::Time t, BrickLink::Condition c, BrickLink::Price p) const  { return Data::fromFixedPoint(m_data.prices[int(t)][int(c)][int(p)]); }
 
     PriceGuide(std::nullptr_t) : PriceGuide(nullptr, nullptr, VatType::Excluded) { } // for scripting only!
     ~PriceGuide() override;
@@ -54,10 +57,23 @@ public:
 
     struct Data
     {
-        int    quantities [int(Time::Count)][int(Condition::Count)] = { };
-        int    lots       [int(Time::Count)][int(Condition::Count)] = { };
-        double prices     [int(Time::Count)][int(Condition::Count)][int(Price::Count)] = { };
+        quint32 quantities [int(Time::Count)][int(Condition::Count)] = { };
+        quint32 lots       [int(Time::Count)][int(Condition::Count)] = { };
+        quint32 prices     [int(Time::Count)][int(Condition::Count)][int(Price::Count)] = { }; // fixed-point
+
+        // BrickLink reports prices in USD with 4 decimals, which also covers the 3 decimals we
+        // use for documents after a currency conversion
+        static constexpr int PriceScale = 10000;
+        static quint32 toFixedPoint(double price);
+        static constexpr double fromFixedPoint(quint32 fp)  { return double(fp) / PriceScale; }
+
+        // the compact (varint) encoding used in the database
+        QByteArray encode() const;
+        bool decode(const QByteArray &blob);
     };
+    Q_STATIC_ASSERT(sizeof(Data) == 96);
+
+    int cost() const;
 
 
 signals:
@@ -105,6 +121,7 @@ public:
     ~PriceGuideCache() override;
 
     void setUpdateInterval(int interval);
+    void setDiskCacheLimit(qint64 bytes);
     void clearCache();
     QPair<int, int> cacheStats() const;
 
@@ -116,6 +133,20 @@ public:
     void cancelPriceGuideUpdate(PriceGuide *pg);
     void cancelAllPriceGuideUpdates();
 
+    struct Prefetch
+    {
+        int id = -1;
+        QVector<PriceGuide *> priceGuides; // one entry per key (or nullptr), each one ref'ed
+    };
+
+    // The bulk version of priceGuide(): duplicate keys are merged, all cache misses are read
+    // from disk with a single query and the needed updates are downloaded in full batches.
+    // prefetchFinished() is emitted once for the returned id, after all loads and updates are
+    // done. The caller has to release() all returned price guides.
+    Prefetch prefetch(std::span<const std::pair<const Item *, const Color *>> keys, VatType vatType,
+                      bool forceUpdate = false);
+    void cancelPrefetch(int prefetchId);
+
     QString retrieverName() const;
     QString retrieverId() const;
 
@@ -128,10 +159,14 @@ public:
 
 signals:
     void priceGuideUpdated(BrickLink::PriceGuide *pg);
+    void prefetchProgress(int prefetchId, int done, int total);
+    void prefetchFinished(int prefetchId);
     void currentVatTypeChanged(BrickLink::VatType vatType);
 
 private:
     PriceGuideCachePrivate *d;
+
+    friend class PriceGuide;
 };
 
 
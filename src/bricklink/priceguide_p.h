@@ -3,8 +3,15 @@
 
 #pragma once
 
+#include <limits>
+#include <map>
+#include <memory>
+
 #include <QtCore/QElapsedTimer>
+#include <QtCore/QDateTime>
 #include <QtCore/QHash>
+#include <QtCore/QSet>
+#include <QtCore/QThreadPool>
 #include <QtCore/QByteArray>
 #include <QtCore/QAtomicInt>
 #include <QtCore/QMutex>
@@ -12,6 +19,7 @@
 #include <QtCore/QVector>
 #include <QtSql/QSqlDatabase>
 
+#include "utility/priorityworkqueue.h"
 #include "utility/q3cache.h"
 #include "global.h"
 #include "priceguide.h"
@@ -38,6 +46,7 @@ public:
 
     virtual void fetch(PriceGuide *pg, bool highPriority) = 0;
     virtual void cancel(PriceGuide *pg) = 0;
+    virtual void cancelMultiple(const QVector<PriceGuide *> &pgs);
     virtual void cancelAll() = 0;
 
 signals:
@@ -84,6 +93,7 @@ public:
 
     void fetch(PriceGuide *pg, bool highPriority) override;
     void cancel(PriceGuide *pg) override;
+    void cancelMultiple(const QVector<PriceGuide *> &pgs) override;
     void cancelAll() override;
 
     static constexpr qsizetype MaxBatchSize = 500;
@@ -94,62 +104,223 @@ private:
     void transferJobFinished(TransferJob *j);
     static QString itemTypeApiId(const ItemType *itt);
 
+    // The scheduled price guides: high priority ones first, otherwise in request order.
+    // Looking up, promoting and removing an entry is O(log n) via the index.
+    class Queue
+    {
+    public:
+        using Entry = std::pair<PriceGuide *, QElapsedTimer>;
+
+        bool isEmpty() const             { return m_entries.empty(); }
+        qsizetype size() const           { return qsizetype(m_entries.size()); }
+        qsizetype prioritySize() const   { return m_prioritySize; }
+        bool contains(PriceGuide *pg) const  { return m_index.contains(pg); }
+
+        void append(PriceGuide *pg, const QElapsedTimer &age, bool highPriority)
+        {
+            const qint64 seq = highPriority ? m_nextHigh++ : m_nextLow++;
+            m_entries.emplace(seq, Entry { pg, age });
+            m_index.insert(pg, seq);
+            if (highPriority)
+                ++m_prioritySize;
+        }
+        // returns false if pg is not queued
+        bool remove(PriceGuide *pg)
+        {
+            auto it = m_index.find(pg);
+            if (it == m_index.end())
+                return false;
+            if (*it < 0)
+                --m_prioritySize;
+            m_entries.erase(*it);
+            m_index.erase(it);
+            return true;
+        }
+        void promote(PriceGuide *pg)
+        {
+            auto it = m_index.constFind(pg);
+            if ((it == m_index.cend()) || (*it < 0))
+                return;
+            const QElapsedTimer age = m_entries.at(*it).second;
+            remove(pg);
+            append(pg, age, true);
+        }
+        Entry takeFirst()
+        {
+            auto it = m_entries.begin();
+            Entry entry = it->second;
+            if (it->first < 0)
+                --m_prioritySize;
+            m_index.remove(entry.first);
+            m_entries.erase(it);
+            return entry;
+        }
+        // the age of the oldest high and low priority entry
+        qint64 priorityAge() const
+        {
+            return m_prioritySize ? m_entries.cbegin()->second.second.elapsed() : 0;
+        }
+        qint64 age() const
+        {
+            auto it = m_entries.lower_bound(0);
+            return (it != m_entries.cend()) ? it->second.second.elapsed() : 0;
+        }
+        template <typename F> void forEach(F func) const // func(pg, age, highPriority)
+        {
+            for (const auto &[seq, entry] : m_entries)
+                func(entry.first, entry.second, seq < 0);
+        }
+        void clear()
+        {
+            m_entries.clear();
+            m_index.clear();
+            m_prioritySize = 0;
+        }
+
+    private:
+        std::map<qint64, Entry> m_entries; // key: sequence number, negative for high priority
+        QHash<PriceGuide *, qint64> m_index;
+        qint64 m_nextHigh = std::numeric_limits<qint64>::min() / 2;
+        qint64 m_nextLow = 0;
+        qsizetype m_prioritySize = 0;
+    };
+
     Core *m_core = nullptr;
     QVector<PriceGuide *> m_currentBatch;
     TransferJob *m_currentJob = nullptr;
-    QVector<std::pair<PriceGuide *, QElapsedTimer>> m_nextBatch;
+    Queue m_nextBatch;
     VatType m_nextBatchVatType = VatType::Excluded;
-    qsizetype m_nextBatchPrioritySize = 0;
     QTimer *m_batchTimer;
-    QVector<std::pair<PriceGuide *, QElapsedTimer>> m_wrongVatTypeQueue;
-    qsizetype m_wrongVatTypeQueuePrioritySize = 0;
+    Queue m_wrongVatTypeQueue;
     QString m_apiKey;
 };
 
 
+// The second tier of the memory cache: price guides that got evicted from the PriceGuide object
+// cache are kept here in their compact database encoding, without a QObject each. The records
+// are appended to one byte arena and dropped from its front, once the cache gets over budget.
+// A record that is taken out again just becomes a stale gap, until it reaches the front.
+class CompactPriceGuideCache
+{
+public:
+    void setMaxSize(qsizetype bytes);
+    void add(quint64 key, const QDateTime &lastUpdated, const PriceGuide::Data &data);
+    bool take(quint64 key, QDateTime &lastUpdated, PriceGuide::Data &data);
+    void clear();
+
+    qsizetype count() const  { return m_index.size(); }
+    qsizetype size() const   { return (m_arena.size() - m_head) + m_index.size() * IndexEntrySize; }
+
+private:
+    // key, last update in secs since epoch, length of the encoded data
+    static constexpr qsizetype RecordHeaderSize = 8 + 4 + 1;
+    // a QHash<quint64, quint32> node plus the span overhead at the average load factor
+    static constexpr qsizetype IndexEntrySize = 24;
+
+    void trim();
+    qsizetype recordSize(qsizetype offset) const;
+    quint64 recordKey(qsizetype offset) const;
+
+    QByteArray m_arena;
+    qsizetype m_head = 0;
+    QHash<quint64, quint32> m_index; // key -> offset of the record in m_arena
+    qsizetype m_maxSize = 0;
+};
+
+
 class PriceGuideCachePrivate
 {
 public:
     PriceGuideRetrieverInterface *m_retriever;
     QAtomicInt m_stop = false;
-    QMutex m_loadMutex;
     QMutex m_saveMutex;
-    QWaitCondition m_loadTrigger;
     QWaitCondition m_saveTrigger;
 
-    enum LoadType {
-        LoadHighPriority,
-        LoadLowPriority,
-    };
-
     enum SaveType {
         SaveData,
         SaveAccessTimeOnly,
     };
 
-    QVector<std::pair<PriceGuide *, LoadType>> m_loadQueue;
+    struct LoadResult {
+        PriceGuide *pg = nullptr;
+        bool highPriority = false;
+        bool loaded = false;
+        bool hasData = false;
+        QDateTime lastUpdated;
+        PriceGuide::Data data;
+    };
+
+    // the max. number of price guides a loader thread fetches from the database in one query
+    static constexpr qsizetype MaxLoadBatchSize = 64;
+
+    std::unique_ptr<PriorityWorkQueue<PriceGuide *>> m_loadQueue;
     QVector<std::pair<PriceGuide *, SaveType>> m_saveQueue;
     QString m_dbName;
     QSqlDatabase m_db;
     QVector<QThread *> m_threads;
+    int m_loadThreadCount = 0;
 
     int m_updateInterval = 0;
     QMap<QString, VatType> m_vatType;  // key: retriever->id()
+    // The memory a cached price guide needs on top of sizeof(PriceGuide): the separately
+    // allocated QObject private data, the cache's bookkeeping and the malloc overhead
+    static constexpr int PerEntryOverhead = 104 + 64 + 2 * 16;
+    // The same amount of RAM as the old limit of 5000 price guides, back when PriceGuide::Data
+    // was 160 bytes (about 420 bytes per entry).
+    static constexpr int MemoryBudget = 5000 * (int(sizeof(PriceGuide) - sizeof(PriceGuide::Data))
+                                                + 160 + PerEntryOverhead);
+    // A quarter of that is for live PriceGuide objects (about 360 bytes each) and the rest for
+    // the compact tier (about 65 bytes each, with a typical 30 byte encoding). Together that is
+    // room for roughly 25,000 price guides, 5x the old cache.
+    static constexpr int MemoryCacheLimit = MemoryBudget / 4;
+    static constexpr int CompactCacheLimit = MemoryBudget - MemoryCacheLimit;
+    // declared before m_cache, so it outlives the PriceGuide objects retiring into it
+    CompactPriceGuideCache m_compactCache;
+    bool m_compactCacheEnabled = true; // off while clearing or destroying m_cache
     Q3Cache<quint64, PriceGuide> m_cache;
     Core *m_core;
     PriceGuideCache *q;
+    struct PrefetchRequest
+    {
+        QSet<PriceGuide *> pending;
+        int total = 0;
+    };
+    QHash<int, PrefetchRequest> m_prefetches;
+    int m_nextPrefetchId = 1;
+    QThreadPool m_bulkLoadPool;
+    int m_bulkLoadCount = 0;
+
     int m_cacheStatId = -1;
+    int m_compactCacheStatId = -1;
     int m_loadsStatId = -1;
     int m_savesStatId = -1;
 
+    // the disk space is managed by the saver thread
+    static constexpr int DiskMaintenanceInterval = 1000; // check the limit every n saves
+    QAtomicInteger<qint64> m_diskCacheLimit = 0; // in bytes, 0 means unlimited
+    QAtomicInt m_diskMaintenanceNeeded = true;
+    qsizetype m_diskEvictedCount = 0;
+    int m_diskSizeStatId = -1;
+    int m_diskEvictedStatId = -1;
+
     static quint64 cacheKey(const Item *item, const Color *color, VatType vatType);
     static QString databaseTag(PriceGuide *pg, PriceGuideRetrieverInterface *retriever);
     bool isUpdateNeeded(PriceGuide *pg) const;
+    void retire(const PriceGuide *pg);
+    bool restore(quint64 key, PriceGuide *pg, bool highPriority);
 
     void load(PriceGuide *pg, bool highPriority);
+    void reprioritize(PriceGuide *pg, bool highPriority);
     void save(PriceGuide *pg);
     void loadThread(QString dbName, int index);
+    void loadFinished(const QVector<LoadResult> &results);
+    void bulkLoad(const QVector<PriceGuide *> &pgs);
+    void prefetchUpdated(PriceGuide *pg);
     void saveThread(QString dbName, int index);
+    void diskMaintenance(QSqlDatabase &db);
+    // returns false on errors, but also if stop was set
+    static bool upgradeDatabaseFromVersion1(QSqlDatabase &db, const QAtomicInt &stop);
+    bool m_upgradeFromVersion1 = false;
 
     void retrieveFinished(PriceGuide *pg, const PriceGuide::Data &data);
     void retrieveFailed(PriceGuide *pg, const QString &errorString);
@@ -0,0 +1,123 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <QtCore/QLoggingCategory>
+#include <QtCore/QStringBuilder>
+#include <QtSql/QSqlDatabase>
+#include <QtSql/QSqlError>
+#include <QtSql/QSqlQuery>
+
+#include "bricklink/sqlcache_p.h"
+
+Q_DECLARE_LOGGING_CATEGORY(LogSql)
+
+
+namespace BrickLink::SqlCache {
+
+static constexpr qint64 AutoVacuumIncremental = 2;
+static constexpr qint64 MaxEvictionsPerTransaction = 5000;
+
+static qint64 pragmaValue(QSqlDatabase &db, const QString &pragma)
+{
+    QSqlQuery query(u"PRAGMA " % pragma % u";", db);
+    return query.next() ? query.value(0).toLongLong() : -1;
+}
+
+static qint64 usedSize(QSqlDatabase &db)
+{
+    auto pageSize = pragmaValue(db, u"page_size"_qs);
+    auto pageCount = pragmaValue(db, u"page_count"_qs);
+    auto freeCount = pragmaValue(db, u"freelist_count"_qs);
+
+    if ((pageSize < 0) || (pageCount < 0) || (freeCount < 0))
+        return -1;
+    return (pageCount - freeCount) * pageSize;
+}
+
+void setup(QSqlDatabase &db, const QString &table)
+{
+    if (!db.isOpen())
+        return;
+
+    QSqlQuery indexQuery(db);
+    if (!indexQuery.exec(u"CREATE INDEX IF NOT EXISTS " % table % u"_accessed ON "
+                         % table % u"(accessed);")) {
+        qCWarning(LogSql) << "Failed to create the access time index on" << table << ":"
+                          << indexQuery.lastError().text();
+    }
+}
+
+MaintenanceResult maintain(QSqlDatabase &db, const QString &table, qint64 maxSize,
+                           const QAtomicInt &abort)
+{
+    MaintenanceResult result;
+
+    if (!db.isOpen())
+        return result;
+
+    qint64 size = usedSize(db);
+
+    if ((maxSize > 0) && (size > maxSize)) {
+        // evict down to 90% of the budget, so we don't have to come back after every save
+        const qint64 targetSize = maxSize / 10 * 9;
+
+        QSqlQuery countQuery(u"SELECT COUNT(*) FROM " % table % u";", db);
+        qint64 count = countQuery.next() ? countQuery.value(0).toLongLong() : 0;
+        countQuery.finish();
+
+        QSqlQuery evictQuery(db);
+        evictQuery.prepare(u"DELETE FROM " % table % u" WHERE id IN (SELECT id FROM " % table
+                           % u" ORDER BY accessed LIMIT :limit);");
+
+        while ((size > targetSize) && (count > 0) && !abort.loadRelaxed()) {
+            // the row sizes vary a lot, so just estimate via the average and iterate
+            const qint64 averageRowSize = std::max(size / count, qint64(1));
+            const qint64 limit = std::clamp((size - targetSize) / averageRowSize + 1,
+                                            qint64(1), MaxEvictionsPerTransaction);
+
+            db.transaction();
+            evictQuery.bindValue(u":limit"_qs, limit);
+            if (!evictQuery.exec()) {
+                qCWarning(LogSql) << "Failed to evict entries from" << table << ":"
+                                  << evictQuery.lastError().text();
+                db.rollback();
+                break;
+            }
+            const auto evicted = evictQuery.numRowsAffected();
+            evictQuery.finish();
+            db.commit();
+
+            if (evicted <= 0)
+                break;
+            result.evictedCount += evicted;
+            count -= evicted;
+            size = usedSize(db);
+        }
+    }
+    result.size = size;
+
+    if (abort.loadRelaxed())
+        return result;
+
+    if (pragmaValue(db, u"auto_vacuum"_qs) != AutoVacuumIncremental) {
+        // databases created before we did any eviction have auto-vacuum disabled: converting
+        // needs a full VACUUM once, but after that the file can be shrunk incrementally
+        qCInfo(LogSql) << "Converting" << db.databaseName() << "to incremental auto-vacuum";
+
+        QSqlQuery(u"PRAGMA auto_vacuum = incremental;"_qs, db);
+        QSqlQuery vacuumQuery(db);
+        if (!vacuumQuery.exec(u"VACUUM;"_qs))
+            qCWarning(LogSql) << "Failed to vacuum" << table << ":" << vacuumQuery.lastError().text();
+    } else if (result.evictedCount) {
+        // SQLite frees one page per step
+        QSqlQuery vacuumQuery(u"PRAGMA incremental_vacuum;"_qs, db);
+        while (vacuumQuery.next())
+            ;
+    }
+    if (result.evictedCount)
+        QSqlQuery(u"PRAGMA wal_checkpoint(TRUNCATE);"_qs, db);
+
+    return result;
+}
+
+} // namespace BrickLink::SqlCache
@@ -0,0 +1,36 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QtCore/QAtomicInt>
+#include <QtCore/QString>
+
+QT_FORWARD_DECLARE_CLASS(QSqlDatabase)
+
+
+namespace BrickLink {
+
+// Disk space management for the SQLite based picture and price-guide caches: both use a
+// single table with an 'id' primary key and an 'accessed' time stamp, so we can evict in
+// least-recently-used order.
+
+namespace SqlCache {
+
+struct MaintenanceResult
+{
+    qint64 size = -1;            // bytes used by live data after the maintenance run
+    qsizetype evictedCount = 0;
+};
+
+// has to be called once per connection before the first maintain()
+void setup(QSqlDatabase &db, const QString &table);
+
+// evicts the least recently accessed entries until the live data fits into maxSize bytes
+// (no limit if maxSize <= 0) and returns the free pages to the file system
+MaintenanceResult maintain(QSqlDatabase &db, const QString &table, qint64 maxSize,
+                           const QAtomicInt &abort);
+
+} // namespace SqlCache
+
+} // namespace BrickLink
@@ -19,9 +19,17 @@ void StaticPointerModel::init() const
     if (sorted.isEmpty()) {
         sorted.resize(pointerCount());
         std::iota(sorted.begin(), sorted.end(), 0);
+        sortedRowIndex = sorted;
     }
 }
 
+void StaticPointerModel::buildRowIndex(const QVector<int> &rows, QVector<int> &rowIndex) const
+{
+    rowIndex.fill(-1, pointerCount());
+    for (int row = 0; row < int(rows.size()); ++row)
+        rowIndex[rows.at(row)] = row;
+}
+
 QModelIndex StaticPointerModel::index(int row, int column, const QModelIndex &parent) const
 {
     if (!parent.isValid() && row >= 0 && column >= 0 && row < rowCount() && column < columnCount()) {
@@ -60,10 +68,8 @@ QModelIndex StaticPointerModel::index(const void *pointer, int column) const
 
     auto row = pointer ? pointerIndexOf(pointer) : -1;
     if (row >= 0) {
-        if (isFiltered())
-            row = int(filtered.indexOf(row));
-        else
-            row = int(sorted.indexOf(row));
+        const auto &rowIndex = isFiltered() ? filteredRowIndex : sortedRowIndex;
+        row = (row < rowIndex.size()) ? rowIndex.at(row) : -1;
     }
     return row >= 0 ? createIndex(row, column, const_cast<void *>(pointer)) : QModelIndex();
 }
@@ -83,6 +89,9 @@ void StaticPointerModel::setFilterDelayEnabled(bool enabled)
     filterDelayEnabled = enabled;
 }
 
+void StaticPointerModel::prepareFilter()
+{ }
+
 bool StaticPointerModel::filterAccepts(const void *) const
 {
     return true;
@@ -140,11 +149,14 @@ void StaticPointerModel::invalidateFilterDelayed()
 void StaticPointerModel::invalidateFilterInternal()
 {
     if (isFiltered()) {
+        prepareFilter();
         filtered = QtConcurrent::blockingFiltered(sorted, [this](int row) {
             return filterAccepts(pointerAt(row));
         });
+        buildRowIndex(filtered, filteredRowIndex);
     } else {
         filtered.clear();
+        filteredRowIndex.clear();
     }
 }
 
@@ -177,6 +189,7 @@ void StaticPointerModel::sort(int column, Qt::SortOrder order)
         for (int i = 0; i < n; ++i)
             sorted[i] = i;
     }
+    buildRowIndex(sorted, sortedRowIndex);
 
     if (filterDelayTimer && filterDelayTimer->isActive())
         filterDelayTimer->stop();
@@ -246,6 +259,7 @@ void StaticPointerModel::setFixedSortOrder(const QVector<const void *> &fixedOrd
                       else
                           return lessThan(pointer1, pointer2, lastSortColumn, lastSortOrder);
                   });
+    buildRowIndex(sorted, sortedRowIndex);
 
     if (filterDelayTimer && filterDelayTimer->isActive())
         filterDelayTimer->stop();
@@ -45,6 +45,8 @@ protected:
     virtual const void *pointerAt(int index) const = 0;
     virtual int pointerIndexOf(const void *pointer) const = 0;
 
+    // called before filterAccepts() is called (in parallel) for all pointers
+    virtual void prepareFilter();
     virtual bool filterAccepts(const void *pointer) const;
     virtual bool lessThan(const void *pointer1, const void *pointer2, int column, Qt::SortOrder order) const;
 
@@ -57,9 +59,13 @@ private:
     void init() const;
     void invalidateFilterDelayed();
     void invalidateFilterInternal();
+    void buildRowIndex(const QVector<int> &rows, QVector<int> &rowIndex) const;
 
     mutable QVector<int> sorted; // this needs to initialized in the first init() call
     QVector<int> filtered;
+    // reverse maps of sorted and filtered: pointer index -> row (or -1 if filtered out)
+    mutable QVector<int> sortedRowIndex;
+    QVector<int> filteredRowIndex;
     int lastSortColumn = -1;
     Qt::SortOrder lastSortOrder = Qt::AscendingOrder;
     bool fixedSortOrder = false;
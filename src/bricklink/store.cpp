@@ -1,9 +1,13 @@
 // Copyright (C) 2004-2023 Robert Griebl
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <atomic>
+#include <memory>
+#include <optional>
 
 #include <QUrl>
 #include <QUrlQuery>
+#include <QThreadPool>
 
 #include "utility/transfer.h"
 #include "utility/exception.h"
@@ -29,35 +33,76 @@ BrickLink::Store::Store(Core *core)
     connect(core, &Core::authenticatedTransferFinished,
             this, [this](TransferJob *job) {
         if ((m_updateStatus == UpdateStatus::Updating) && (m_job == job)) {
-            bool success = job->isCompleted() && (job->responseCode() == 200) && job->data();
-            QString message;
+            m_job = nullptr;
+            if (job->isCompleted() && (job->responseCode() == 200) && job->data())
+                parseInventory(*job->data());
+            else
+                finishUpdate(false, tr("Failed to download the store inventory") + u": " + job->errorString());
+        }
+    });
+}
+
+void BrickLink::Store::parseInventory(const QByteArray &data)
+{
+    // Big inventories take a while to parse: do it on a worker thread, reporting the progress
+    // through updateProgress(). The cancel flag is shared, because the Store could be gone
+    // before the parser is finished.
+    auto canceled = std::make_shared<std::atomic<bool>>(false);
+    m_parseCanceled = canceled;
+
+    QThreadPool::globalInstance()->start([this, data, canceled]() {
+        auto result = std::make_shared<std::optional<IO::ParseResult>>();
+        QString error;
+        try {
+            result->emplace(IO::fromBrickLinkXML(data, IO::Hint::Store, { },
+                                                 [this, canceled](int done, int total) {
+                if (*canceled)
+                    return false;
+                QMetaObject::invokeMethod(this, [this, canceled, done, total]() {
+                    if (!*canceled)
+                        emit updateProgress(done, total);
+                }, Qt::QueuedConnection);
+                return true;
+            }));
+        } catch (const Exception &e) {
+            error = e.errorString();
+        }
+
+        QMetaObject::invokeMethod(this, [this, canceled, result, error]() {
+            if (m_parseCanceled == canceled)
+                m_parseCanceled.reset();
+
+            if (*canceled) {
+                finishUpdate(false, { });
+                return;
+            }
+            const bool success = result->has_value();
             if (success) {
-                try {
-                    auto result = IO::fromBrickLinkXML(*job->data(), IO::Hint::Store);
-                    m_lots = result.takeLots();
-                    if (result.currencyCode() != m_currencyCode) {
-                        m_currencyCode = result.currencyCode();
-                        emit currencyCodeChanged(m_currencyCode);
-                    }
-                } catch (const Exception &e) {
-                    success = false;
-                    message = tr("Failed to import the store inventory") + u":<br><br>" + e.errorString();
-                }
-                if (success != m_valid) {
-                    m_valid = success;
-                    emit isValidChanged(success);
+                m_lots = (*result)->takeLots();
+                if ((*result)->currencyCode() != m_currencyCode) {
+                    m_currencyCode = (*result)->currencyCode();
+                    emit currencyCodeChanged(m_currencyCode);
                 }
-            } else {
-                message = tr("Failed to download the store inventory") + u": " + job->errorString();
             }
-            setUpdateStatus(success ? UpdateStatus::Ok : UpdateStatus::UpdateFailed);
-            setLastUpdated(QDateTime::currentDateTime());
-            emit updateFinished(success, message);
-            m_job = nullptr;
-        }
+            if (success != m_valid) {
+                m_valid = success;
+                emit isValidChanged(success);
+            }
+            QString message;
+            if (!success)
+                message = tr("Failed to import the store inventory") + u":<br><br>" + error;
+            finishUpdate(success, message);
+        }, Qt::QueuedConnection);
     });
 }
 
+void BrickLink::Store::finishUpdate(bool success, const QString &message)
+{
+    setUpdateStatus(success ? UpdateStatus::Ok : UpdateStatus::UpdateFailed);
+    setLastUpdated(QDateTime::currentDateTime());
+    emit updateFinished(success, message);
+}
+
 BrickLink::Store::~Store()
 {
     qDeleteAll(m_lots);
@@ -110,8 +155,12 @@ bool BrickLink::Store::startUpdate()
 
 void BrickLink::Store::cancelUpdate()
 {
-    if ((m_updateStatus == UpdateStatus::Updating) && m_job)
-        m_job->abort();
+    if (m_updateStatus == UpdateStatus::Updating) {
+        if (m_job)
+            m_job->abort();
+        else if (m_parseCanceled)
+            *m_parseCanceled = true;
+    }
 }
 
 #include "moc_store.cpp"
@@ -3,6 +3,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include <QtCore/QObject>
 #include <QtCore/QDateTime>
 #include <QtQml/qqmlregistration.h>
@@ -53,11 +56,14 @@ private:
     Store(Core *core);
     void setUpdateStatus(UpdateStatus updateStatus);
     void setLastUpdated(const QDateTime &lastUpdated);
+    void parseInventory(const QByteArray &data);
+    void finishUpdate(bool success, const QString &message);
 
     Core *m_core;
     bool m_valid = false;
     UpdateStatus m_updateStatus = UpdateStatus::UpdateFailed;
     TransferJob *m_job = nullptr;
+    std::shared_ptr<std::atomic<bool>> m_parseCanceled;
     LotList m_lots;
     QDateTime m_lastUpdated;
     QString m_currencyCode;
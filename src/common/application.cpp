@@ -537,6 +537,10 @@ QCoro::Task<bool> Application::updateDatabase()
         if (DocumentList::inst()->count())
             co_await qCoro(DocumentList::inst(), &DocumentList::lastDocumentClosed);
 
+        // documents that are still being parsed would end up with dangling items and colors
+        while (DocumentList::inst()->pendingLoadCount())
+            co_await qCoro(DocumentList::inst(), &DocumentList::pendingLoadsFinished);
+
         if (DocumentList::inst()->count())
             co_return false;
 
@@ -937,6 +941,9 @@ bool Application::initBrickLink()
     BrickLink::core()->setUpdateIntervals(Config::inst()->updateIntervals());
     connect(Config::inst(), &Config::updateIntervalsChanged,
             BrickLink::core(), &BrickLink::Core::setUpdateIntervals);
+    BrickLink::core()->setDiskCacheLimits(Config::inst()->diskCacheLimits());
+    connect(Config::inst(), &Config::diskCacheLimitsChanged,
+            BrickLink::core(), &BrickLink::Core::setDiskCacheLimits);
 
     QString lastRetrieverId = Config::inst()->value(u"BrickLink/VAT/LastRetrieverId"_qs).toString();
     QString retrieverId = BrickLink::core()->priceGuideCache()->retrieverId();
@@ -306,8 +306,8 @@ QString QmlBrickStore::cacheStats() const
     return u"Cache stats:\n"_qs
                   + u"Pictures    : [" + picBar + u"] " + QString::number(pic.first / 1000)
                   + u" / " + QString::number(pic.second / 1000) + u" MB\n"
-                  + u"Price guides: [" + pgBar + u"] " + QString::number(pg.first)
-                  + u" / " + QString::number(pg.second) + u" entries\n"
+                  + u"Price guides: [" + pgBar + u"] " + QString::number(pg.first / 1000)
+                  + u" / " + QString::number(pg.second / 1000) + u" KB\n"
                   + u"LDraw parts : [" + ldBar + u"] " + QString::number(ld.first)
                   + u" / " + QString::number(ld.second) + u" lines";
 }
@@ -422,10 +422,10 @@ void QmlDocument::sortAdditionally(int column, Qt::SortOrder order)
 
 DocumentStatistics QmlDocument::selectionStatistics(bool ignoreExcluded) const
 {
-    const auto &selected = m_doc->selectedLots();
-
-    return m_doc->model()->statistics(selected.isEmpty() ? m_doc->model()->filteredLots() : selected,
-                                      ignoreExcluded);
+    if (m_doc->selectedLots().isEmpty())
+        return m_doc->model()->statistics(m_doc->model()->filteredLots(), ignoreExcluded);
+    else
+        return m_doc->selectionStatistics(ignoreExcluded);
 }
 
 void QmlDocument::saveCurrentColumnLayout()
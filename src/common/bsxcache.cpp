@@ -0,0 +1,484 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <QtCore/QCryptographicHash>
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+#include <QtCore/QScopeGuard>
+
+#include "bricklink/core.h"
+#include "bricklink/database.h"
+#include "utility/utility.h"
+#include "common/bsxcache.h"
+
+
+static constexpr quint32 CacheMagic = 0x42535842; // 'BSXB'
+static constexpr quint32 CacheVersion = 1;
+static constexpr qint64 MaxCacheSize = 256 * 1024 * 1024;
+static constexpr int MaxCacheAgeDays = 30;
+
+namespace {
+
+// the cache file is machine local, so all the structs are simply written in native byte order
+
+struct Header
+{
+    quint32 magic;
+    quint32 version;
+    quint32 headerSize;
+    quint32 recordSize;
+    qint64  bsxSize;
+    qint64  bsxModified;      // msecs since epoch
+    qint64  databaseDate;     // msecs since epoch
+    quint64 itemCount;
+    quint64 colorCount;
+    quint64 lotCount;
+    quint64 lotsOffset;       // lotCount lot records, followed by lotCount base records
+    quint64 heapOffset;
+    quint64 heapSize;
+    quint32 bsxPath;          // offset into the string heap
+    quint32 currencyCode;     // offset into the string heap
+    quint64 columnLayoutOffset;
+    quint64 columnLayoutSize;
+    quint64 sortFilterStateOffset;
+    quint64 sortFilterStateSize;
+};
+
+struct LotRecord
+{
+    enum Flags : quint32 {
+        Retain       = 0x01,
+        MarkerColor  = 0x02,
+        DateAdded    = 0x04,
+        DateLastSold = 0x08,
+    };
+
+    double  price;
+    double  cost;
+    double  tierPrice[3];
+    double  weight;           // per piece, 0 if the lot has no custom weight
+    qint64  dateAdded;        // secs since epoch (UTC)
+    qint64  dateLastSold;     // secs since epoch (UTC)
+    quint32 itemIndex;
+    quint32 colorIndex;
+    qint32  quantity;
+    qint32  bulkQuantity;
+    qint32  sale;
+    qint32  tierQuantity[3];
+    quint32 lotId;
+    quint32 markerColor;      // QRgb
+    quint32 comments;         // offsets into the string heap
+    quint32 remarks;
+    quint32 reserved;
+    quint32 markerText;
+    quint32 flags;
+    quint8  status;
+    quint8  condition;
+    quint8  subCondition;
+    quint8  stockroom;
+};
+
+// Every string is stored as its length followed by the UTF-16 data, 4-byte aligned. Offset 0
+// is the empty string.
+class StringHeapWriter
+{
+public:
+    StringHeapWriter()
+    {
+        m_data.append(4, '\0');
+    }
+
+    quint32 add(const QString &str)
+    {
+        if (str.isEmpty())
+            return 0;
+        auto it = m_offsets.constFind(str);
+        if (it != m_offsets.cend())
+            return *it;
+
+        const auto offset = quint32(m_data.size());
+        const auto length = quint32(str.size());
+        m_data.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        m_data.append(reinterpret_cast<const char *>(str.utf16()), str.size() * 2);
+        m_data.append((4 - (m_data.size() % 4)) % 4, '\0');
+        m_offsets.insert(str, offset);
+        return offset;
+    }
+
+    const QByteArray &data() const  { return m_data; }
+
+private:
+    QByteArray m_data;
+    QHash<QString, quint32> m_offsets;
+};
+
+class StringHeapReader
+{
+public:
+    StringHeapReader(const uchar *data, quint64 size)
+        : m_data(data)
+        , m_size(size)
+    { }
+
+    // all lots share the same QString for the same heap entry
+    bool string(quint32 offset, QString &str)
+    {
+        if (!offset) {
+            str.clear();
+            return true;
+        }
+        auto it = m_strings.constFind(offset);
+        if (it != m_strings.cend()) {
+            str = *it;
+            return true;
+        }
+        quint32 length = 0;
+        if ((offset % 4) || ((quint64(offset) + sizeof(length)) > m_size))
+            return false;
+        std::memcpy(&length, m_data + offset, sizeof(length));
+        if (length > ((m_size - offset - sizeof(length)) / 2))
+            return false;
+        str = QString(reinterpret_cast<const QChar *>(m_data + offset + sizeof(length)), qsizetype(length));
+        m_strings.insert(offset, str);
+        return true;
+    }
+
+private:
+    const uchar *m_data;
+    quint64 m_size;
+    QHash<quint32, QString> m_strings;
+};
+
+} // namespace
+
+
+// The values are normalized exactly like a round-trip through DocumentIO::createBsxInventory()
+// and the BSX parser would do it.
+
+static double normalizedCurrency(double d)
+{
+    return QString::number(Utility::fixFinite(d), 'f', 3).toDouble();
+}
+
+static double normalizedWeight(double totalWeight, int quantity)
+{
+    // see Lot::setTotalWeight()
+    const double w = Utility::fixFinite(QString::number(Utility::fixFinite(totalWeight), 'f', 4).toDouble());
+    return (w <= 0) ? 0 : (w / (quantity ? qAbs(quantity) : 1));
+}
+
+static qint64 normalizedDateTime(const QDateTime &dt)
+{
+    // the XML only has a resolution of seconds
+    const qint64 msecs = dt.toMSecsSinceEpoch();
+    return (msecs / 1000) - (((msecs % 1000) < 0) ? 1 : 0);
+}
+
+static bool fillRecord(LotRecord &rec, const Lot &lot, StringHeapWriter &heap)
+{
+    if (lot.isIncomplete() || !lot.item() || !lot.color())
+        return false;
+
+    rec = { };
+    rec.itemIndex = lot.item()->index();
+    rec.colorIndex = lot.color()->index();
+    rec.status = quint8(lot.status());
+    rec.condition = quint8(lot.condition());
+    rec.subCondition = quint8(lot.subCondition());
+    rec.stockroom = quint8(lot.stockroom());
+    rec.quantity = lot.quantity();
+    rec.bulkQuantity = lot.bulkQuantity();
+    rec.sale = lot.sale();
+    rec.price = normalizedCurrency(lot.price());
+    rec.cost = normalizedCurrency(lot.cost());
+    for (int i = 0; i < 3; ++i) {
+        rec.tierQuantity[i] = lot.tierQuantity(i);
+        rec.tierPrice[i] = normalizedCurrency(lot.tierPrice(i));
+    }
+    rec.weight = lot.hasCustomWeight() ? normalizedWeight(lot.totalWeight(), lot.quantity()) : 0;
+    rec.lotId = lot.lotId();
+    rec.comments = heap.add(lot.comments());
+    rec.remarks = heap.add(lot.remarks());
+    rec.reserved = heap.add(lot.reserved());
+    rec.markerText = heap.add(lot.markerText());
+
+    if (lot.retain())
+        rec.flags |= LotRecord::Retain;
+    if (lot.markerColor().isValid()) {
+        rec.flags |= LotRecord::MarkerColor;
+        rec.markerColor = lot.markerColor().rgb();
+    }
+    if (lot.dateAdded().isValid()) {
+        rec.flags |= LotRecord::DateAdded;
+        rec.dateAdded = normalizedDateTime(lot.dateAdded());
+    }
+    if (lot.dateLastSold().isValid()) {
+        rec.flags |= LotRecord::DateLastSold;
+        rec.dateLastSold = normalizedDateTime(lot.dateLastSold());
+    }
+    return true;
+}
+
+static bool isRecordValid(const LotRecord &rec, StringHeapReader &heap, size_t itemCount,
+                          size_t colorCount)
+{
+    QString dummy;
+    return (rec.itemIndex < itemCount) && (rec.colorIndex < colorCount)
+            && (rec.status < quint8(BrickLink::Status::Count))
+            && (rec.condition < quint8(BrickLink::Condition::Count))
+            && (rec.subCondition < quint8(BrickLink::SubCondition::Count))
+            && (rec.stockroom < quint8(BrickLink::Stockroom::Count))
+            && heap.string(rec.comments, dummy) && heap.string(rec.remarks, dummy)
+            && heap.string(rec.reserved, dummy) && heap.string(rec.markerText, dummy);
+}
+
+// the marker and the dates are not part of the difference mode base
+static void applyRecord(const LotRecord &rec, Lot &lot, StringHeapReader &heap, bool isBase)
+{
+    QString str;
+
+    lot.setStatus(BrickLink::Status(rec.status));
+    lot.setQuantity(rec.quantity);
+    lot.setPrice(rec.price);
+    lot.setCondition(BrickLink::Condition(rec.condition));
+    lot.setSubCondition(BrickLink::SubCondition(rec.subCondition));
+    lot.setBulkQuantity(rec.bulkQuantity);
+    lot.setSale(rec.sale);
+    lot.setCost(rec.cost);
+    heap.string(rec.comments, str);
+    lot.setComments(str);
+    heap.string(rec.remarks, str);
+    lot.setRemarks(str);
+    heap.string(rec.reserved, str);
+    lot.setReserved(str);
+    lot.setLotId(rec.lotId);
+    for (int i = 0; i < 3; ++i) {
+        lot.setTierQuantity(i, rec.tierQuantity[i]);
+        lot.setTierPrice(i, rec.tierPrice[i]);
+    }
+    lot.setRetain(rec.flags & LotRecord::Retain);
+    lot.setStockroom(BrickLink::Stockroom(rec.stockroom));
+    lot.setWeight(rec.weight);
+
+    if (isBase)
+        return;
+
+    heap.string(rec.markerText, str);
+    lot.setMarkerText(str);
+    if (rec.flags & LotRecord::MarkerColor)
+        lot.setMarkerColor(QColor(QRgb(rec.markerColor)));
+    if (rec.flags & LotRecord::DateAdded)
+        lot.setDateAdded(QDateTime::fromSecsSinceEpoch(rec.dateAdded, Qt::UTC));
+    if (rec.flags & LotRecord::DateLastSold)
+        lot.setDateLastSold(QDateTime::fromSecsSinceEpoch(rec.dateLastSold, Qt::UTC));
+}
+
+
+QString BsxCache::cacheFileName(const QString &bsxFileName)
+{
+    const auto hash = QCryptographicHash::hash(QFileInfo(bsxFileName).absoluteFilePath().toUtf8(),
+                                               QCryptographicHash::Sha1);
+    return BrickLink::core()->dataPath() + u"bsx_cache/" + QString::fromLatin1(hash.toHex())
+            + u".bsxb";
+}
+
+bool BsxCache::load(const QString &bsxFileName, DocumentIO::BsxContents &bsx)
+{
+    const QFileInfo fi(bsxFileName);
+    const auto &items = BrickLink::core()->items();
+    const auto &colors = BrickLink::core()->colors();
+
+    QFile f(cacheFileName(bsxFileName));
+    if (!f.open(QIODevice::ReadOnly) || (f.size() < qint64(sizeof(Header))))
+        return false;
+    const auto fileSize = quint64(f.size());
+    uchar *data = f.map(0, f.size());
+    if (!data)
+        return false;
+    auto unmap = qScopeGuard([&f, data]() { f.unmap(data); });
+
+    Header header;
+    std::memcpy(&header, data, sizeof(header));
+
+    if ((header.magic != CacheMagic) || (header.version != CacheVersion)
+            || (header.headerSize != sizeof(Header)) || (header.recordSize != sizeof(LotRecord))
+            || (header.bsxSize != fi.size())
+            || (header.bsxModified != fi.lastModified().toMSecsSinceEpoch())
+            || (header.databaseDate != BrickLink::core()->database()->lastUpdated().toMSecsSinceEpoch())
+            || (header.itemCount != items.size()) || (header.colorCount != colors.size())) {
+        return false;
+    }
+
+    // the records are accessed directly in the mapped file, so better make sure they are sane
+    auto sectionValid = [fileSize](quint64 offset, quint64 size) {
+        return (offset <= fileSize) && (size <= (fileSize - offset));
+    };
+    if ((header.lotCount > (fileSize / sizeof(LotRecord) / 2))
+            || (header.lotsOffset % alignof(LotRecord))
+            || !sectionValid(header.lotsOffset, header.lotCount * 2 * sizeof(LotRecord))
+            || !sectionValid(header.heapOffset, header.heapSize)
+            || !sectionValid(header.columnLayoutOffset, header.columnLayoutSize)
+            || !sectionValid(header.sortFilterStateOffset, header.sortFilterStateSize)) {
+        return false;
+    }
+
+    StringHeapReader heap(data + header.heapOffset, header.heapSize);
+    QString bsxPath;
+    QString currencyCode;
+    if (!heap.string(header.bsxPath, bsxPath) || (bsxPath != fi.absoluteFilePath())
+            || !heap.string(header.currencyCode, currencyCode)) {
+        return false;
+    }
+
+    const auto *records = reinterpret_cast<const LotRecord *>(data + header.lotsOffset);
+    const auto lotCount = qsizetype(header.lotCount);
+
+    // check everything before creating the first lot: we don't want half a document
+    for (qsizetype i = 0; i < (lotCount * 2); ++i) {
+        if (!isRecordValid(records[i], heap, items.size(), colors.size()))
+            return false;
+    }
+
+    for (qsizetype i = 0; i < lotCount; ++i) {
+        const LotRecord &rec = records[i];
+        const LotRecord &baseRec = records[lotCount + i];
+
+        auto *lot = new Lot(&items[rec.itemIndex], &colors[rec.colorIndex]);
+        applyRecord(rec, *lot, heap, false);
+
+        Lot base = *lot;
+        base.setItem(&items[baseRec.itemIndex]);
+        base.setColor(&colors[baseRec.colorIndex]);
+        applyRecord(baseRec, base, heap, true);
+        bsx.addToDifferenceModeBase(lot, base);
+
+        bsx.addLot(std::move(lot));
+    }
+
+    bsx.setCurrencyCode(currencyCode);
+    bsx.guiColumnLayout = QByteArray(reinterpret_cast<const char *>(data + header.columnLayoutOffset),
+                                     qsizetype(header.columnLayoutSize));
+    bsx.guiSortFilterState = QByteArray(reinterpret_cast<const char *>(data + header.sortFilterStateOffset),
+                                        qsizetype(header.sortFilterStateSize));
+
+    // the modification time is only used for pruning, so this turns it into an LRU cache
+    f.setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+    return true;
+}
+
+bool BsxCache::save(const QString &bsxFileName, const QString &currencyCode, const LotList &lots,
+                    const QHash<const Lot *, Lot> &differenceModeBase,
+                    const QByteArray &guiColumnLayout, const QByteArray &guiSortFilterState)
+{
+    const QFileInfo fi(bsxFileName);
+    const QString fileName = cacheFileName(bsxFileName);
+
+    // whatever happens, the old cache is outdated now
+    auto removeOutdated = qScopeGuard([&fileName]() { QFile::remove(fileName); });
+
+    StringHeapWriter heap;
+    const auto lotCount = lots.size();
+    std::vector<LotRecord> records(size_t(lotCount) * 2);
+
+    for (qsizetype i = 0; i < lotCount; ++i) {
+        const Lot *lot = lots.at(i);
+        LotRecord &rec = records[size_t(i)];
+        LotRecord &baseRec = records[size_t(lotCount + i)];
+
+        if (!fillRecord(rec, *lot, heap))
+            return false;
+
+        // the BSX parser falls back to the lot's item and color, if the base has none
+        Lot base = differenceModeBase.value(lot);
+        if (!base.item())
+            base.setItem(lot->item());
+        if (!base.color())
+            base.setColor(lot->color());
+        if (!fillRecord(baseRec, base, heap))
+            return false;
+
+        // the base's weight is only saved if the lot has a custom weight
+        if (lot->hasCustomWeight() && (base.totalWeight() != lot->totalWeight()))
+            baseRec.weight = normalizedWeight(base.totalWeight(), base.quantity());
+        else
+            baseRec.weight = rec.weight;
+    }
+
+    Header header = { };
+    header.magic = CacheMagic;
+    header.version = CacheVersion;
+    header.headerSize = sizeof(Header);
+    header.recordSize = sizeof(LotRecord);
+    header.bsxSize = fi.size();
+    header.bsxModified = fi.lastModified().toMSecsSinceEpoch();
+    header.databaseDate = BrickLink::core()->database()->lastUpdated().toMSecsSinceEpoch();
+    header.itemCount = BrickLink::core()->items().size();
+    header.colorCount = BrickLink::core()->colors().size();
+    header.bsxPath = heap.add(fi.absoluteFilePath());
+    header.currencyCode = heap.add(currencyCode);
+    header.lotCount = quint64(lotCount);
+    header.lotsOffset = sizeof(Header);
+    header.heapOffset = header.lotsOffset + records.size() * sizeof(LotRecord);
+    header.heapSize = quint64(heap.data().size());
+    header.columnLayoutOffset = header.heapOffset + header.heapSize;
+    header.columnLayoutSize = quint64(guiColumnLayout.size());
+    header.sortFilterStateOffset = header.columnLayoutOffset + header.columnLayoutSize;
+    header.sortFilterStateSize = quint64(guiSortFilterState.size());
+
+    if (header.heapSize > std::numeric_limits<quint32>::max())
+        return false;
+
+    QDir().mkpath(QFileInfo(fileName).absolutePath());
+    QSaveFile f(fileName);
+    if (!f.open(QIODevice::WriteOnly))
+        return false;
+
+    const auto recordsSize = qint64(records.size() * sizeof(LotRecord));
+    if ((f.write(reinterpret_cast<const char *>(&header), sizeof(header)) != qint64(sizeof(header)))
+            || (f.write(reinterpret_cast<const char *>(records.data()), recordsSize) != recordsSize)
+            || (f.write(heap.data()) != heap.data().size())
+            || (f.write(guiColumnLayout) != guiColumnLayout.size())
+            || (f.write(guiSortFilterState) != guiSortFilterState.size())
+            || !f.commit()) {
+        return false;
+    }
+    removeOutdated.dismiss();
+    prune(fileName);
+    return true;
+}
+
+void BsxCache::prune(const QString &keepFileName)
+{
+    const QFileInfo keep(keepFileName);
+    const auto databaseDate = BrickLink::core()->database()->lastUpdated().toMSecsSinceEpoch();
+    const auto oldest = QDateTime::currentDateTime().addDays(-MaxCacheAgeDays);
+    qint64 totalSize = keep.size();
+
+    // the most recently used files come first
+    const auto entries = keep.dir().entryInfoList({ u"*.bsxb"_qs }, QDir::Files, QDir::Time);
+    for (const QFileInfo &fi : entries) {
+        if (fi == keep)
+            continue;
+
+        bool keepEntry = (fi.lastModified() >= oldest) && ((totalSize + fi.size()) <= MaxCacheSize);
+        if (keepEntry) {
+            // after a database update, the old files can never be loaded again
+            QFile f(fi.absoluteFilePath());
+            Header header = { };
+            keepEntry = f.open(QIODevice::ReadOnly)
+                    && (f.read(reinterpret_cast<char *>(&header), sizeof(header)) == qint64(sizeof(header)))
+                    && (header.magic == CacheMagic) && (header.version == CacheVersion)
+                    && (header.databaseDate == databaseDate);
+        }
+        if (keepEntry)
+            totalSize += fi.size();
+        else
+            QFile::remove(fi.absoluteFilePath());
+    }
+}
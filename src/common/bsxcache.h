@@ -0,0 +1,42 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QString>
+
+#include "common/documentio.h"
+
+
+/* A binary companion file for BSX documents, so that big documents can be opened again
+ * without parsing any XML.
+ *
+ * The file holds a header, a table of fixed size lot records and a string heap. Items and
+ * colors are referenced by their index into the catalog, so the file is only valid as long as
+ * the same database is loaded and the BSX file itself hasn't been touched (same size and
+ * modification time). The cache is machine local: everything is in native byte order and it
+ * lives in the BrickLink data directory instead of next to the BSX file.
+ * The lots are stored normalized, the same way they would come out of the XML parser. This
+ * way, loading the cache results in exactly the same document as parsing the BSX file.
+ */
+
+class BsxCache
+{
+public:
+    // returns false if there is no valid cache for this BSX file
+    static bool load(const QString &bsxFileName, DocumentIO::BsxContents &bsx);
+
+    // Needs to be called after the BSX file has been written. Documents with incomplete lots
+    // are not cached: an outdated cache file is removed in this case. Saving also prunes the
+    // cache directory: files for an older database, files that haven't been used for a month
+    // and the least recently used ones beyond a total size of 256 MB are removed.
+    static bool save(const QString &bsxFileName, const QString &currencyCode, const LotList &lots,
+                     const QHash<const Lot *, Lot> &differenceModeBase,
+                     const QByteArray &guiColumnLayout, const QByteArray &guiSortFilterState);
+
+private:
+    static QString cacheFileName(const QString &bsxFileName);
+    static void prune(const QString &keepFileName);
+};
@@ -326,6 +326,45 @@ void Config::setUpdateIntervals(const QMap<QByteArray, int> &uiv)
         emit updateIntervalsChanged(updateIntervals());
 }
 
+QMap<QByteArray, int> Config::diskCacheLimits() const
+{
+    QMap<QByteArray, int> limits = diskCacheLimitsDefault();
+
+    static const std::array lut = { "Picture", "PriceGuide" };
+
+    for (const auto &l : lut)
+        limits[l] = value(u"BrickLink/DiskCacheLimit/"_qs + QLatin1String(l), limits[l]).toInt();
+    return limits;
+}
+
+QMap<QByteArray, int> Config::diskCacheLimitsDefault() const
+{
+    QMap<QByteArray, int> limits;
+
+    limits.insert("Picture",    2000);
+    limits.insert("PriceGuide",  200);
+
+    return limits;
+}
+
+void Config::setDiskCacheLimits(const QMap<QByteArray, int> &limits)
+{
+    bool modified = false;
+    QMap<QByteArray, int> oldLimits = diskCacheLimits();
+
+    for (QMapIterator<QByteArray, int> it(limits); it.hasNext(); ) {
+        it.next();
+
+        if (it.value() != oldLimits.value(it.key())) {
+            setValue(u"BrickLink/DiskCacheLimit/"_qs + QLatin1String(it.key()), it.value());
+            modified = true;
+        }
+    }
+
+    if (modified)
+        emit diskCacheLimitsChanged(diskCacheLimits());
+}
+
 void Config::setFontSizePercent(int p)
 {
     auto oldp = fontSizePercent();
@@ -641,6 +680,21 @@ void Config::setVisualChangesMarkModified(bool b)
     }
 }
 
+int Config::undoMemoryLimit() const
+{
+    return std::max(0, value(u"General/UndoMemoryLimit"_qs, 256).toInt());
+}
+
+void Config::setUndoMemoryLimit(int mb)
+{
+    mb = std::max(0, mb);
+
+    if (undoMemoryLimit() != mb) {
+        setValue(u"General/UndoMemoryLimit"_qs, mb);
+        emit undoMemoryLimitChanged(mb);
+    }
+}
+
 bool Config::restoreLastSession() const
 {
     return value(u"General/RestoreLastSession"_qs, true).toBool();
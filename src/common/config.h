@@ -91,6 +91,9 @@ public:
     bool visualChangesMarkModified() const;
     void setVisualChangesMarkModified(bool b);
 
+    int undoMemoryLimit() const; // in MB per document, 0 for unlimited
+    void setUndoMemoryLimit(int mb);
+
     bool restoreLastSession() const;
     void setRestoreLastSession(bool b);
 
@@ -107,6 +110,10 @@ public:
     QMap<QByteArray, int> updateIntervalsDefault() const;
     void setUpdateIntervals(const QMap<QByteArray, int> &intervals);
 
+    QMap<QByteArray, int> diskCacheLimits() const; // in MB
+    QMap<QByteArray, int> diskCacheLimitsDefault() const;
+    void setDiskCacheLimits(const QMap<QByteArray, int> &limits);
+
     enum class UISize {
         System,
         Small,
@@ -180,7 +187,9 @@ signals:
     void showInputErrorsChanged(bool b);
     void showDifferenceIndicatorsChanged(bool b);
     void visualChangesMarkModifiedChanged(bool b);
+    void undoMemoryLimitChanged(int mb);
     void updateIntervalsChanged(const QMap<QByteArray, int> &intervals);
+    void diskCacheLimitsChanged(const QMap<QByteArray, int> &limits);
     void onlineStatusChanged(bool b);
     void iconSizeChanged(Config::UISize iconSize);
     void fontSizePercentChanged(int p);
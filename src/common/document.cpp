@@ -8,6 +8,10 @@
 #include <QtCore/QSaveFile>
 #include <QtCore/QStandardPaths>
 #include <QtCore/QBitArray>
+#include <QtCore/QSet>
+#include <QtCore/QDataStream>
+#include <QtCore/QThreadPool>
+#include <QtCore/QScopeGuard>
 #include <QtGui/QClipboard>
 #include <QtGui/QCursor>
 #include <QtGui/QImage>
@@ -16,6 +20,9 @@
 #include <QtGui/QGuiApplication>
 #include <QAction>
 #include <QDebug>
+#include <QtConcurrentRun>
+
+#include <QCoro/QCoroFuture>
 
 #include "bricklink/core.h"
 #include "bricklink/order.h"
@@ -225,13 +232,24 @@ Document::Document(DocumentModel *model, const QByteArray &columnsState, QObject
     connect(m_model, &DocumentModel::dataChanged,
             this, &Document::documentDataChanged);
 
-    connect(BrickLink::core()->priceGuideCache(), &BrickLink::PriceGuideCache::priceGuideUpdated,
-            this, &Document::priceGuideUpdated);
+    connect(BrickLink::core()->priceGuideCache(), &BrickLink::PriceGuideCache::prefetchProgress,
+            this, [this](int prefetchId, int done, int total) {
+        if (m_setToPG && (prefetchId == m_setToPG->prefetchId))
+            emit blockingOperationProgress(done, total);
+    });
+    connect(BrickLink::core()->priceGuideCache(), &BrickLink::PriceGuideCache::prefetchFinished,
+            this, &Document::priceGuidesPrefetched);
 
     updateItemFlagsMask();
 
     connect(model->undoStack(), &QUndoStack::indexChanged,
                this, [this]() { m_autosaveClean = false; });
+    connect(m_model, &DocumentModel::lotsInserted,
+            this, &Document::autosaveLotsInserted);
+    connect(m_model, &DocumentModel::lotsRemoved,
+            this, &Document::autosaveLotsRemoved);
+    connect(m_model, &DocumentModel::lotsChanged,
+            this, &Document::autosaveLotsChanged);
     connect(&m_autosaveTimer, &QTimer::timeout,
             this, &Document::autosave);
     m_autosaveTimer.start(1min);
@@ -1052,45 +1070,31 @@ void Document::setPriceToGuide(BrickLink::Time time, BrickLink::Price price, boo
 
     m_setToPG = std::make_unique<SetToPriceGuideData>();
     m_setToPG->changes.reserve(uint(sel.size()));
-    m_setToPG->totalCount = int(sel.count());
-    m_setToPG->doneCount = 0;
+    m_setToPG->lots = sel;
     m_setToPG->time = time;
     m_setToPG->price = price;
     m_setToPG->currencyRate = Currency::inst()->rate(m_model->currencyCode());
     m_setToPG->noPgOption = noPgOption;
 
-    for (Lot *lot : sel) {
-        BrickLink::PriceGuide *pg = BrickLink::core()->priceGuideCache()->priceGuide(lot->item(), lot->color());
-
-        if (pg && forceUpdate && (pg->updateStatus() != BrickLink::UpdateStatus::Updating)) {
-            pg->update();
-        }
-
-        if (pg && ((pg->updateStatus() == BrickLink::UpdateStatus::Loading)
-                   || (pg->updateStatus() == BrickLink::UpdateStatus::Updating))) {
-            m_setToPG->priceGuides.insert(pg, lot);
-            pg->addRef();
+    std::vector<std::pair<const BrickLink::Item *, const BrickLink::Color *>> keys;
+    keys.reserve(size_t(sel.size()));
+    for (const Lot *lot : sel)
+        keys.emplace_back(lot->item(), lot->color());
 
-        } else {
-            if (!updatePriceToGuide(lot, pg))
-                ++m_setToPG->failCount;
-            ++m_setToPG->doneCount;
-            emit blockingOperationProgress(m_setToPG->doneCount, m_setToPG->totalCount);
-        }
-    }
+    auto *pgCache = BrickLink::core()->priceGuideCache();
+    auto prefetch = pgCache->prefetch(keys, pgCache->currentVatType(), forceUpdate);
+    m_setToPG->prefetchId = prefetch.id;
+    m_setToPG->priceGuides = prefetch.priceGuides;
 
     setBlockingOperationTitle(tr("Downloading price guide data from BrickLink"));
     setBlockingOperationCancelCallback([this]() { cancelPriceGuideUpdates(); });
-
-    if (m_setToPG->priceGuides.isEmpty())
-        priceGuideUpdated(nullptr);
 }
 
 bool Document::updatePriceToGuide(BrickLink::Lot *lot, const BrickLink::PriceGuide *pg)
 {
     bool hasError = !pg || !pg->isValid()
                     || (pg->updateStatus() == BrickLink::UpdateStatus::UpdateFailed)
-                    || m_setToPG->canceled;
+                    || m_setToPG->canceled.contains(pg);
     double price = hasError ? 0 : pg->price(m_setToPG->time, lot->condition(), m_setToPG->price) * m_setToPG->currencyRate;
 
     if (hasError || qFuzzyIsNull(price)) {
@@ -1124,31 +1128,19 @@ bool Document::updatePriceToGuide(BrickLink::Lot *lot, const BrickLink::PriceGui
     }
 }
 
-void Document::priceGuideUpdated(BrickLink::PriceGuide *pg)
+void Document::priceGuidesPrefetched(int prefetchId)
 {
-    if (m_setToPG && pg) {
-        const auto lots = m_setToPG->priceGuides.values(pg);
-
-        if (lots.isEmpty())
-            return; // not a PG requested by us
-        if (pg->updateStatus() == BrickLink::UpdateStatus::Updating)
-            return; // loaded now, but still needs an online update
-
-        for (auto lot : lots) {
-            if (!updatePriceToGuide(lot, pg))
+    if (m_setToPG && (prefetchId == m_setToPG->prefetchId)) {
+        for (qsizetype i = 0; i < m_setToPG->lots.size(); ++i) {
+            auto *pg = m_setToPG->priceGuides.at(i);
+            if (!updatePriceToGuide(m_setToPG->lots.at(i), pg))
                 ++m_setToPG->failCount;
-            ++m_setToPG->doneCount;
-            pg->release();
+            if (pg)
+                pg->release();
         }
 
-        emit blockingOperationProgress(m_setToPG->doneCount, m_setToPG->totalCount);
-        m_setToPG->priceGuides.remove(pg);
-    }
-
-    if (m_setToPG && m_setToPG->priceGuides.isEmpty()
-            && (m_setToPG->doneCount == m_setToPG->totalCount)) {
         int failCount = m_setToPG->failCount;
-        int successCount = m_setToPG->totalCount - failCount;
+        int successCount = int(m_setToPG->lots.size()) - failCount;
         m_model->changeLots(m_setToPG->changes);
         m_setToPG.reset();
 
@@ -1170,12 +1162,14 @@ void Document::priceGuideUpdated(BrickLink::PriceGuide *pg)
 void Document::cancelPriceGuideUpdates()
 {
     if (m_setToPG) {
-        m_setToPG->canceled = true;
-        const auto pgs = m_setToPG->priceGuides.uniqueKeys();
-        for (BrickLink::PriceGuide *pg : pgs) {
-            if (pg->updateStatus() == BrickLink::UpdateStatus::Updating)
-                pg->cancelUpdate();
+        // whatever has been loaded so far is still applied
+        for (const auto *pg : std::as_const(m_setToPG->priceGuides)) {
+            if (pg && ((pg->updateStatus() == BrickLink::UpdateStatus::Loading)
+                       || (pg->updateStatus() == BrickLink::UpdateStatus::Updating))) {
+                m_setToPG->canceled.insert(pg);
+            }
         }
+        BrickLink::core()->priceGuideCache()->cancelPrefetch(m_setToPG->prefetchId);
     }
 }
 
@@ -1650,6 +1644,25 @@ void Document::hideColumn(int logical, bool oldHidden, int newHidden)
                                              logical, oldHidden, newHidden));
 }
 
+// The part of loading a document that doesn't touch any QObjects, so it can run on a worker
+// thread. Both load() and loadFromFile() go through readBsxFile() and createLoadedDocument().
+static void readBsxFile(const QString &fileName, DocumentIO::BsxContents &bsx,
+                        const std::function<bool(int, int)> &progress = { })
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly))
+        throw Exception(f.errorString());
+    DocumentIO::parseBsxContents(&f, bsx, progress);
+}
+
+static Document *createLoadedDocument(const QString &fileName, DocumentIO::BsxContents &bsx)
+{
+    auto doc = DocumentIO::createBsxDocument(bsx);
+    doc->setFilePath(fileName);
+    RecentFiles::inst()->add(doc->filePath(), doc->fileName());
+    return doc;
+}
+
 QCoro::Task<Document *> Document::load(QString fileName)
 {
     QString fn = fileName;
@@ -1667,28 +1680,59 @@ QCoro::Task<Document *> Document::load(QString fileName)
         co_return existingDocument;
     }
 
-    try {
-        auto doc = loadFromFile(fn);
-        QMetaObject::invokeMethod(doc, &Document::requestActivation, Qt::QueuedConnection);
-        co_return doc;
-    } catch (const Exception &e) {
-        UIHelpers::warning(e.errorString());
+    // the database must not be updated while we are resolving items and colors
+    co_await DocumentList::inst()->beginLoad();
+    auto endLoad = qScopeGuard([]() { DocumentList::inst()->endLoad(); });
+
+    // parsing and resolving big documents takes a while: do it on a worker thread
+    DocumentIO::BsxContents bsx;
+    QString error;
+    auto parse = [&fn, &bsx, &error](const std::function<bool(int, int)> &progress) {
+        try {
+            readBsxFile(fn, bsx, progress);
+        } catch (const Exception &e) {
+            error = e.errorString();
+        }
+    };
+
+    // only show a progress dialog for big documents: restoring a session opens a lot of
+    // small ones at the same time
+    static constexpr qint64 ProgressDialogFileSize = 2 * 1024 * 1024;
+
+    if (QFileInfo(fn).size() >= ProgressDialogFileSize) {
+        if (!co_await UIHelpers::runWithProgressDialog(tr("Open File"),
+                                                       tr("Loading %1").arg(CMB_BOLD(QFileInfo(fn).fileName())),
+                                                       parse)) {
+            co_return nullptr;
+        }
+    } else {
+        QGuiApplication::setOverrideCursor(QCursor(Qt::WaitCursor));
+        co_await QtConcurrent::run([&parse]() { parse({ }); });
+        QGuiApplication::restoreOverrideCursor();
+    }
+
+    if (!error.isEmpty()) {
+        UIHelpers::warning(tr("Failed to load document %1: %2").arg(fn).arg(error));
         co_return nullptr;
     }
+
+    // the same file could have been opened a second time in the meantime
+    if (auto *existingDocument = DocumentList::inst()->documentForFile(fn)) {
+        emit existingDocument->requestActivation();
+        co_return existingDocument;
+    }
+
+    auto doc = createLoadedDocument(fn, bsx);
+    QMetaObject::invokeMethod(doc, &Document::requestActivation, Qt::QueuedConnection);
+    co_return doc;
 }
 
 Document *Document::loadFromFile(const QString &fileName)
 {
-    QFile f(fileName);
-
     try {
-        if (!f.open(QIODevice::ReadOnly))
-            throw Exception(f.errorString());
-
-        auto doc = DocumentIO::parseBsxInventory(&f);
-        doc->setFilePath(fileName);
-        RecentFiles::inst()->add(doc->filePath(), doc->fileName());
-        return doc;
+        DocumentIO::BsxContents bsx;
+        readBsxFile(fileName, bsx);
+        return createLoadedDocument(fileName, bsx);
     } catch (const Exception &e) {
         throw Exception(tr("Failed to load document %1: %2").arg(fileName).arg(e.errorString()));
     }
@@ -1748,6 +1792,7 @@ void Document::saveToFile(const QString &fileName)
             || !f.commit()) {
         throw Exception(&f, tr("Failed to save document"));
     }
+    DocumentIO::createBsxCache(fileName, this);
 
     model()->unsetModified();
     setFilePath(fileName);
@@ -1866,6 +1911,16 @@ void Document::updateSelection()
         newSelectedLots.append(m_model->filteredLots().at(row));
 
     if (newSelectedLots != m_selectedLots) {
+        // only the (de)selected lots need to be accounted for in the selection statistics
+        if (m_selectionTotalsGeneration == m_model->statisticsGeneration()) {
+            QSet<const Lot *> deselected(m_selectedLots.cbegin(), m_selectedLots.cend());
+            for (const Lot *lot : std::as_const(newSelectedLots)) {
+                if (!deselected.remove(lot))
+                    m_selectionTotals.add(m_model, lot);
+            }
+            for (const Lot *lot : std::as_const(deselected))
+                m_selectionTotals.remove(m_model, lot);
+        }
         m_selectedLots = newSelectedLots;
         emit selectedLotsChanged(m_selectedLots);
     }
@@ -1874,6 +1929,18 @@ void Document::updateSelection()
         emit ensureVisible(m_selectionModel->currentIndex());
 }
 
+DocumentStatistics Document::selectionStatistics(bool ignoreExcluded) const
+{
+    // the lots themselves changed: start from scratch
+    if (m_selectionTotalsGeneration != m_model->statisticsGeneration()) {
+        m_selectionTotals.clear();
+        for (const Lot *lot : m_selectedLots)
+            m_selectionTotals.add(m_model, lot);
+        m_selectionTotalsGeneration = m_model->statisticsGeneration();
+    }
+    return m_model->statistics(m_selectionTotals, ignoreExcluded);
+}
+
 void Document::applyTo(const LotList &lots, const char *actionName,
                        const std::function<DocumentModel::ApplyToResult(const Lot &, Lot &)> &callback)
 {
@@ -1893,13 +1960,14 @@ void Document::copyFields(const LotList &srcLots, const DocumentModel::FieldMerg
     std::vector<std::pair<Lot *, Lot>> changes;
     changes.reserve(uint(m_model->lots().size())); // just a guestimate
 
+    LotMergeIndex srcIndex;
+    srcIndex.rebuild(srcLots);
+
     model()->beginMacro();
 
     for (Lot *dstLot : m_model->lots()) {
-        for (const auto &srcLot : srcLots) {
-            if (!DocumentModel::canLotsBeMerged(*dstLot, *srcLot))
-                continue;
-
+        const LotList candidates = srcIndex.candidates(*dstLot);
+        for (const auto &srcLot : candidates) {
             Lot newLot = *dstLot;
             if (DocumentModel::mergeLotFields(*srcLot, newLot, fieldMergeModes)) {
                 changes.emplace_back(dstLot, newLot);
@@ -1917,10 +1985,10 @@ void Document::subtractItems(const LotList &subLots)
 {
     if (subLots.isEmpty())
         return;
-    const LotList &lots = model()->lots();
 
     std::vector<std::pair<Lot *, Lot>> changes;
     changes.reserve(uint(subLots.size() * 2)); // just a guestimate
+    QHash<const Lot *, size_t> changeIndex; // position in changes
     LotList newLots;
 
     model()->beginMacro();
@@ -1931,15 +1999,13 @@ void Document::subtractItems(const LotList &subLots)
             continue;
 
         bool hadMatch = false;
+        const LotList candidates = model()->mergeCandidates(*subLot);
 
-        for (Lot *lot : lots) {
-            if (!DocumentModel::canLotsBeMerged(*lot, *subLot))
-                continue;
-
+        for (Lot *lot : candidates) {
             Lot newItem = *lot;
-            auto change = std::find_if(changes.begin(), changes.end(), [=](const auto &c) {
-                return c.first == lot;
-            });
+            auto changeIt = changeIndex.constFind(lot);
+            auto change = (changeIt == changeIndex.cend()) ? changes.end()
+                                                           : changes.begin() + qsizetype(*changeIt);
             Lot &newItemRef = (change == changes.end()) ? newItem : change->second;
             int qtyInItem = newItemRef.quantity();
 
@@ -1954,11 +2020,15 @@ void Document::subtractItems(const LotList &subLots)
             // make sure that this is the last entry in changes, so we can reference it
             // easily below, if a qty is left
             if (&newItemRef == &newItem) {
+                changeIndex.insert(lot, changes.size());
                 changes.emplace_back(lot, newItem);
             } else {
                 auto last = std::prev(changes.end());
-                if (last != change)
+                if (last != change) {
                     std::swap(*change, *last);
+                    changeIndex[change->first] = size_t(change - changes.begin());
+                    changeIndex[last->first] = size_t(last - changes.begin());
+                }
             }
             hadMatch = true;
 
@@ -2414,8 +2484,186 @@ void Document::cancelBlockingOperation()
 ///////////////////////////////////////////////////////////////////////
 
 
+/* Autosaves are written as a checkpoint containing all the lots, plus a journal that only
+ * gets the lots touched since then appended to it. The lots are identified by ids that are
+ * local to the autosave. Restoring means replaying the journal on top of the checkpoint.
+ * Compacting both into a new checkpoint works on the still serialized lots, so it doesn't
+ * need the document and can run in the background, once the journal gets too big.
+ *
+ * All the file operations for autosaves run one after the other on a thread pool with a
+ * single thread, so appending to a journal can never race with compacting it.
+ */
+
 static const char *autosaveMagic = "||BRICKSTORE AUTOSAVE MAGIC||";
 static const char *autosaveTemplate = "brickstore_%1.autosave";
+static const char *autosaveJournalSuffix = ".journal";
+static constexpr qint32 autosaveVersion = 7;
+static constexpr quint32 autosaveJournalMagic = 0x424a524e; // 'BJRN'
+
+namespace {
+
+struct AutosaveEntry
+{
+    uint changelogId = 0;
+    QByteArray lot;
+    QByteArray base;  // empty if there is no difference base
+};
+
+QDataStream &operator<<(QDataStream &ds, const AutosaveEntry &entry)
+{
+    return ds << entry.changelogId << entry.lot << entry.base;
+}
+
+QDataStream &operator>>(QDataStream &ds, AutosaveEntry &entry)
+{
+    return ds >> entry.changelogId >> entry.lot >> entry.base;
+}
+
+struct AutosaveMetaData
+{
+    QString title;
+    QString filePath;
+    QString currencyCode;
+    QByteArray columnsState;
+    QByteArray sortFilterState;
+};
+
+QDataStream &operator<<(QDataStream &ds, const AutosaveMetaData &meta)
+{
+    return ds << meta.title << meta.filePath << meta.currencyCode << meta.columnsState
+              << meta.sortFilterState;
+}
+
+QDataStream &operator>>(QDataStream &ds, AutosaveMetaData &meta)
+{
+    return ds >> meta.title >> meta.filePath >> meta.currencyCode >> meta.columnsState
+              >> meta.sortFilterState;
+}
+
+// everything touched since the last autosave
+struct AutosaveJournalBatch
+{
+    AutosaveMetaData meta;
+    QVector<std::pair<quint32, AutosaveEntry>> changed;
+    QVector<quint32> removed;
+    bool hasOrder = false;
+    QVector<quint32> order;
+};
+
+struct AutosaveState
+{
+    AutosaveMetaData meta;
+    QHash<quint32, AutosaveEntry> entries;
+    QVector<quint32> order;
+
+    bool readCheckpoint(QIODevice *in)
+    {
+        QDataStream ds(in);
+        QByteArray magic;
+        qint32 version = 0;
+        qint32 count = 0;
+
+        ds >> magic >> version;
+        if ((magic != QByteArray(autosaveMagic)) || (version != autosaveVersion))
+            return false;
+        ds >> meta >> count;
+        if ((ds.status() != QDataStream::Ok) || (count < 0))
+            return false;
+
+        entries.clear();
+        entries.reserve(count);
+        order.clear();
+        order.reserve(count);
+        for (qint32 i = 0; i < count; ++i) {
+            quint32 id = 0;
+            AutosaveEntry entry;
+            ds >> id >> entry;
+            order.append(id);
+            entries.insert(id, entry);
+        }
+        ds >> magic;
+        return (ds.status() == QDataStream::Ok) && (magic == QByteArray(autosaveMagic));
+    }
+
+    bool writeCheckpoint(QIODevice *out) const
+    {
+        QDataStream ds(out);
+        ds << QByteArray(autosaveMagic) << autosaveVersion << meta << qint32(order.size());
+        for (const auto id : order)
+            ds << id << entries.value(id);
+        ds << QByteArray(autosaveMagic);
+        return (ds.status() == QDataStream::Ok);
+    }
+
+    // Applies all complete batches. A crash while appending to the journal can leave an
+    // incomplete batch at the end, which is ignored.
+    void replayJournal(QIODevice *in)
+    {
+        QDataStream ds(in);
+
+        while (!ds.atEnd()) {
+            quint32 magic = 0;
+            QByteArray payload;
+            quint16 checksum = 0;
+            ds >> magic >> payload >> checksum;
+            if ((ds.status() != QDataStream::Ok) || (magic != autosaveJournalMagic)
+                    || (checksum != qChecksum(payload))) {
+                break;
+            }
+
+            AutosaveJournalBatch batch;
+            QDataStream pds(payload);
+            qint32 changedCount = 0;
+            pds >> batch.meta >> changedCount;
+            for (qint32 i = 0; (i < changedCount) && (pds.status() == QDataStream::Ok); ++i) {
+                quint32 id = 0;
+                AutosaveEntry entry;
+                pds >> id >> entry;
+                batch.changed.append({ id, entry });
+            }
+            pds >> batch.removed >> batch.hasOrder >> batch.order;
+            if (pds.status() != QDataStream::Ok)
+                break;
+
+            meta = batch.meta;
+            for (const auto &[id, entry] : std::as_const(batch.changed))
+                entries.insert(id, entry);
+            for (const auto id : std::as_const(batch.removed))
+                entries.remove(id);
+            if (batch.hasOrder)
+                order = batch.order;
+        }
+    }
+};
+
+QByteArray journalBatchPayload(const AutosaveJournalBatch &batch)
+{
+    QByteArray payload;
+    QDataStream ds(&payload, QIODevice::WriteOnly);
+    ds << batch.meta << qint32(batch.changed.size());
+    for (const auto &[id, entry] : batch.changed)
+        ds << id << entry;
+    ds << batch.removed << batch.hasOrder << batch.order;
+    return payload;
+}
+
+QThreadPool *autosavePool()
+{
+    static QThreadPool *pool = []() {
+        auto *p = new QThreadPool(qApp);
+        p->setMaxThreadCount(1);
+        return p;
+    }();
+    return pool;
+}
+
+QString autosaveFilePath(const QUuid &uuid)
+{
+    QDir temp(QStandardPaths::writableLocation(QStandardPaths::TempLocation));
+    return temp.filePath(QString::fromLatin1(autosaveTemplate).arg(uuid.toString()));
+}
+
+} // namespace
 
 bool Document::isRestoredFromAutosave() const
 {
@@ -2424,92 +2672,258 @@ bool Document::isRestoredFromAutosave() const
 
 void Document::deleteAutosave()
 {
-    QDir temp(QStandardPaths::writableLocation(QStandardPaths::TempLocation));
-    QString filename = QString::fromLatin1(autosaveTemplate).arg(m_uuid.toString());
-    temp.remove(filename);
+    m_autosaveCheckpointNeeded = true;
+
+    // queued behind all pending writes, which would recreate the files otherwise
+    const QString fileName = autosaveFilePath(m_uuid);
+    autosavePool()->start([fileName]() {
+        QFile::remove(fileName);
+        QFile::remove(fileName + QLatin1String(autosaveJournalSuffix));
+    });
 }
 
 class AutosaveJob : public QRunnable
 {
 public:
-    explicit AutosaveJob(Document *document, const QByteArray &contents)
-        : QRunnable()
-        , m_document(document)
-        , m_uuid(document->m_uuid)
-        , m_contents(contents)
+    // writes a new checkpoint and removes the journal
+    AutosaveJob(Document *document, AutosaveState &&checkpoint)
+        : m_document(document)
+        , m_fileName(autosaveFilePath(document->m_uuid))
+        , m_checkpoint(std::move(checkpoint))
+        , m_isCheckpoint(true)
+    { }
+
+    // appends to the journal and compacts it, if it got too big
+    AutosaveJob(Document *document, const QByteArray &journalPayload)
+        : m_document(document)
+        , m_fileName(autosaveFilePath(document->m_uuid))
+        , m_journalPayload(journalPayload)
     { }
 
     void run() override;
+
 private:
+    bool writeCheckpoint(const AutosaveState &state);
+    bool appendToJournal();
+    bool compact();
+
     QPointer<Document> m_document;
-    const QUuid m_uuid;
-    const QByteArray m_contents;
+    const QString m_fileName;
+    AutosaveState m_checkpoint;
+    QByteArray m_journalPayload;
+    bool m_isCheckpoint = false;
 };
 
 void AutosaveJob::run()
 {
-    QDir temp(QStandardPaths::writableLocation(QStandardPaths::TempLocation));
-    QString fileName = QString::fromLatin1(autosaveTemplate).arg(m_uuid.toString());
-    QString newFileName = fileName + u".new";
-
-    { // reading is cheaper than writing, so check first
-        QFile f(temp.filePath(fileName));
-        if (f.open(QIODevice::ReadOnly)) {
-            if (f.readAll() == m_contents)
-                return;
-        }
+    bool ok = m_isCheckpoint ? writeCheckpoint(m_checkpoint) : appendToJournal();
+
+    if (!ok) {
+        // the journal is useless without all its batches: start over with a checkpoint
+        QPointer<Document> document = m_document;
+        QMetaObject::invokeMethod(qApp, [=]() {
+            if (document) {
+                document->m_autosaveCheckpointNeeded = true;
+                document->m_autosaveClean = false;
+            }
+        });
     }
+}
 
-    QSaveFile f(temp.filePath(fileName));
-    if (f.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
-        f.write(m_contents);
-        if (f.commit()) {
-            QPointer<Document> document = m_document;
-            QMetaObject::invokeMethod(qApp, [=]() {
-                if (document)
-                    document->m_autosaveClean = true;
-            });
-        } else {
-            qWarning() << "Autosave rename from" << newFileName << "to" << fileName << "failed";
-        }
+// Journals that failed to get a batch appended: replaying any batch after the missing one
+// would restore garbage, so nothing is appended anymore until the next checkpoint. This is only
+// ever accessed from the single autosave thread.
+static QSet<QString> &brokenAutosaveJournals()
+{
+    static QSet<QString> broken;
+    return broken;
+}
+
+bool AutosaveJob::writeCheckpoint(const AutosaveState &state)
+{
+    QSaveFile f(m_fileName);
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Truncate) || !state.writeCheckpoint(&f)
+            || !f.commit()) {
+        qWarning() << "Autosave: writing" << m_fileName << "failed";
+        return false;
     }
+    QFile::remove(m_fileName + QLatin1String(autosaveJournalSuffix));
+    brokenAutosaveJournals().remove(m_fileName);
+    return true;
 }
 
+bool AutosaveJob::appendToJournal()
+{
+    if (brokenAutosaveJournals().contains(m_fileName))
+        return false;
 
-void Document::autosave() const
+    QFile f(m_fileName + QLatin1String(autosaveJournalSuffix));
+    if (!f.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Autosave: opening" << f.fileName() << "failed";
+        brokenAutosaveJournals().insert(m_fileName);
+        return false;
+    }
+
+    QDataStream ds(&f);
+    ds << autosaveJournalMagic << m_journalPayload << qChecksum(m_journalPayload);
+    f.close();
+    if ((ds.status() != QDataStream::Ok) || (f.error() != QFileDevice::NoError)) {
+        qWarning() << "Autosave: appending to" << f.fileName() << "failed";
+        brokenAutosaveJournals().insert(m_fileName);
+        return false;
+    }
+
+    // replaying a journal that is half as big as the checkpoint is still cheap
+    const qint64 journalSize = f.size();
+    if (journalSize > std::max(qint64(1024 * 1024), QFileInfo(m_fileName).size() / 2))
+        return compact();
+    return true;
+}
+
+bool AutosaveJob::compact()
+{
+    AutosaveState state;
+    QFile checkpoint(m_fileName);
+    QFile journal(m_fileName + QLatin1String(autosaveJournalSuffix));
+    if (!checkpoint.open(QIODevice::ReadOnly) || !state.readCheckpoint(&checkpoint)
+            || !journal.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    state.replayJournal(&journal);
+    checkpoint.close();
+    journal.close();
+
+    return writeCheckpoint(state);
+}
+
+
+void Document::autosave()
 {
     if (m_uuid.isNull() || !model()->isModified() || model()->lots().isEmpty() || m_autosaveClean)
         return;
 
+    const AutosaveMetaData meta { title(), filePath(), m_model->currencyCode(),
+                                  saveColumnsState(), model()->saveSortFilterState() };
+    const uint changelogId = BrickLink::core()->latestChangelogId();
+
+    auto serialize = [this, changelogId](const Lot *lot) {
+        AutosaveEntry entry;
+        entry.changelogId = changelogId;
+        QDataStream lds(&entry.lot, QIODevice::WriteOnly);
+        lot->save(lds);
+        if (auto base = m_model->differenceBaseLot(lot)) {
+            QDataStream bds(&entry.base, QIODevice::WriteOnly);
+            base->save(bds);
+        }
+        return entry;
+    };
+    auto idFor = [this](const Lot *lot) {
+        auto it = m_autosaveIds.constFind(lot);
+        if (it == m_autosaveIds.cend())
+            it = m_autosaveIds.insert(lot, m_autosaveNextId++);
+        return *it;
+    };
+
     const auto lots = m_model->lots();
-    QByteArray ba;
-    QDataStream ds(&ba, QIODevice::WriteOnly);
-    ds << QByteArray(autosaveMagic)
-       << qint32(6) // version
-       << title()
-       << filePath()
-       << m_model->currencyCode()
-       << saveColumnsState()
-       << model()->saveSortFilterState()
-       << BrickLink::core()->latestChangelogId()
-       << qint32(lots.count());
-
-    for (auto lot : lots) {
-        lot->save(ds);
-        auto base = m_model->differenceBaseLot(lot);
-        ds << bool(base);
-        if (base)
-            base->save(ds);
-    }
-    ds << QByteArray(autosaveMagic);
-
-    QThreadPool::globalInstance()->start(new AutosaveJob(const_cast<Document *>(this), ba));
+    AutosaveJob *job;
+
+    if (m_autosaveCheckpointNeeded) {
+        m_autosaveIds.clear();
+        m_autosaveNextId = 0;
+
+        AutosaveState checkpoint;
+        checkpoint.meta = meta;
+        checkpoint.order.reserve(lots.size());
+        checkpoint.entries.reserve(lots.size());
+        for (const auto *lot : lots) {
+            const auto id = idFor(lot);
+            checkpoint.order.append(id);
+            checkpoint.entries.insert(id, serialize(lot));
+        }
+        job = new AutosaveJob(this, std::move(checkpoint));
+    } else {
+        AutosaveJournalBatch batch;
+        batch.meta = meta;
+        batch.changed.reserve(m_autosaveDirtyLots.size());
+        for (const auto *lot : std::as_const(m_autosaveDirtyLots))
+            batch.changed.append({ idFor(lot), serialize(lot) });
+        batch.removed = m_autosaveRemovedIds;
+        if (m_autosaveOrderChanged) {
+            batch.hasOrder = true;
+            batch.order.reserve(lots.size());
+            for (const auto *lot : lots)
+                batch.order.append(idFor(lot));
+        }
+        job = new AutosaveJob(this, journalBatchPayload(batch));
+    }
+
+    m_autosaveCheckpointNeeded = false;
+    m_autosaveDirtyLots.clear();
+    m_autosaveRemovedIds.clear();
+    m_autosaveOrderChanged = false;
+    m_autosaveClean = true;
+
+    autosavePool()->start(job);
+}
+
+void Document::autosaveLotsInserted(const LotList &lots)
+{
+    for (const auto *lot : lots)
+        m_autosaveDirtyLots.insert(lot);
+    m_autosaveOrderChanged = true;
+}
+
+void Document::autosaveLotsRemoved(const LotList &lots)
+{
+    for (const auto *lot : lots) {
+        m_autosaveDirtyLots.remove(lot);
+        // the Lot object might get deleted and its address reused for a new one
+        auto it = m_autosaveIds.find(lot);
+        if (it != m_autosaveIds.end()) {
+            m_autosaveRemovedIds.append(*it);
+            m_autosaveIds.erase(it);
+        }
+    }
+    m_autosaveOrderChanged = true;
+}
+
+void Document::autosaveLotsChanged(const LotList &lots)
+{
+    for (const auto *lot : lots)
+        m_autosaveDirtyLots.insert(lot);
+}
+
+// only checks the header: autosaves written by other versions can't be restored
+static bool isRestorableAutosave(const QString &fileName)
+{
+    QFile f(fileName);
+    if (!f.open(QIODevice::ReadOnly))
+        return false;
+
+    QDataStream ds(&f);
+    QByteArray magic;
+    qint32 version = 0;
+    ds >> magic >> version;
+    return (ds.status() == QDataStream::Ok) && (magic == QByteArray(autosaveMagic))
+            && (version == autosaveVersion);
 }
 
 int Document::restorableAutosaves()
 {
     QDir temp(QStandardPaths::writableLocation(QStandardPaths::TempLocation));
-    return int(temp.entryList({ QString::fromLatin1(autosaveTemplate).arg(u"*") }).count());
+    const auto ondisk = temp.entryList({ QString::fromLatin1(autosaveTemplate).arg(u"*") });
+    int count = 0;
+
+    for (const QString &filename : ondisk) {
+        if (isRestorableAutosave(temp.filePath(filename))) {
+            ++count;
+        } else {
+            // there is no point in asking the user about these
+            temp.remove(filename);
+            temp.remove(filename + QLatin1String(autosaveJournalSuffix));
+        }
+    }
+    return count;
 }
 
 int Document::processAutosaves(AutosaveAction action)
@@ -2521,76 +2935,78 @@ int Document::processAutosaves(AutosaveAction action)
 
     for (const QString &filename : ondisk) {
         QFile f(temp.filePath(filename));
-        if ((action == AutosaveAction::Restore) && f.open(QIODevice::ReadOnly)) {
-            QByteArray magic;
-            qint32 version;
-            QString savedTitle;
-            QString savedFileName;
-            QString savedCurrencyCode;
-            QByteArray columnState;
-            QByteArray savedSortFilterState;
-            qint32 count = 0;
-            uint startChangelogAt = 0;
-
-            QDataStream ds(&f);
-            ds >> magic >> version;
-            if ((magic != QByteArray(autosaveMagic)) || (version != 6))
-                continue;
-            ds >> savedTitle >> savedFileName >> savedCurrencyCode >> columnState
-                >> savedSortFilterState >> startChangelogAt >> count;
+        QFile journal(f.fileName() + QLatin1String(autosaveJournalSuffix));
+        AutosaveState state;
+
+        // unreadable checkpoints (old versions or damaged files) are deleted as well
+        if ((action == AutosaveAction::Restore) && f.open(QIODevice::ReadOnly)
+                && state.readCheckpoint(&f)) {
+            if (journal.open(QIODevice::ReadOnly))
+                state.replayJournal(&journal);
 
             BrickLink::IO::ParseResult pr;
-            pr.setCurrencyCode(savedCurrencyCode);
-
-            if (count > 0) {
-                for (int i = 0; i < count; ++i) {
-                    if (auto lot = Lot::restore(ds, startChangelogAt)) {
-                        bool hasBase = false;
-                        ds >> hasBase;
-                        if (hasBase) {
-                            if (auto base = Lot::restore(ds, startChangelogAt)) {
-                                pr.addToDifferenceModeBase(lot, *base);
-                                delete base;
-                            } else {
-                                hasBase = false;
-                            }
+            pr.setCurrencyCode(state.meta.currencyCode);
+
+            for (const auto id : std::as_const(state.order)) {
+                auto it = state.entries.constFind(id);
+                if (it == state.entries.cend())
+                    continue;
+
+                QDataStream lds(it->lot);
+                if (auto lot = Lot::restore(lds, it->changelogId)) {
+                    bool hasBase = false;
+                    if (!it->base.isEmpty()) {
+                        QDataStream bds(it->base);
+                        if (auto base = Lot::restore(bds, it->changelogId)) {
+                            pr.addToDifferenceModeBase(lot, *base);
+                            delete base;
+                            hasBase = true;
                         }
-                        if (!hasBase)
-                            pr.addToDifferenceModeBase(lot, *lot);
-                        pr.addLot(std::move(lot));
                     }
+                    if (!hasBase)
+                        pr.addToDifferenceModeBase(lot, *lot);
+                    pr.addLot(std::move(lot));
                 }
-                ds >> magic;
-
-                if (magic == QByteArray(autosaveMagic)) {
-                    QString restoredTag = tr("RESTORED", "Tag for document restored from autosave");
-
-                    // Document owns the items now
-                    DocumentIO::BsxContents bsx;
-                    auto model = new DocumentModel(std::move(pr), true /*mark as modified*/);
-                    model->restoreSortFilterState(savedSortFilterState);
-                    auto *doc = new Document(model, columnState, true /* is autosave restore*/);
-
-                    if (!savedFileName.isEmpty()) {
-                        QFileInfo fi(savedFileName);
-                        QString newFileName = fi.dir().filePath(restoredTag + u" " + fi.fileName());
-                        try {
-                            doc->saveToFile(newFileName);
-                        } catch (const Exception &) {
-                            // not really much we can do here
-                        }
-                    } else {
-                        doc->setTitle(restoredTag + u" " + savedTitle);
-                    }
-                    QMetaObject::invokeMethod(doc, &Document::requestActivation, Qt::QueuedConnection);
+            }
 
-                    ++restoredCount;
+            if (pr.hasLots()) {
+                QString restoredTag = tr("RESTORED", "Tag for document restored from autosave");
+
+                // Document owns the items now
+                auto model = new DocumentModel(std::move(pr), true /*mark as modified*/);
+                model->restoreSortFilterState(state.meta.sortFilterState);
+                auto *doc = new Document(model, state.meta.columnsState, true /* is autosave restore*/);
+
+                if (!state.meta.filePath.isEmpty()) {
+                    QFileInfo fi(state.meta.filePath);
+                    QString newFileName = fi.dir().filePath(restoredTag + u" " + fi.fileName());
+                    try {
+                        doc->saveToFile(newFileName);
+                    } catch (const Exception &) {
+                        // not really much we can do here
+                    }
+                } else {
+                    doc->setTitle(restoredTag + u" " + state.meta.title);
                 }
+                QMetaObject::invokeMethod(doc, &Document::requestActivation, Qt::QueuedConnection);
+
+                ++restoredCount;
             }
-            f.close();
         }
+        f.close();
         f.remove();
+        journal.close();
+        journal.remove();
     }
+
+    // journals without a checkpoint are useless
+    const QLatin1String journalSuffix(autosaveJournalSuffix);
+    const auto journals = temp.entryList({ QString::fromLatin1(autosaveTemplate).arg(u"*") + journalSuffix });
+    for (const QString &filename : journals) {
+        if (!temp.exists(filename.chopped(journalSuffix.size())))
+            temp.remove(filename);
+    }
+
     return restoredCount;
 }
 
@@ -11,6 +11,7 @@
 #include <QMultiHash>
 #include <QModelIndex>
 #include <QPointer>
+#include <QSet>
 
 #include <QCoro/QCoroTask>
 
@@ -120,6 +121,7 @@ public:
     QModelIndex currentIndex() const;
 
     const LotList &selectedLots() const  { return m_selectedLots; }
+    DocumentStatistics selectionStatistics(bool ignoreExcluded) const;
 
     bool isBlockingOperationActive() const;
     void startBlockingOperation(const QString &title, const std::function<void ()> &cancelCallback = { });
@@ -268,7 +270,7 @@ private:
     void applyTo(const LotList &lots,
                  const char *actionName, const std::function<DocumentModel::ApplyToResult (const Lot &, Lot &)> &callback);
     bool updatePriceToGuide(BrickLink::Lot *lot, const BrickLink::PriceGuide *pg);
-    void priceGuideUpdated(BrickLink::PriceGuide *pg);
+    void priceGuidesPrefetched(int prefetchId);
     void cancelPriceGuideUpdates();
     enum ExportCheckMode {
         ExportToFile = 0,
@@ -287,13 +289,18 @@ private:
     void hideColumnDirect(int logical, bool newHidden);
     void setColumnLayoutDirect(QVector<ColumnData> &columnData);
 
-    void autosave() const;
+    void autosave();
+    void autosaveLotsInserted(const LotList &lots);
+    void autosaveLotsRemoved(const LotList &lots);
+    void autosaveLotsChanged(const LotList &lots);
     void deleteAutosave();
 
 private:
     DocumentModel *      m_model;
     QItemSelectionModel *m_selectionModel;
     LotList              m_selectedLots;
+    mutable DocumentStatistics::Totals m_selectionTotals;
+    mutable quint64      m_selectionTotalsGeneration = 0;
 
     bool                 m_hasBeenActive = false;
     QObject *            m_actionConnectionContext = nullptr;
@@ -303,14 +310,14 @@ private:
     struct SetToPriceGuideData
     {
         std::vector<std::pair<Lot *, Lot>> changes;
-        QMultiHash<BrickLink::PriceGuide *, Lot *>    priceGuides;
+        LotList          lots;
+        QVector<BrickLink::PriceGuide *> priceGuides; // ref'ed, one per lot
+        int              prefetchId = -1;
         int              failCount = 0;
-        int              doneCount = 0;
-        int              totalCount = 0;
         BrickLink::Time  time;
         BrickLink::Price price;
         double           currencyRate;
-        bool             canceled = false;
+        QSet<const BrickLink::PriceGuide *> canceled; // still loading when canceled
         BrickLink::NoPriceGuideOption noPgOption;
     };
     std::unique_ptr<SetToPriceGuideData> m_setToPG;
@@ -330,8 +337,15 @@ private:
 
     QUuid                 m_uuid;  // for autosave
     QTimer                m_autosaveTimer;
-    mutable bool          m_autosaveClean = true;
+    bool                  m_autosaveClean = true;
     bool                  m_restoredFromAutosave = false;
+    bool                  m_autosaveCheckpointNeeded = true;
+    // what changed since the last autosave: ids are local to the autosave journal
+    QHash<const Lot *, quint32> m_autosaveIds;
+    quint32               m_autosaveNextId = 0;
+    QSet<const Lot *>     m_autosaveDirtyLots;
+    QVector<quint32>      m_autosaveRemovedIds;
+    bool                  m_autosaveOrderChanged = false;
 
     friend class AutosaveJob;
     friend void ColumnCmd::redo();
@@ -1,8 +1,11 @@
 // Copyright (C) 2004-2023 Robert Griebl
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <atomic>
 #include <memory>
+#include <optional>
 #include <cmath>
+#include <vector>
 
 #include <QtGui/QGuiApplication>
 #include <QtGui/QCursor>
@@ -13,6 +16,9 @@
 #include <QXmlStreamReader>
 #include <QXmlStreamWriter>
 #include <QDebug>
+#include <QScopeGuard>
+#include <QThreadPool>
+#include <QtConcurrentRun>
 
 #include "utility/exception.h"
 #include "utility/utility.h"
@@ -25,9 +31,11 @@
 #include "bricklink/store.h"
 #include "bricklink/wantedlist.h"
 
+#include "common/bsxcache.h"
 #include "common/document.h"
 #include "common/documentmodel.h"
 #include "common/documentio.h"
+#include "common/documentlist.h"
 #include "common/uihelpers.h"
 
 
@@ -138,18 +146,36 @@ QCoro::Task<Document *> DocumentIO::importBrickLinkXML(QString fileName)
     if (fn.isEmpty())
         co_return nullptr;
 
+    // the database must not be updated while we are resolving items and colors
+    co_await DocumentList::inst()->beginLoad();
+    auto endLoad = qScopeGuard([]() { DocumentList::inst()->endLoad(); });
+
     QFile f(fn);
     if (f.open(QIODevice::ReadOnly)) {
-        try {
-            auto result = BrickLink::IO::fromBrickLinkXML(f.readAll(),
-                                                          BrickLink::IO::Hint::PlainOrWanted,
-                                                          f.fileTime(QFile::FileModificationTime));
-            auto *document = new Document(new DocumentModel(std::move(result))); // Document owns the items now
+        const QByteArray data = f.readAll();
+        const QDateTime creationTime = f.fileTime(QFile::FileModificationTime);
+        std::optional<BrickLink::IO::ParseResult> result;
+        QString error;
+
+        bool finished = co_await UIHelpers::runWithProgressDialog(
+                    tr("Import File"), tr("Importing %1").arg(CMB_BOLD(QFileInfo(fn).fileName())),
+                    [&data, &creationTime, &result, &error](const auto &progress) {
+            try {
+                result.emplace(BrickLink::IO::fromBrickLinkXML(data, BrickLink::IO::Hint::PlainOrWanted,
+                                                               creationTime, progress));
+            } catch (const Exception &e) {
+                error = e.errorString();
+            }
+        });
+
+        if (!finished) {
+            co_return nullptr;
+        } else if (result) {
+            auto *document = new Document(new DocumentModel(std::move(*result))); // Document owns the items now
             document->setTitle(tr("Import of %1").arg(QFileInfo(fn).fileName()));
             co_return document;
-
-        } catch (const Exception &e) {
-            UIHelpers::warning(tr("Could not parse the XML data.") + u"<br><br>" + e.errorString());
+        } else {
+            UIHelpers::warning(tr("Could not parse the XML data.") + u"<br><br>" + error);
         }
     } else {
         co_await UIHelpers::warning(tr("Could not open file %1 for reading.").arg(CMB_BOLD(fn)));
@@ -421,14 +447,43 @@ bool DocumentIO::parseLDrawModelInternal(QFile *f, bool isStudio, const QString
 
 
 
-Document *DocumentIO::parseBsxInventory(QFile *in)
+// QDateTime::fromString() is slow, so the format written by createBsxInventory() gets a
+// hand-crafted parser: "yyyy-MM-ddTHH:mm:ss", optionally followed by 'Z' for UTC.
+static QDateTime parseISODateTimeString(const QString &v)
 {
-    //stopwatch loadBsxWatch("Load BSX");
+    if (v.isEmpty())
+        return { };
+
+    auto number = [&v](qsizetype from, qsizetype length) {
+        int n = 0;
+        for (qsizetype i = from; i < (from + length); ++i) {
+            const char16_t c = v.at(i).unicode();
+            if ((c < u'0') || (c > u'9'))
+                return -1;
+            n = n * 10 + (c - u'0');
+        }
+        return n;
+    };
 
-    Q_ASSERT(in);
-    QXmlStreamReader xml(in);
-    BsxContents bsx;
-    QDateTime creationTime = in->fileTime(QFile::FileModificationTime);
+    const auto size = v.size();
+    if (((size == 19) || ((size == 20) && (v.at(19) == u'Z')))
+            && (v.at(4) == u'-') && (v.at(7) == u'-') && (v.at(10) == u'T')
+            && (v.at(13) == u':') && (v.at(16) == u':')) {
+        const int year = number(0, 4); // QDate would accept -1 as a valid year
+        const QDate date(year, number(5, 2), number(8, 2));
+        const QTime time(number(11, 2), number(14, 2), number(17, 2));
+        if ((year > 0) && date.isValid() && time.isValid())
+            return QDateTime(date, time, (size == 20) ? Qt::UTC : Qt::LocalTime);
+    }
+    return QDateTime::fromString(v, Qt::ISODate);
+}
+
+// Parses a complete BrickStoreXML document into bsx. The GUI state is only parsed, if
+// withGuiState is set.
+static void parseBsxDocument(QXmlStreamReader &xml, const QDateTime &creationTime,
+                             BrickLink::ResolveCache &resolveCache, DocumentIO::BsxContents &bsx,
+                             bool withGuiState)
+{
     uint startAtChangelogId = 0;
 
     try {
@@ -513,10 +568,10 @@ Document *DocumentIO::parseBsxInventory(QFile *in)
             { u"MarkerColor",  [](auto *lot, auto &v) { lot->setMarkerColor(QColor(v)); } },
             { u"DateAdded",    [](auto *lot, auto &v) {
                 if (!v.isEmpty())
-                    lot->setDateAdded(QDateTime::fromString(v, Qt::ISODate)); } },
+                    lot->setDateAdded(parseISODateTimeString(v)); } },
             { u"DateLastSold", [](auto *lot, auto &v) {
                 if (!v.isEmpty())
-                    lot->setDateLastSold(QDateTime::fromString(v, Qt::ISODate)); } },
+                    lot->setDateLastSold(parseISODateTimeString(v)); } },
             { u"OrigPrice",    [&legacyOrigPrice](auto *lot, auto &v) {
                 Q_UNUSED(lot)
                 legacyOrigPrice.setValue(Utility::fixFinite(v.toDouble()));
@@ -550,7 +605,8 @@ Document *DocumentIO::parseBsxInventory(QFile *in)
                     }
                 }
 
-                switch (BrickLink::core()->resolveIncomplete(lot, startAtChangelogId, creationTime)) {
+                switch (BrickLink::core()->resolveIncomplete(lot, startAtChangelogId, creationTime,
+                                                             &resolveCache)) {
                 case BrickLink::Core::ResolveResult::Fail: bsx.incInvalidLotCount(); break;
                 case BrickLink::Core::ResolveResult::ChangeLog: bsx.incFixedLotCount(); break;
                 default: break;
@@ -574,7 +630,8 @@ Document *DocumentIO::parseBsxInventory(QFile *in)
                             (*it)(&base, attr.value().toString());
                         }
                     }
-                    if (BrickLink::core()->resolveIncomplete(&base, startAtChangelogId, creationTime)
+                    if (BrickLink::core()->resolveIncomplete(&base, startAtChangelogId, creationTime,
+                                                             &resolveCache)
                         == BrickLink::Core::ResolveResult::Fail) {
                         if (!base.item() && lot->item())
                             base.setItem(lot->item());
@@ -620,7 +677,7 @@ Document *DocumentIO::parseBsxInventory(QFile *in)
                         bsx.setCurrencyCode(xml.attributes().value(u"Currency"_qs).toString());
                         startAtChangelogId = xml.attributes().value(u"BrickLinkChangelogId"_qs).toUInt();
                         parseInventory();
-                    } else if ((xml.name() == u"GuiState")
+                    } else if (withGuiState && (xml.name() == u"GuiState")
                                 && (xml.attributes().value(u"Application"_qs) == u"BrickStore")
                                 && (xml.attributes().value(u"Version"_qs).toInt() == 2)) {
                         parseGuiState();
@@ -633,15 +690,11 @@ Document *DocumentIO::parseBsxInventory(QFile *in)
             case QXmlStreamReader::Invalid:
                 throw Exception(xml.errorString());
 
-            case QXmlStreamReader::EndDocument: {
+            case QXmlStreamReader::EndDocument:
                 if (!foundRoot || !foundInventory)
                     throw Exception("Not a valid BrickStoreXML file");
+                return;
 
-                auto model = std::make_unique<DocumentModel>(std::move(bsx), (bsx.fixedLotCount() != 0) /*forceModified*/);
-                if (!bsx.guiSortFilterState.isEmpty())
-                    model->restoreSortFilterState(bsx.guiSortFilterState);
-                return new Document(model.release(), bsx.guiColumnLayout);
-            }
             default:
                 break;
             }
@@ -652,6 +705,177 @@ Document *DocumentIO::parseBsxInventory(QFile *in)
     }
 }
 
+// Splits the Inventory element at the <Item> tags into chunks of a few thousand lots and
+// parses these chunks in parallel on the global thread pool. Every chunk is wrapped in the
+// header and trailer of the original document, so it is a complete BrickStoreXML document.
+// Returns false if the data is too small or can't be split, or if any chunk fails to parse:
+// the sequential parser has to take over in this case, so it can report a proper error.
+static bool parseBsxDocumentChunked(const QByteArray &data, const QDateTime &creationTime,
+                                    BrickLink::ResolveCache &resolveCache,
+                                    const std::function<bool(int, int)> &progress,
+                                    DocumentIO::BsxContents &bsx)
+{
+    static constexpr qsizetype MinLotsPerChunk = 1000;
+
+    const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+    if (threadCount < 2)
+        return false;
+
+    // the legacy OrigPrice and OrigQty tags carry state from one lot to the next
+    if (data.contains("<OrigPrice>") || data.contains("<OrigQty>"))
+        return false;
+
+    const qsizetype inventoryStart = data.indexOf("<Inventory");
+    const qsizetype inventoryEnd = data.lastIndexOf("</Inventory>");
+    if ((inventoryStart < 0) || (inventoryEnd < inventoryStart)
+            || (data.indexOf("<Inventory", inventoryStart + 1) >= 0)) {
+        return false;
+    }
+
+    QVector<qsizetype> itemStarts;
+    for (auto pos = data.indexOf("<Item>", inventoryStart); (pos >= 0) && (pos < inventoryEnd);
+         pos = data.indexOf("<Item>", pos + 6)) {
+        itemStarts.append(pos);
+    }
+    const qsizetype lotCount = itemStarts.size();
+    if (lotCount < 2 * MinLotsPerChunk)
+        return false;
+
+    const QByteArray header = data.left(itemStarts.constFirst());
+    const QByteArray trailer = data.mid(inventoryEnd);
+
+    struct Chunk
+    {
+        qsizetype from = 0;
+        qsizetype to = 0;
+        int lotCount = 0;
+        DocumentIO::BsxContents bsx;
+    };
+
+    const qsizetype lotsPerChunk = std::max(MinLotsPerChunk, lotCount / (threadCount * 4) + 1);
+    std::vector<Chunk> chunks(size_t((lotCount + lotsPerChunk - 1) / lotsPerChunk));
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        const qsizetype first = qsizetype(i) * lotsPerChunk;
+        const qsizetype last = std::min(first + lotsPerChunk, lotCount);
+        chunks[i].from = itemStarts.at(first);
+        chunks[i].to = (last == lotCount) ? inventoryEnd : itemStarts.at(last);
+        chunks[i].lotCount = int(last - first);
+    }
+
+    std::atomic<bool> stop = false;
+    std::atomic<bool> failed = false;
+    bool canceled = false;
+    QVector<QFuture<void>> futures;
+
+    // the tasks reference local variables: never leave this scope while they are running
+    auto waitForTasks = qScopeGuard([&futures]() {
+        for (auto &future : futures)
+            future.waitForFinished();
+    });
+
+    for (auto &chunk : chunks) {
+        const bool withGuiState = (&chunk == &chunks.front());
+
+        futures << QtConcurrent::run(QThreadPool::globalInstance(),
+                                     [&data, &header, &trailer, &creationTime, &resolveCache,
+                                      &stop, &failed, withGuiState, c = &chunk]() {
+            if (stop)
+                return;
+
+            QByteArray chunkData;
+            chunkData.reserve(header.size() + (c->to - c->from) + trailer.size());
+            chunkData.append(header).append(data.constData() + c->from, c->to - c->from).append(trailer);
+
+            QXmlStreamReader xml(chunkData);
+            try {
+                parseBsxDocument(xml, creationTime, resolveCache, c->bsx, withGuiState);
+            } catch (const Exception &) {
+                failed = true;
+                stop = true;
+            }
+        });
+    }
+
+    // the chunks are roughly the same size, so reporting the progress in order is good enough
+    int lotsDone = 0;
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        futures[qsizetype(i)].waitForFinished();
+        lotsDone += chunks[i].lotCount;
+        if (progress && !stop && !progress(lotsDone, int(lotCount))) {
+            canceled = true;
+            stop = true;
+        }
+    }
+
+    if (canceled)
+        throw Exception("Loading the document was canceled");
+    if (failed)
+        return false;
+
+    const auto &first = chunks.front().bsx;
+    bsx.setCurrencyCode(first.currencyCode());
+    bsx.guiColumnLayout = first.guiColumnLayout;
+    bsx.guiSortFilterState = first.guiSortFilterState;
+
+    for (auto &chunk : chunks) {
+        const auto &differenceModeBase = chunk.bsx.differenceModeBase();
+        for (auto it = differenceModeBase.cbegin(); it != differenceModeBase.cend(); ++it)
+            bsx.addToDifferenceModeBase(it.key(), it.value());
+
+        const LotList lots = chunk.bsx.takeLots();
+        for (auto *lot : lots)
+            bsx.addLot(std::move(lot));
+        bsx.incInvalidLotCount(chunk.bsx.invalidLotCount());
+        bsx.incFixedLotCount(chunk.bsx.fixedLotCount());
+    }
+    return true;
+}
+
+void DocumentIO::parseBsxContents(QFile *in, BsxContents &bsx,
+                                  const std::function<bool(int, int)> &progress)
+{
+    //stopwatch loadBsxWatch("Load BSX");
+
+    Q_ASSERT(in);
+    if (BsxCache::load(in->fileName(), bsx))
+        return;
+
+    const QByteArray data = in->readAll();
+    const QDateTime creationTime = in->fileTime(QFile::FileModificationTime);
+
+    // shared by all the parser threads, and also by the sequential fallback
+    BrickLink::ResolveCache resolveCache;
+
+    if (!parseBsxDocumentChunked(data, creationTime, resolveCache, progress, bsx)) {
+        // the sequential parser has no progress reporting, so the best we can do is "busy"
+        if (progress && !progress(0, 0))
+            throw Exception("Loading the document was canceled");
+        QXmlStreamReader xml(data);
+        parseBsxDocument(xml, creationTime, resolveCache, bsx, true);
+    }
+
+    // documents that needed fixing will be marked as modified and saved anyway
+    if (!bsx.invalidLotCount() && !bsx.fixedLotCount()) {
+        BsxCache::save(in->fileName(), bsx.currencyCode(), bsx.lots(), bsx.differenceModeBase(),
+                       bsx.guiColumnLayout, bsx.guiSortFilterState);
+    }
+}
+
+Document *DocumentIO::createBsxDocument(BsxContents &bsx)
+{
+    auto model = std::make_unique<DocumentModel>(std::move(bsx), (bsx.fixedLotCount() != 0) /*forceModified*/);
+    if (!bsx.guiSortFilterState.isEmpty())
+        model->restoreSortFilterState(bsx.guiSortFilterState);
+    return new Document(model.release(), bsx.guiColumnLayout);
+}
+
+Document *DocumentIO::parseBsxInventory(QFile *in)
+{
+    BsxContents bsx;
+    parseBsxContents(in, bsx);
+    return createBsxDocument(bsx);
+}
+
 
 bool DocumentIO::createBsxInventory(QIODevice *out, const Document *doc)
 {
@@ -834,3 +1058,10 @@ bool DocumentIO::createBsxInventory(QIODevice *out, const Document *doc)
     xml.writeEndDocument();
     return !xml.hasError();
 }
+
+void DocumentIO::createBsxCache(const QString &fileName, const Document *doc)
+{
+    BsxCache::save(fileName, doc->model()->currencyCode(), doc->model()->lots(),
+                   doc->model()->differenceBase(), doc->saveColumnsState(),
+                   doc->model()->saveSortFilterState());
+}
@@ -52,7 +52,14 @@ public:
                                                   const LotList &lots);
 
     static Document *parseBsxInventory(QFile *in);
+    // parseBsxInventory() split in two: the first step doesn't touch any QObjects and can
+    // run on a worker thread. progress works like in BrickLink::IO::fromBrickLinkXML().
+    static void parseBsxContents(QFile *in, BsxContents &bsx,
+                                 const std::function<bool(int done, int total)> &progress = { });
+    static Document *createBsxDocument(BsxContents &bsx);
     static bool createBsxInventory(QIODevice *out, const Document *doc);
+    // writes the binary companion file (see BsxCache) for a freshly saved BSX file
+    static void createBsxCache(const QString &fileName, const Document *doc);
 
 private:
     static bool parseLDrawModel(QFile *f, bool isStudio, BrickLink::IO::ParseResult &pr);
@@ -5,6 +5,10 @@
 #include <QIcon>
 #include <QPainter>
 
+#include <QCoro/QCoroSignal>
+
+#include "bricklink/core.h"
+#include "bricklink/database.h"
 #include "documentlist.h"
 
 
@@ -38,6 +42,26 @@ const QVector<Document *> &DocumentList::documents() const
     return m_documents;
 }
 
+QCoro::Task<> DocumentList::beginLoad()
+{
+    auto *db = BrickLink::core()->database();
+    while (db->updateStatus() == BrickLink::UpdateStatus::Updating)
+        co_await qCoro(db, &BrickLink::Database::updateStatusChanged);
+    ++m_pendingLoads;
+}
+
+void DocumentList::endLoad()
+{
+    Q_ASSERT(m_pendingLoads > 0);
+    if (--m_pendingLoads == 0)
+        emit pendingLoadsFinished();
+}
+
+int DocumentList::pendingLoadCount() const
+{
+    return m_pendingLoads;
+}
+
 Document *DocumentList::documentForFile(const QString &fileName) const
 {
     QString afp = QFileInfo(fileName).absoluteFilePath();
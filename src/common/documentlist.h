@@ -5,6 +5,8 @@
 
 #include <QAbstractListModel>
 
+#include <QCoro/QCoroTask>
+
 #include "common/document.h"
 
 
@@ -22,6 +24,12 @@ public:
     Document *documentForFile(const QString &fileName) const;
     Document *documentForModel(DocumentModel *model) const;
 
+    // Documents that are still being parsed on a worker thread reference the database as well,
+    // but they are not in the list yet. beginLoad() waits for a running database update.
+    QCoro::Task<> beginLoad();
+    void endLoad();
+    int pendingLoadCount() const;
+
     int rowCount(const QModelIndex &parent = QModelIndex()) const override;
     QVariant data(const QModelIndex &index, int role) const override;
 
@@ -31,6 +39,7 @@ signals:
     void documentAdded(Document *document);
     void documentRemoved(Document *document);
     void documentCreated(Document *document);
+    void pendingLoadsFinished();
 
 private:
     DocumentList() = default;
@@ -38,6 +47,7 @@ private:
     void remove(Document *document);
 
     QVector<Document *> m_documents;
+    int m_pendingLoads = 0;
     static DocumentList *s_inst;
 
     friend Document::Document(DocumentModel *, const QByteArray &, QObject *);
@@ -3,13 +3,18 @@
 
 #include <utility>
 #include <algorithm>
+#include <array>
+#include <numeric>
 
 #include <QCoreApplication>
 #include <QCursor>
 #include <QFileInfo>
 #include <QDir>
+#include <QDataStream>
+#include <QSet>
 #include <QTimer>
 #include <QtConcurrentFilter>
+#include <QtConcurrentMap>
 #include <QtAlgorithms>
 #include <QStringListModel>
 
@@ -33,6 +38,8 @@
 
 using namespace std::chrono_literals;
 
+//#define DOCUMENTMODEL_TESTING // benchmarking
+
 
 template <auto G, auto S>
 struct FieldOp
@@ -222,14 +229,17 @@ QString AddRemoveCmd::genDesc(bool is_add, int count)
 QTimer *ChangeCmd::s_eventLoopCounter = nullptr;
 
 ChangeCmd::ChangeCmd(DocumentModel *model, const std::vector<std::pair<Lot *, Lot>> &changes, DocumentModel::Field hint)
-    : QUndoCommand()
+    : CompactableUndoCommand()
     , m_model(model)
     , m_hint(hint)
-    , m_changes(changes)
 {
-    std::sort(m_changes.begin(), m_changes.end(), [](const auto &a, const auto &b) {
-        return a.first < b.first;
-    });
+    // only record the fields that actually change
+    m_lots.reserve(qsizetype(changes.size()));
+    QDataStream ds(&m_deltas, QIODevice::WriteOnly);
+    for (const auto &[lot, newLot] : changes) {
+        m_lots.append(lot);
+        lot->writeDelta(ds, newLot);
+    }
 
     if (!s_eventLoopCounter) {
         s_eventLoopCounter = new QTimer(QCoreApplication::instance());
@@ -252,7 +262,7 @@ void ChangeCmd::updateText()
 {
     //: Generic undo/redo text for table edits: %1 == column name (e.g. "Price")
     setText(QCoreApplication::translate("ChangeCmd", "Modified %1 on %Ln item(s)", nullptr,
-                                        int(m_changes.size()))
+                                        int(m_lots.size()))
             //: Generic undo/redo text for table edits: if more than one column was edited at once
             .arg((m_hint < DocumentModel::FieldCount) ? m_model->headerData(m_hint, Qt::Horizontal).toString()
                                                  : QCoreApplication::translate("ChangeCmd", "multiple fields")));
@@ -268,14 +278,51 @@ bool ChangeCmd::mergeWith(const QUndoCommand *other)
     if (other->id() == id()) {
         auto *otherChange = static_cast<const ChangeCmd *>(other);
         if ((m_loopCount == otherChange->m_loopCount) && (m_hint == otherChange->m_hint)) {
-            std::copy_if(otherChange->m_changes.cbegin(), otherChange->m_changes.cend(),
-                         std::back_inserter(m_changes), [this](const auto &change) {
-                return !std::binary_search(m_changes.begin(), m_changes.end(),
-                                           std::make_pair(change.first, Lot { }),
-                                           [](const auto &a, const auto &b) {
-                    return a.first < b.first;
-                });
+            uncompact();
+            const QByteArray otherDeltas = otherChange->m_compressed
+                    ? qUncompress(otherChange->m_deltas) : otherChange->m_deltas;
+
+            // the other command's records, split up per lot
+            QHash<Lot *, QByteArray> otherRecords;
+            otherRecords.reserve(otherChange->m_lots.size());
+            QDataStream otherIn(otherDeltas);
+            for (Lot *lot : otherChange->m_lots) {
+                QByteArray record;
+                QDataStream recordOut(&record, QIODevice::WriteOnly);
+                Lot::skipDelta(otherIn, &recordOut);
+                otherRecords.insert(lot, record);
+            }
+
+            // Lots changed by both commands need a combined record: our values are older, so
+            // they win, but the fields only the other command changed have to be added.
+            const bool overlaps = std::any_of(m_lots.cbegin(), m_lots.cend(), [&otherRecords](Lot *lot) {
+                return otherRecords.contains(lot);
             });
+            if (overlaps) {
+                QByteArray merged;
+                QDataStream in(m_deltas);
+                QDataStream out(&merged, QIODevice::WriteOnly);
+                for (Lot *lot : std::as_const(m_lots)) {
+                    auto it = otherRecords.find(lot);
+                    if (it != otherRecords.end()) {
+                        QDataStream otherRecordIn(*it);
+                        Lot::mergeDelta(in, otherRecordIn, out);
+                        otherRecords.erase(it);
+                    } else {
+                        Lot::skipDelta(in, &out);
+                    }
+                }
+                m_deltas = merged;
+            }
+
+            QDataStream out(&m_deltas, QIODevice::Append);
+            for (Lot *lot : otherChange->m_lots) {
+                auto it = otherRecords.constFind(lot);
+                if (it != otherRecords.cend()) {
+                    m_lots.append(lot);
+                    out.writeRawData(it->constData(), int(it->size()));
+                }
+            }
             updateText();
             return true;
         }
@@ -285,7 +332,33 @@ bool ChangeCmd::mergeWith(const QUndoCommand *other)
 
 void ChangeCmd::redo()
 {
-    m_model->changeLotsDirect(m_changes);
+    uncompact();
+    m_model->changeLotsDirect(m_lots, m_deltas);
+}
+
+qsizetype ChangeCmd::memoryUsage() const
+{
+    return qsizetype(sizeof(*this)) + m_lots.capacity() * qsizetype(sizeof(Lot *))
+            + m_deltas.capacity();
+}
+
+qsizetype ChangeCmd::compact()
+{
+    // the records compress very well, because most of them only differ in their values
+    if (m_compressed || (m_deltas.size() < 1024))
+        return 0;
+    const qsizetype before = m_deltas.capacity();
+    m_deltas = qCompress(m_deltas);
+    m_compressed = true;
+    return before - m_deltas.capacity();
+}
+
+void ChangeCmd::uncompact()
+{
+    if (m_compressed) {
+        m_deltas = qUncompress(m_deltas);
+        m_compressed = false;
+    }
 }
 
 void ChangeCmd::undo()
@@ -445,55 +518,91 @@ void FilterCmd::undo()
 ///////////////////////////////////////////////////////////////////////
 
 
-DocumentStatistics::DocumentStatistics(const DocumentModel *model, const LotList &list,
-                                       bool ignoreExcluded, bool ignorePriceAndQuantityErrors)
+void DocumentStatistics::Totals::Sums::update(const Lot *lot, QPair<quint64, quint64> flags,
+                                              int sign)
 {
-    m_lots = 0;
-    m_items = 0;
-    m_val = m_minval = m_cost = 0.;
-    m_weight = .0;
-    m_errors = 0;
-    m_differences = 0;
-    m_incomplete = 0;
-    bool weight_missing = false;
+    lots += sign;
 
-    for (const Lot *lot : list) {
-        if (ignoreExcluded && (lot->status() == BrickLink::Status::Exclude))
-            continue;
+    int qty = lot->quantity();
+    double price = lot->price();
 
-        ++m_lots;
+    value += sign * (qty * price);
+    cost += sign * (qty * lot->cost());
 
-        int qty = lot->quantity();
-        double price = lot->price();
+    for (int i = 0; i < 3; i++) {
+        if (lot->tierQuantity(i) && !qFuzzyIsNull(lot->tierPrice(i)))
+            price = lot->tierPrice(i);
+    }
+    minValue += sign * (qty * price * (1.0 - double(lot->sale()) / 100.0));
+    items += sign * qty;
 
-        m_val += (qty * price);
-        m_cost += (qty * lot->cost());
+    if (lot->totalWeight() > 0)
+        weight += sign * lot->totalWeight();
+    else
+        weightMissing += sign;
 
-        for (int i = 0; i < 3; i++) {
-            if (lot->tierQuantity(i) && !qFuzzyIsNull(lot->tierPrice(i)))
-                price = lot->tierPrice(i);
-        }
-        m_minval += (qty * price * (1.0 - double(lot->sale()) / 100.0));
-        m_items += qty;
+    for (quint64 e = flags.first; e; e &= (e - 1))
+        errors[qCountTrailingZeroBits(e)] += sign;
+    for (quint64 d = flags.second; d; d &= (d - 1))
+        differences[qCountTrailingZeroBits(d)] += sign;
 
-        if (lot->totalWeight() > 0)
-            m_weight += lot->totalWeight();
-        else
-            weight_missing = true;
+    if (lot->isIncomplete())
+        incomplete += sign;
 
-        auto flags = model->lotFlags(lot);
-        if (flags.first) {
-            if (ignorePriceAndQuantityErrors)
-                flags.first &= ((1ULL << DocumentModel::PartNo) | (1ULL << DocumentModel::Color));
-            m_errors += qPopulationCount(flags.first);
-        }
-        if (flags.second)
-            m_differences += qPopulationCount(flags.second);
+    // don't let rounding errors accumulate
+    if (!lots)
+        value = minValue = cost = weight = 0;
+}
 
-        if (lot->isIncomplete())
-            m_incomplete++;
+void DocumentStatistics::Totals::update(const DocumentModel *model, const Lot *lot, int sign)
+{
+    Sums &sums = (lot->status() == BrickLink::Status::Exclude) ? m_excluded : m_included;
+    sums.update(lot, model->m_lotFlags.value(lot, { }), sign);
+}
+
+DocumentStatistics::DocumentStatistics(const DocumentModel *model, const Totals &totals,
+                                       bool ignoreExcluded, bool ignorePriceAndQuantityErrors)
+{
+    const auto &in = totals.m_included;
+    const auto &ex = totals.m_excluded;
+
+    m_lots = in.lots;
+    m_items = in.items;
+    m_val = in.value;
+    m_minval = in.minValue;
+    m_cost = in.cost;
+    m_weight = in.weight;
+    m_incomplete = in.incomplete;
+    int weightMissing = in.weightMissing;
+
+    if (!ignoreExcluded) {
+        m_lots += ex.lots;
+        m_items += ex.items;
+        m_val += ex.value;
+        m_minval += ex.minValue;
+        m_cost += ex.cost;
+        m_weight += ex.weight;
+        m_incomplete += ex.incomplete;
+        weightMissing += ex.weightMissing;
     }
-    if (weight_missing)
+
+    quint64 errorMask = model->m_lotFlagsMask.first;
+    if (ignorePriceAndQuantityErrors)
+        errorMask &= ((1ULL << DocumentModel::PartNo) | (1ULL << DocumentModel::Color));
+    quint64 differenceMask = model->m_lotFlagsMask.second;
+
+    m_errors = 0;
+    for (quint64 e = errorMask; e; e &= (e - 1)) {
+        const auto bit = qCountTrailingZeroBits(e);
+        m_errors += in.errors[bit] + (ignoreExcluded ? 0 : ex.errors[bit]);
+    }
+    m_differences = 0;
+    for (quint64 d = differenceMask; d; d &= (d - 1)) {
+        const auto bit = qCountTrailingZeroBits(d);
+        m_differences += in.differences[bit] + (ignoreExcluded ? 0 : ex.differences[bit]);
+    }
+
+    if (weightMissing)
         m_weight = qFuzzyIsNull(m_weight) ? -std::numeric_limits<double>::min() : -m_weight;
     m_ccode = model->currencyCode();
 }
@@ -705,19 +814,28 @@ QCoro::Task<int> DocumentModel::addLots(BrickLink::LotList &&lotsRef, AddLotMode
     // it didn't have to deal with this problem.
     QHash<BrickLink::Lot *, qsizetype> mergedLots;
     int mergedCount = 0;
+    QHash<const Lot *, int> sortedLotIndex; // only built if needed
 
     for (int i = 0; i < lots.size(); ++i) {
         Lot *lot = lots.at(i);
 
         if (addLotMode != AddLotMode::AddAsNew) {
+            // merge into the last candidate in sort order
             Lot *mergeLot = nullptr;
-
-            for (int j = int(m_sortedLots.count()) - 1; j >= 0; --j) {
-                Lot *otherLot = m_sortedLots.at(j);
-                if (canLotsBeMerged(*lot, *otherLot)) {
-                    mergeLot = otherLot;
-                    break;
+            const LotList candidates = m_mergeIndex.candidates(*lot);
+
+            if (candidates.size() == 1) {
+                mergeLot = candidates.constFirst();
+            } else if (candidates.size() > 1) {
+                if (sortedLotIndex.isEmpty()) {
+                    sortedLotIndex.reserve(m_sortedLots.size());
+                    for (int j = 0; j < m_sortedLots.size(); ++j)
+                        sortedLotIndex.insert(m_sortedLots.at(j), j);
                 }
+                mergeLot = *std::max_element(candidates.cbegin(), candidates.cend(),
+                                             [&sortedLotIndex](const Lot *l1, const Lot *l2) {
+                    return sortedLotIndex.value(l1) < sortedLotIndex.value(l2);
+                });
             }
             if (!mergeLot) {  // record "lot" to be added
                 Consolidate c({ nullptr, lot });
@@ -854,22 +972,26 @@ QCoro::Task<> DocumentModel::consolidateLots(BrickLink::LotList lots)
         co_return;
 
     QVector<Consolidate> consolidateList;
-    LotList sourceLots = lots;
 
-    for (int i = 0; i < sourceLots.count(); ++i) {
-        Lot *lot = sourceLots.at(i);
-        LotList mergeLots;
+    // group the lots by merge key, in the order of their first appearance
+    QVector<LotList> groups;
+    QHash<LotMergeIndex::Key, qsizetype> groupIndex;
+    groupIndex.reserve(lots.size());
 
-        for (int j = i + 1; j < sourceLots.count(); ++j) {
-            Lot *otherLot = sourceLots.at(j);
-            if (canLotsBeMerged(*lot, *otherLot))
-                mergeLots << sourceLots.takeAt(j--);
+    for (Lot *lot : std::as_const(lots)) {
+        if (const auto key = LotMergeIndex::key(*lot)) {
+            auto it = groupIndex.constFind(*key);
+            if (it == groupIndex.cend()) {
+                groupIndex.insert(*key, groups.size());
+                groups.append({ lot });
+            } else {
+                groups[*it].append(lot);
+            }
         }
-        if (mergeLots.isEmpty())
-            continue;
-
-        mergeLots.prepend(sourceLots.at(i));
-        consolidateList.emplace_back(mergeLots);
+    }
+    for (const LotList &group : std::as_const(groups)) {
+        if (group.size() > 1)
+            consolidateList.emplace_back(group);
     }
 
     if (consolidateList.isEmpty())
@@ -1056,6 +1178,17 @@ const LotList &DocumentModel::sortedLots() const
     return m_sortedLots;
 }
 
+LotList DocumentModel::mergeCandidates(const Lot &lot) const
+{
+    LotList candidates = m_mergeIndex.candidates(lot);
+    if (candidates.size() > 1) {
+        std::sort(candidates.begin(), candidates.end(), [this](const Lot *l1, const Lot *l2) {
+            return m_lotIndex.value(l1) < m_lotIndex.value(l2);
+        });
+    }
+    return candidates;
+}
+
 const LotList &DocumentModel::filteredLots() const
 {
     return m_filteredLots;
@@ -1064,7 +1197,22 @@ const LotList &DocumentModel::filteredLots() const
 DocumentStatistics DocumentModel::statistics(const LotList &list, bool ignoreExcluded,
                                              bool ignorePriceAndQuantityErrors) const
 {
-    return { this, list, ignoreExcluded, ignorePriceAndQuantityErrors };
+    if ((&list == &m_lots)
+            || ((&list == &m_filteredLots) && (m_filteredLots.size() == m_lots.size()))) {
+        return { this, m_statisticsTotals, ignoreExcluded, ignorePriceAndQuantityErrors };
+    }
+
+    DocumentStatistics::Totals totals;
+    for (const Lot *lot : list)
+        totals.add(this, lot);
+    return { this, totals, ignoreExcluded, ignorePriceAndQuantityErrors };
+}
+
+DocumentStatistics DocumentModel::statistics(const DocumentStatistics::Totals &totals,
+                                             bool ignoreExcluded,
+                                             bool ignorePriceAndQuantityErrors) const
+{
+    return { this, totals, ignoreExcluded, ignorePriceAndQuantityErrors };
 }
 
 void DocumentModel::beginMacro(const QString &label)
@@ -1190,10 +1338,39 @@ void DocumentModel::changeLots(const std::vector<std::pair<Lot *, Lot>> &changes
         m_undo->push(new ChangeCmd(this, changes, hint));
 }
 
+void DocumentModel::shareLotStrings(const LotList &lots)
+{
+    // Lots in a document very often have the same remarks or comments (or none at all): let
+    // them share the QString data instead of keeping one copy for each lot. This matters most
+    // after loading and when applying change records, as those create a new copy per lot.
+    QSet<QString> strings;
+    auto share = [&strings](const QString &str) -> const QString * {
+        if (str.isEmpty())
+            return nullptr;
+        auto it = strings.constFind(str);
+        if (it == strings.cend())
+            strings.insert(str);
+        else if (!it->isSharedWith(str))
+            return &(*it);
+        return nullptr;
+    };
+    for (Lot *lot : lots) {
+        if (auto s = share(lot->remarks()))
+            lot->setRemarks(*s);
+        if (auto s = share(lot->comments()))
+            lot->setComments(*s);
+        if (auto s = share(lot->reserved()))
+            lot->setReserved(*s);
+        if (auto s = share(lot->markerText()))
+            lot->setMarkerText(*s);
+    }
+}
+
 void DocumentModel::setLotsDirect(const LotList &lots)
 {
     if (lots.empty())
         return;
+
     QVector<int> posDummy, sortedPosDummy, filteredPosDummy;
     insertLotsDirect(lots, posDummy, sortedPosDummy, filteredPosDummy);
 }
@@ -1215,6 +1392,7 @@ void DocumentModel::insertLotsDirect(const LotList &lots, QVector<int> &position
 
     m_lotIndex.clear();
     m_filteredLotIndex.clear();
+    shareLotStrings(lots);
 
     for (Lot *lot : std::as_const(lots)) {
         if (!isAppend) {
@@ -1229,6 +1407,8 @@ void DocumentModel::insertLotsDirect(const LotList &lots, QVector<int> &position
             m_filteredLots.append(lot);
         }
 
+        m_mergeIndex.insert(lot);
+
         // this is really a new lot, not just a redo - start with no differences
         if (!m_differenceBase.contains(lot))
             m_differenceBase.insert(lot, *lot);
@@ -1237,8 +1417,11 @@ void DocumentModel::insertLotsDirect(const LotList &lots, QVector<int> &position
     rebuildLotIndex();
     rebuildFilteredLotIndex();
 
-    for (Lot *lot : std::as_const(lots))
+    for (Lot *lot : std::as_const(lots)) {
         updateLotFlags(lot);
+        m_statisticsTotals.add(this, lot);
+    }
+    ++m_statisticsGeneration;
 
     QModelIndexList after;
     for (const QModelIndex &idx : before)
@@ -1247,6 +1430,7 @@ void DocumentModel::insertLotsDirect(const LotList &lots, QVector<int> &position
     emit layoutChanged({ }, VerticalSortHint);
 
     emit lotCountChanged(int(m_lots.count()));
+    emit lotsInserted(lots);
     emitStatisticsChanged();
 
     if (isSorted())
@@ -1281,7 +1465,10 @@ void DocumentModel::removeLotsDirect(const LotList &lots, QVector<int> &position
         m_sortedLots.removeAt(sortIdx);
         if (filterIdx >= 0)
             m_filteredLots.removeAt(filterIdx);
+        m_mergeIndex.remove(lot);
+        m_statisticsTotals.remove(this, lot);
     }
+    ++m_statisticsGeneration;
 
     rebuildLotIndex();
     rebuildFilteredLotIndex();
@@ -1293,6 +1480,7 @@ void DocumentModel::removeLotsDirect(const LotList &lots, QVector<int> &position
     emit layoutChanged({ }, VerticalSortHint);
 
     emit lotCountChanged(int(m_lots.count()));
+    emit lotsRemoved(lots);
     emitStatisticsChanged();
 
     //TODO: we should remember and re-apply the isSorted/isFiltered state
@@ -1302,20 +1490,39 @@ void DocumentModel::removeLotsDirect(const LotList &lots, QVector<int> &position
         emit isFilteredChanged(m_isFiltered = false);
 }
 
-void DocumentModel::changeLotsDirect(std::vector<std::pair<Lot *, Lot>> &changes)
+void DocumentModel::changeLotsDirect(const LotList &lots, QByteArray &deltas)
 {
-    Q_ASSERT(!changes.empty());
+    Q_ASSERT(!lots.isEmpty());
+
+    // apply the delta records and replace them with the reverse ones
+    QByteArray reverseDeltas;
+    reverseDeltas.reserve(deltas.size());
+    QDataStream in(deltas);
+    QDataStream out(&reverseDeltas, QIODevice::WriteOnly);
 
-    for (auto &change : changes) {
-        Lot *lot = change.first;
-        std::swap(*lot, change.second);
+    for (Lot *lot : lots) {
+        const auto oldKey = LotMergeIndex::key(*lot);
+        m_statisticsTotals.remove(this, lot);
+        lot->swapDelta(in, out);
+        const auto newKey = LotMergeIndex::key(*lot);
+        if (oldKey != newKey) {
+            if (oldKey)
+                m_mergeIndex.remove(*oldKey, lot);
+            if (newKey)
+                m_mergeIndex.insert(*newKey, lot);
+        }
 
         QModelIndex idx1 = index(lot, 0);
         QModelIndex idx2 = idx1.siblingAtColumn(columnCount() - 1);
         updateLotFlags(lot);
+        m_statisticsTotals.add(this, lot);
         emitDataChanged(idx1, idx2);
     }
+    deltas = reverseDeltas;
+    shareLotStrings(lots);
+    ++m_statisticsGeneration;
 
+    emit lotsChanged(lots);
     emitStatisticsChanged();
 
     //TODO: we should remember and re-apply the isSorted/isFiltered state
@@ -1362,7 +1569,9 @@ void DocumentModel::changeCurrencyDirect(const QString &ccode, double crate, dou
             prices = nullptr;
         }
 
+        rebuildStatisticsTotals();
         emitDataChanged();
+        emit lotsChanged(m_lots);
         emitStatisticsChanged();
 
         //TODO: we should remember and re-apply the isSorted/isFiltered state
@@ -1430,6 +1639,14 @@ void DocumentModel::emitStatisticsChanged()
     m_delayedEmitOfStatisticsChanged->start();
 }
 
+void DocumentModel::rebuildStatisticsTotals()
+{
+    m_statisticsTotals.clear();
+    for (const Lot *lot : std::as_const(m_lots))
+        m_statisticsTotals.add(this, lot);
+    ++m_statisticsGeneration;
+}
+
 void DocumentModel::updateLotFlags(const Lot *lot)
 {
     quint64 errors = 0;
@@ -1500,8 +1717,14 @@ void DocumentModel::resetDifferenceModeDirect(QHash<const Lot *, Lot> &differenc
 
     for (const auto *lot : std::as_const(m_lots))
         updateLotFlags(lot);
+    rebuildStatisticsTotals();
 
     emitDataChanged();
+    emit lotsChanged(m_lots);
+
+    // the difference columns changed
+    if (isFiltered())
+        emit isFilteredChanged(m_isFiltered = false);
 }
 
 const Lot *DocumentModel::differenceBaseLot(const Lot *lot) const
@@ -1589,6 +1812,7 @@ Filter::Parser *DocumentModel::filterParser()
 void DocumentModel::setFakeIndexes(const QVector<int> &fakeIndexes)
 {
     m_fakeIndexes = fakeIndexes;
+    compileFilter();
 }
 
 void DocumentModel::rebuildLotIndex()
@@ -1601,6 +1825,7 @@ void DocumentModel::rebuildLotIndex()
 void DocumentModel::rebuildFilteredLotIndex()
 {
     m_filteredLotIndex.clear();
+    m_filteredLotIndex.reserve(m_filteredLots.size());
     for (auto i = 0; i < m_filteredLots.size(); ++i)
         m_filteredLotIndex[m_filteredLots.at(i)] = i;
 }
@@ -1805,7 +2030,11 @@ QVariant DocumentModel::dataForDecorationRole(const Lot *lot, Field f) const
 
 QVariant DocumentModel::dataForFilterRole(const Lot *lot, Field f) const
 {
-    const auto &c = m_columns.value(f);
+    // this is called from multiple threads while filtering: don't copy the Column
+    const auto it = m_columns.constFind(f);
+    if (it == m_columns.cend())
+        return { };
+    const auto &c = it.value();
     if (!c.filterable)
         return { };
     else if (c.filterFn) {
@@ -1842,24 +2071,148 @@ QHash<int, QByteArray> DocumentModel::roleNames() const
     return roles;
 }
 
+DocumentModel::SortKey DocumentModel::SortKey::fromInt(qint64 i)
+{
+    SortKey key;
+    key.type = Int;
+    key.i = i;
+    return key;
+}
+
+DocumentModel::SortKey DocumentModel::SortKey::fromDouble(double d)
+{
+    SortKey key;
+    key.type = Double;
+    key.d = d;
+    return key;
+}
+
+DocumentModel::SortKey DocumentModel::SortKey::fromString(const QString &str)
+{
+    SortKey key;
+    key.type = String;
+    key.s = str;
+    return key;
+}
+
+DocumentModel::SortKey DocumentModel::SortKey::fromNaturalString(const QString &str, qint64 secondary)
+{
+    SortKey key;
+    key.type = NaturalString;
+    key.s = Utility::naturalSortKey(str);
+    key.text = str;
+    key.i = secondary;
+    return key;
+}
+
+DocumentModel::SortKey DocumentModel::SortKey::fromCollatedString(const QString &str,
+                                                                  const QCollator &collator)
+{
+    SortKey key;
+    key.type = CollatedString;
+    key.collated = collator.sortKey(str);
+    return key;
+}
+
+int DocumentModel::SortKey::compare(const SortKey &key1, const SortKey &key2)
+{
+    Q_ASSERT(key1.type == key2.type);
+
+    switch (key1.type) {
+    case Int:
+        return (key1.i == key2.i) ? 0 : ((key1.i < key2.i) ? -1 : 1);
+    case Double:
+        return Utility::fuzzyCompare(key1.d, key2.d) ? 0 : ((key1.d < key2.d) ? -1 : 1);
+    case String:
+        return key1.s.compare(key2.s);
+    case NaturalString: {
+        int r = key1.s.compare(key2.s);
+        if (!r && (key1.text != key2.text)) // same as Utility::naturalCompare()'s fallback
+            r = key1.text.localeAwareCompare(key2.text);
+        return r ? r : ((key1.i == key2.i) ? 0 : ((key1.i < key2.i) ? -1 : 1));
+    }
+    case CollatedString:
+        return key1.collated->compare(*key2.collated);
+    }
+    return 0;
+}
+
 void DocumentModel::initializeColumns()
 {
     if (!m_columns.isEmpty())
         return;
 
-    static auto boolCompare = [](bool b1, bool b2) -> int {
-        return (b1 ? 1 : 0) - (b2 ? 1 : 0);
+    // Typed filters: these read the lot's fields directly, without going through QVariant
+    static auto intFilter = [](auto valueFn, bool localized = true) {
+        return [=](const Filter &f) -> FilterMatchFn {
+            return [=](const Lot *lot) { return f.matchesInt(valueFn(lot), localized); };
+        };
+    };
+    static auto doubleFilter = [](auto valueFn) {
+        return [=](const Filter &f) -> FilterMatchFn {
+            return [=](const Lot *lot) { return f.matchesDouble(valueFn(lot)); };
+        };
+    };
+    static auto dateTimeFilter = [](auto valueFn) {
+        return [=](const Filter &f) -> FilterMatchFn {
+            return [=](const Lot *lot) { return f.matchesDateTime(valueFn(lot)); };
+        };
+    };
+    static auto stringFilter = [](auto valueFn) {
+        return [=](const Filter &f) -> FilterMatchFn {
+            return [=](const Lot *lot) { return f.matchesString(valueFn(lot)); };
+        };
+    };
+    // string filters on BrickLink objects: match all the names once, then just look them up
+    static auto lookupFilter = [](auto allObjectsFn, auto objectFn, auto nameFn) {
+        return [=](const Filter &f) -> FilterMatchFn {
+            QSet<const void *> matching;
+            for (const auto &object : allObjectsFn()) {
+                if (f.matchesString(object.name()))
+                    matching.insert(&object);
+            }
+            return [=](const Lot *lot) {
+                const void *object = objectFn(lot);
+                return object ? matching.contains(object) : f.matchesString(nameFn(lot));
+            };
+        };
+    };
+    // string filters on enums: match all the names once, then just look up the value
+    static auto enumFilter = [](auto valueFn, auto nameFn, auto... values) {
+        return [=](const Filter &f) -> FilterMatchFn {
+            const std::array matching { std::pair { values, f.matchesString(nameFn(values)) }... };
+            return [=](const Lot *lot) {
+                const auto v = valueFn(lot);
+                for (const auto &m : matching) {
+                    if (m.first == v)
+                        return m.second;
+                }
+                return f.matchesString(nameFn(v));
+            };
+        };
+    };
+
+    static auto statusName = [](BrickLink::Status status) {
+        switch (status) {
+        case BrickLink::Status::Include: return tr("Include");
+        case BrickLink::Status::Extra  : return tr("Extra");
+        default:
+        case BrickLink::Status::Exclude: return tr("Exclude");
+        }
     };
-    static auto uintCompare = [](uint u1, uint u2) -> int {
-        return (u1 == u2) ? 0 : ((u1 < u2) ? -1 : 1);
+    static auto conditionName = [](BrickLink::Condition condition) {
+        return (condition == BrickLink::Condition::New) ? tr("New") : tr("Used");
     };
-    static auto doubleCompare = [](double d1, double d2) -> int {
-        return Utility::fuzzyCompare(d1, d2) ? 0 : ((d1 < d2) ? -1 : 1);
+    static auto retainName = [](bool retain) {
+        return retain ? tr("Yes", "Filter>Retain>Yes") : tr("No", "Filter>Retain>No");
     };
-    static auto dateTimeCompare = [](const QDateTime &dt1, const QDateTime &dt2) -> int {
-        qint64 se1 = dt1.toSecsSinceEpoch();
-        qint64 se2 = dt2.toSecsSinceEpoch();
-        return (se1 == se2) ? 0 : ((se1 < se2) ? -1 : 1);
+    static auto stockroomName = [](BrickLink::Stockroom stockroom) {
+        switch (stockroom) {
+        case BrickLink::Stockroom::A: return u"A"_qs;
+        case BrickLink::Stockroom::B: return u"B"_qs;
+        case BrickLink::Stockroom::C: return u"C"_qs;
+        default                     : return tr("None", "Filter>Stockroom>None");
+        }
     };
 
     auto C = [this](Field f, const Column &c) { m_columns.insert(f, c); };
@@ -1877,8 +2230,13 @@ void DocumentModel::initializeColumns()
                   return fi >= 0 ? QVariant { fi + 1 } : QVariant { u"+"_qs };
               }
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return m_lotIndex.value(l1, -1) - m_lotIndex.value(l2, -1);
+          .compileFilterFn = [&](const Filter &f) {
+              // fake indexes need the generic filter
+              return m_fakeIndexes.isEmpty() ? intFilter([this](const Lot *lot) { return m_lotIndex.value(lot, -1) + 1; })(f)
+                                             : FilterMatchFn { };
+          },
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(m_lotIndex.value(lot, -1));
           },
       });
 
@@ -1889,27 +2247,15 @@ void DocumentModel::initializeColumns()
           .valueModelFn = [&]() { return new QStringListModel({ tr("Include"), tr("Exclude"), tr("Extra") }); },
           .dataFn = [&](const Lot *lot) { return QVariant::fromValue(lot->status()); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setStatus(v.value<BrickLink::Status>()); },
-          .filterFn = [&](const Lot *lot) {
-              switch (lot->status()) {
-              case BrickLink::Status::Include: return tr("Include");
-              case BrickLink::Status::Extra  : return tr("Extra");
-              default:
-              case BrickLink::Status::Exclude: return tr("Exclude");
-              }
+          .filterFn = [&](const Lot *lot) { return statusName(lot->status()); },
+          .compileFilterFn = enumFilter([](const Lot *lot) { return lot->status(); }, statusName,
+                                        BrickLink::Status::Include, BrickLink::Status::Exclude,
+                                        BrickLink::Status::Extra),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              // status, then counter-part, alternate id and alternate, packed into one number
+              return SortKey::fromInt((qint64(lot->status()) << 34) | (qint64(lot->counterPart()) << 33)
+                                      | (qint64(lot->alternateId()) << 1) | qint64(lot->alternate()));
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              if (l1->status() != l2->status()) {
-                  return int(l1->status()) - int(l2->status());
-              } else if (l1->counterPart() != l2->counterPart()) {
-                  return boolCompare(l1->counterPart(), l2->counterPart());
-              } else if (l1->alternateId() != l2->alternateId()) {
-                  return uintCompare(l1->alternateId(), l2->alternateId());
-              } else if (l1->alternate() != l2->alternate()) {
-                  return boolCompare(l1->alternate(), l2->alternate());
-              } else {
-                  return 0;
-              }
-          }
       });
 
     C(Picture, Column {
@@ -1923,9 +2269,8 @@ void DocumentModel::initializeColumns()
               auto pic = BrickLink::core()->pictureCache()->picture(lot->item(), lot->color());
               return QVariant::fromValue(pic ? pic->image() : QImage { });
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-                       return Utility::naturalCompare(QString::fromLatin1(l1->itemId()),
-                                                      QString::fromLatin1(l2->itemId()));
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromNaturalString(QString::fromLatin1(lot->itemId()));
           },
       });
     C(PartNo, Column {
@@ -1937,9 +2282,11 @@ void DocumentModel::initializeColumns()
               if (auto newItem = BrickLink::core()->item(itid, v.toString().toLatin1()))
                   lot->setItem(newItem);
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-                      return Utility::naturalCompare(QString::fromLatin1(l1->itemId()),
-                                                     QString::fromLatin1(l2->itemId()));
+          .compileFilterFn = [](const Filter &f) -> FilterMatchFn {
+              return [f](const Lot *lot) { return f.matchesString(QLatin1String(lot->itemId())); };
+          },
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromNaturalString(QString::fromLatin1(lot->itemId()));
           },
       });
     C(Description, Column {
@@ -1948,24 +2295,27 @@ void DocumentModel::initializeColumns()
           .dataFn = [&](const Lot *lot) { return QVariant::fromValue(lot->item()); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setItem(v.value<const BrickLink::Item *>()); },
           .displayFn = [&](const Lot *lot) { return lot->itemName(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return Utility::naturalCompare(l1->itemName(), l2->itemName());
+          .compileFilterFn = stringFilter([](const Lot *lot) { return lot->itemName(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromNaturalString(lot->itemName());
           },
       });
     C(Comments, Column {
           .title = QT_TR_NOOP("Comments"),
           .dataFn = [&](const Lot *lot) { return lot->comments(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setComments(v.toString()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->comments().localeAwareCompare(l2->comments());
+          .compileFilterFn = stringFilter([](const Lot *lot) { return lot->comments(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &collator) {
+              return SortKey::fromCollatedString(lot->comments(), collator);
           },
       });
     C(Remarks, Column {
           .title = QT_TR_NOOP("Remarks"),
           .dataFn = [&](const Lot *lot) { return lot->remarks(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setRemarks(v.toString()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->remarks().localeAwareCompare(l2->remarks());
+          .compileFilterFn = stringFilter([](const Lot *lot) { return lot->remarks(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &collator) {
+              return SortKey::fromCollatedString(lot->remarks(), collator);
           },
       });
     C(QuantityOrig, Column {
@@ -1977,10 +2327,13 @@ void DocumentModel::initializeColumns()
               auto base = differenceBaseLot(lot);
               return base ? base->quantity() : 0;
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              auto base1 = differenceBaseLot(l1);
-              auto base2 = differenceBaseLot(l2);
-              return (base1 ? base1->quantity() : 0) - (base2 ? base2->quantity() : 0);
+          .compileFilterFn = intFilter([this](const Lot *lot) {
+              auto base = differenceBaseLot(lot);
+              return base ? base->quantity() : 0;
+          }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              auto base = differenceBaseLot(lot);
+              return SortKey::fromInt(base ? base->quantity() : 0);
           },
       });
     C(QuantityDiff, Column {
@@ -1995,10 +2348,13 @@ void DocumentModel::initializeColumns()
               if (auto base = differenceBaseLot(lot))
                   lot->setQuantity(base->quantity() + v.toInt());
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              auto base1 = differenceBaseLot(l1);
-              auto base2 = differenceBaseLot(l2);
-              return (base1 ? l1->quantity() - base1->quantity() : 0) - (base2 ? l2->quantity() - base2->quantity() : 0);
+          .compileFilterFn = intFilter([this](const Lot *lot) {
+              auto base = differenceBaseLot(lot);
+              return base ? lot->quantity() - base->quantity() : 0;
+          }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              auto base = differenceBaseLot(lot);
+              return SortKey::fromInt(base ? lot->quantity() - base->quantity() : 0);
           },
       });
     C(Quantity, Column {
@@ -2007,8 +2363,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Quantity"),
           .dataFn = [&](const Lot *lot) { return lot->quantity(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setQuantity(v.toInt()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->quantity() - l2->quantity();
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->quantity(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->quantity());
           },
       });
     C(Bulk, Column {
@@ -2017,8 +2374,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Bulk"),
           .dataFn = [&](const Lot *lot) { return lot->bulkQuantity(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setBulkQuantity(v.toInt()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->bulkQuantity() - l2->bulkQuantity();
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->bulkQuantity(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->bulkQuantity());
           },
       });
     C(PriceOrig, Column {
@@ -2029,10 +2387,13 @@ void DocumentModel::initializeColumns()
               auto base = differenceBaseLot(lot);
               return base ? base->price() : 0;
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              auto base1 = differenceBaseLot(l1);
-              auto base2 = differenceBaseLot(l2);
-              return doubleCompare(base1 ? base1->price() : 0, base2 ? base2->price() : 0);
+          .compileFilterFn = doubleFilter([this](const Lot *lot) {
+              auto base = differenceBaseLot(lot);
+              return base ? base->price() : 0;
+          }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              auto base = differenceBaseLot(lot);
+              return SortKey::fromDouble(base ? base->price() : 0);
           },
       });
     C(PriceDiff, Column {
@@ -2046,10 +2407,13 @@ void DocumentModel::initializeColumns()
               if (auto base = differenceBaseLot(lot))
                   lot->setPrice(base->price() + v.toDouble());
           },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              auto base1 = differenceBaseLot(l1);
-              auto base2 = differenceBaseLot(l2);
-              return doubleCompare(base1 ? l1->price() - base1->price() : 0, base2 ? l2->price() - base2->price() : 0);
+          .compileFilterFn = doubleFilter([this](const Lot *lot) {
+              auto base = differenceBaseLot(lot);
+              return base ? lot->price() - base->price() : 0;
+          }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              auto base = differenceBaseLot(lot);
+              return SortKey::fromDouble(base ? lot->price() - base->price() : 0);
           },
       });
     C(Cost, Column {
@@ -2057,8 +2421,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Cost"),
           .dataFn = [&](const Lot *lot) { return lot->cost(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setCost(v.toDouble()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->cost(), l2->cost());
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->cost(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->cost());
           },
       });
     C(Price, Column {
@@ -2066,8 +2431,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Price"),
           .dataFn = [&](const Lot *lot) { return lot->price(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setPrice(v.toDouble()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->price(), l2->price());
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->price(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->price());
           },
       });
     C(Total, Column {
@@ -2075,8 +2441,9 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Total"),
           .displayFn = [&](const Lot *lot) { return lot->total(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->total(), l2->total());
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->total(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->total());
           },
       });
     C(Sale, Column {
@@ -2085,8 +2452,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Sale"),
           .dataFn = [&](const Lot *lot) { return lot->sale(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setSale(v.toInt()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->sale() - l2->sale();
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->sale(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->sale());
           },
       });
     C(Condition, Column {
@@ -2097,12 +2465,11 @@ void DocumentModel::initializeColumns()
           .dataFn = [&](const Lot *lot) { return QVariant::fromValue(lot->condition()); },
           .auxDataFn = [&](const Lot *lot) { return QVariant::fromValue(lot->subCondition()); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setCondition(v.value<BrickLink::Condition>()); },
-          .filterFn = [&](const Lot *lot) {
-              return (lot->condition() == BrickLink::Condition::New) ? tr("New") : tr("Used");
-          },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              int d = int(l1->condition()) - int(l2->condition());
-              return d ? d : int(l1->subCondition()) - int(l2->subCondition());
+          .filterFn = [&](const Lot *lot) { return conditionName(lot->condition()); },
+          .compileFilterFn = enumFilter([](const Lot *lot) { return lot->condition(); }, conditionName,
+                                        BrickLink::Condition::New, BrickLink::Condition::Used),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(int(lot->condition()) * 256 + int(lot->subCondition()));
           },
       });
     C(Color, Column {
@@ -2120,8 +2487,11 @@ void DocumentModel::initializeColumns()
           .dataFn = [&](const Lot *lot) { return QVariant::fromValue(lot->color()); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setColor(v.value<const BrickLink::Color *>()); },
           .displayFn = [&](const Lot *lot) { return lot->colorName(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->colorName().localeAwareCompare(l2->colorName());
+          .compileFilterFn = lookupFilter([]() -> const auto & { return BrickLink::core()->colors(); },
+                                          [](const Lot *lot) { return lot->color(); },
+                                          [](const Lot *lot) { return lot->colorName(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &collator) {
+              return SortKey::fromCollatedString(lot->colorName(), collator);
           },
       });
     C(Category, Column {
@@ -2137,8 +2507,11 @@ void DocumentModel::initializeColumns()
           },
           .auxDataFn = [&](const Lot *lot) { return lot->categoryId(); },
           .displayFn = [&](const Lot *lot) { return lot->categoryName(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->categoryName().localeAwareCompare(l2->categoryName());
+          .compileFilterFn = lookupFilter([]() -> const auto & { return BrickLink::core()->categories(); },
+                                          [](const Lot *lot) { return lot->category(); },
+                                          [](const Lot *lot) { return lot->categoryName(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &collator) {
+              return SortKey::fromCollatedString(lot->categoryName(), collator);
           },
       });
     C(ItemType, Column {
@@ -2153,8 +2526,11 @@ void DocumentModel::initializeColumns()
           },
           .auxDataFn = [&](const Lot *lot) { return int(lot->itemTypeId()); },
           .displayFn = [&](const Lot *lot) { return lot->itemTypeName(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->itemTypeName().localeAwareCompare(l2->itemTypeName());
+          .compileFilterFn = lookupFilter([]() -> const auto & { return BrickLink::core()->itemTypes(); },
+                                          [](const Lot *lot) { return lot->itemType(); },
+                                          [](const Lot *lot) { return lot->itemTypeName(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &collator) {
+              return SortKey::fromCollatedString(lot->itemTypeName(), collator);
           },
       });
     C(TierQ1, Column {
@@ -2163,8 +2539,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier Q1"),
           .dataFn = [&](const Lot *lot) { return lot->tierQuantity(0); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierQuantity(0, v.toInt()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->tierQuantity(0) - l2->tierQuantity(0);
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->tierQuantity(0); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->tierQuantity(0));
           },
       });
     C(TierP1, Column {
@@ -2172,8 +2549,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier P1"),
           .dataFn = [&](const Lot *lot) { return lot->tierPrice(0); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierPrice(0, v.toDouble()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->tierPrice(0), l2->tierPrice(0));
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->tierPrice(0); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->tierPrice(0));
           },
       });
     C(TierQ2, Column {
@@ -2182,8 +2560,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier Q2"),
           .dataFn = [&](const Lot *lot) { return lot->tierQuantity(1); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierQuantity(1, v.toInt()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->tierQuantity(1) - l2->tierQuantity(1);
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->tierQuantity(1); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->tierQuantity(1));
           },
       });
     C(TierP2, Column {
@@ -2191,8 +2570,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier P2"),
           .dataFn = [&](const Lot *lot) { return lot->tierPrice(1); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierPrice(1, v.toDouble()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->tierPrice(1), l2->tierPrice(1));
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->tierPrice(1); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->tierPrice(1));
           },
       });
     C(TierQ3, Column {
@@ -2201,8 +2581,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier Q3"),
           .dataFn = [&](const Lot *lot) { return lot->tierQuantity(2); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierQuantity(2, v.toInt()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->tierQuantity(2) - l2->tierQuantity(2);
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->tierQuantity(2); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->tierQuantity(2));
           },
       });
     C(TierP3, Column {
@@ -2210,8 +2591,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Tier P3"),
           .dataFn = [&](const Lot *lot) { return lot->tierPrice(2); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTierPrice(2, v.toDouble()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->tierPrice(2), l2->tierPrice(2));
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->tierPrice(2); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->tierPrice(2));
           },
       });
     C(LotId, Column {
@@ -2219,8 +2601,9 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Lot Id"),
           .displayFn = [&](const Lot *lot) { return lot->lotId(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return uintCompare(l1->lotId(), l2->lotId());
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->lotId(); }, false),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->lotId());
           },
       });
     C(Retain, Column {
@@ -2230,11 +2613,11 @@ void DocumentModel::initializeColumns()
           .valueModelFn = [&]() { return new QStringListModel({ tr("Yes"), tr("No") }); },
           .dataFn = [&](const Lot *lot) { return lot->retain(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setRetain(v.toBool()); },
-          .filterFn = [&](const Lot *lot) {
-              return lot->retain() ? tr("Yes", "Filter>Retain>Yes") : tr("No", "Filter>Retain>No");
-          },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return boolCompare(l1->retain(), l2->retain());
+          .filterFn = [&](const Lot *lot) { return retainName(lot->retain()); },
+          .compileFilterFn = enumFilter([](const Lot *lot) { return lot->retain(); }, retainName,
+                                        true, false),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->retain() ? 1 : 0);
           },
       });
     C(Stockroom, Column {
@@ -2243,24 +2626,21 @@ void DocumentModel::initializeColumns()
           .valueModelFn = [&]() { return new QStringListModel({ u"A"_qs, u"B"_qs, u"C"_qs, tr("None") }); },
           .dataFn = [&](const Lot *lot) { return QVariant::fromValue(lot->stockroom()); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setStockroom(v.value<BrickLink::Stockroom>()); },
-          .filterFn = [&](const Lot *lot) {
-              switch (lot->stockroom()) {
-              case BrickLink::Stockroom::A: return u"A"_qs;
-              case BrickLink::Stockroom::B: return u"B"_qs;
-              case BrickLink::Stockroom::C: return u"C"_qs;
-              default                     : return tr("None", "Filter>Stockroom>None");
-              }
-          },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return int(l1->stockroom()) - int(l2->stockroom());
+          .filterFn = [&](const Lot *lot) { return stockroomName(lot->stockroom()); },
+          .compileFilterFn = enumFilter([](const Lot *lot) { return lot->stockroom(); }, stockroomName,
+                                        BrickLink::Stockroom::None, BrickLink::Stockroom::A,
+                                        BrickLink::Stockroom::B, BrickLink::Stockroom::C),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(int(lot->stockroom()));
           },
       });
     C(Reserved, Column {
           .title = QT_TR_NOOP("Reserved"),
           .dataFn = [&](const Lot *lot) { return lot->reserved(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setReserved(v.toString()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->reserved().compare(l2->reserved());
+          .compileFilterFn = stringFilter([](const Lot *lot) { return lot->reserved(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromString(lot->reserved());
           },
       });
     C(Weight, Column {
@@ -2268,8 +2648,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Weight"),
           .dataFn = [&](const Lot *lot) { return lot->weight(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setWeight(v.toDouble()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->weight(), l2->weight());
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->weight(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->weight());
           },
       });
     C(TotalWeight, Column {
@@ -2277,8 +2658,9 @@ void DocumentModel::initializeColumns()
           .title = QT_TR_NOOP("Total Weight"),
           .dataFn = [&](const Lot *lot) { return lot->totalWeight(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setTotalWeight(v.toDouble()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return doubleCompare(l1->totalWeight(), l2->totalWeight());
+          .compileFilterFn = doubleFilter([](const Lot *lot) { return lot->totalWeight(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromDouble(lot->totalWeight());
           },
       });
     C(YearReleased, Column {
@@ -2287,8 +2669,9 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Year"),
           .displayFn = [&](const Lot *lot) { return lot->itemYearReleased(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return l1->itemYearReleased() - l2->itemYearReleased();
+          .compileFilterFn = intFilter([](const Lot *lot) { return lot->itemYearReleased(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->itemYearReleased());
           },
       });
     C(Marker, Column {
@@ -2296,9 +2679,9 @@ void DocumentModel::initializeColumns()
           .dataFn = [&](const Lot *lot) { return lot->markerText(); },
           .auxDataFn = [&](const Lot *lot) { return lot->markerColor(); },
           .setDataFn = [&](Lot *lot, const QVariant &v) { lot->setMarkerText(v.toString()); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              int d = Utility::naturalCompare(l1->markerText(), l2->markerText());
-              return d ? d : uintCompare(l1->markerColor().rgba(), l2->markerColor().rgba());
+          .compileFilterFn = stringFilter([](const Lot *lot) { return lot->markerText(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromNaturalString(lot->markerText(), lot->markerColor().rgba());
           },
       });
     C(DateAdded, Column {
@@ -2306,8 +2689,9 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Added"),
           .displayFn = [&](const Lot *lot) { return lot->dateAdded(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return dateTimeCompare(l1->dateAdded(), l2->dateAdded());
+          .compileFilterFn = dateTimeFilter([](const Lot *lot) { return lot->dateAdded(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->dateAdded().toSecsSinceEpoch());
           },
       });
     C(DateLastSold, Column {
@@ -2315,8 +2699,9 @@ void DocumentModel::initializeColumns()
           .editable = false,
           .title = QT_TR_NOOP("Last Sold"),
           .displayFn = [&](const Lot *lot) { return lot->dateLastSold(); },
-          .compareFn = [&](const Lot *l1, const Lot *l2) {
-              return dateTimeCompare(l1->dateLastSold(), l2->dateLastSold());
+          .compileFilterFn = dateTimeFilter([](const Lot *lot) { return lot->dateLastSold(); }),
+          .sortKeyFn = [&](const Lot *lot, const QCollator &) {
+              return SortKey::fromInt(lot->dateLastSold().toSecsSinceEpoch());
           },
       });
 }
@@ -2391,8 +2776,6 @@ void DocumentModel::sortDirect(const QVector<QPair<int, Qt::SortOrder>> &columns
     emit layoutAboutToBeChanged({ }, VerticalSortHint);
     const QModelIndexList before = persistentIndexList();
 
-    m_filteredLotIndex.clear();
-
     m_sortColumns = columns;
 
     if (!unsortedLots.isEmpty()) {
@@ -2411,30 +2794,67 @@ void DocumentModel::sortDirect(const QVector<QPair<int, Qt::SortOrder>> &columns
             auto columnsPlusIndex = columns;
             columnsPlusIndex.append(qMakePair(0, columns.isEmpty() ? Qt::AscendingOrder
                                                                    : columns.constFirst().second));
-            qParallelSort(m_sortedLots.begin(), m_sortedLots.end(),
-                          [this, columnsPlusIndex](const auto *lot1, const auto *lot2) {
-                int r = 0;
-                for (const auto &sc : columnsPlusIndex) {
-                    auto cmp = m_columns.value(sc.first).compareFn;
-                    r = cmp ? cmp(lot1, lot2) : 0;
-                    if (r) {
-                        if (sc.second == Qt::DescendingOrder)
-                            r = -r;
-                        break;
-                    }
+
+            // Extract the sort keys of all lots once (in parallel), instead of calling the
+            // columns' accessors twice for every single comparison while sorting
+            std::vector<std::function<SortKey(const Lot *, const QCollator &)>> keyFns;
+            std::vector<bool> descending;
+            for (const auto &sc : std::as_const(columnsPlusIndex)) {
+                if (auto fn = m_columns.value(sc.first).sortKeyFn) {
+                    keyFns.push_back(fn);
+                    descending.push_back(sc.second == Qt::DescendingOrder);
+                }
+            }
+            const auto lotCount = size_t(m_sortedLots.size());
+            const size_t keyCount = keyFns.size();
+            std::vector<SortKey> keys(lotCount * keyCount);
+
+            static constexpr size_t chunkSize = 4096;
+            std::vector<size_t> chunks;
+            for (size_t i = 0; i < lotCount; i += chunkSize)
+                chunks.push_back(i);
+
+            QtConcurrent::blockingMap(chunks, [&](size_t first) {
+                QCollator collator; // not thread-safe, so we need one per chunk
+                const size_t last = std::min(first + chunkSize, lotCount);
+                for (size_t i = first; i < last; ++i) {
+                    for (size_t k = 0; k < keyCount; ++k)
+                        keys[i * keyCount + k] = keyFns[k](m_sortedLots.at(qsizetype(i)), collator);
                 }
-                return r < 0;
             });
+
+            std::vector<qsizetype> order(lotCount);
+            std::iota(order.begin(), order.end(), 0);
+            qParallelSort(order.begin(), order.end(), [&](qsizetype i1, qsizetype i2) {
+                const SortKey *keys1 = keys.data() + size_t(i1) * keyCount;
+                const SortKey *keys2 = keys.data() + size_t(i2) * keyCount;
+                for (size_t k = 0; k < keyCount; ++k) {
+                    if (int r = SortKey::compare(keys1[k], keys2[k]))
+                        return descending[k] ? (r > 0) : (r < 0);
+                }
+                return false;
+            });
+
+            LotList sortedLots;
+            sortedLots.reserve(qsizetype(lotCount));
+            for (auto i : order)
+                sortedLots.append(m_sortedLots.at(i));
+            m_sortedLots = sortedLots;
         }
     }
 
     // we were filtered before, but we don't want to refilter: the solution is to
-    // keep the old filtered lots, but use the order from m_sortedLots
+    // keep the old filtered lots, but use the order from m_sortedLots.
+    // m_filteredLotIndex still describes the old filtered lots, so this is O(n) and not O(n*m)
     if (!m_filteredLots.isEmpty()
             && (m_filteredLots.size() != m_sortedLots.size())
             && (m_filteredLots != m_sortedLots)) {
-        m_filteredLots = QtConcurrent::blockingFiltered(m_sortedLots, [this](auto *lot) {
-            return m_filteredLots.contains(lot);
+        if (m_filteredLotIndex.size() != m_filteredLots.size())
+            rebuildFilteredLotIndex();
+
+        const auto &filteredLotIndex = m_filteredLotIndex;
+        m_filteredLots = QtConcurrent::blockingFiltered(m_sortedLots, [&filteredLotIndex](auto *lot) {
+            return filteredLotIndex.contains(lot);
         });
     } else {
         m_filteredLots = m_sortedLots;
@@ -2466,7 +2886,12 @@ void DocumentModel::filterDirect(const QVector<Filter> &filter, bool &filtered,
 
     m_filteredLotIndex.clear();
 
+    // if the lots haven't changed since the last filter run and the new filter is narrower,
+    // only the currently visible lots can match
+    const bool isRefinement = m_isFiltered && Filter::isRefinement(m_filter, filter);
+
     m_filter = filter;
+    compileFilter();
 
     if (!unfilteredLots.isEmpty()) {
         m_isFiltered = filtered;
@@ -2477,10 +2902,12 @@ void DocumentModel::filterDirect(const QVector<Filter> &filter, bool &filtered,
         unfilteredLots = m_filteredLots;
         filtered = m_isFiltered;
         m_isFiltered = true;
-        m_filteredLots = m_sortedLots;
 
-        if (!filter.isEmpty()) {
-            m_filteredLots = QtConcurrent::blockingFiltered(m_sortedLots, [this](auto *lot) {
+        if (filter.isEmpty()) {
+            m_filteredLots = m_sortedLots;
+        } else {
+            m_filteredLots = QtConcurrent::blockingFiltered(isRefinement ? unfilteredLots : m_sortedLots,
+                                                            [this](auto *lot) {
                 return filterAcceptsLot(lot);
             });
         }
@@ -2660,41 +3087,75 @@ void DocumentModel::reFilter()
 }
 
 
+void DocumentModel::compileFilter()
+{
+    m_compiledFilter.clear();
+    m_compiledFilter.reserve(size_t(m_filter.size()));
+
+    for (const Filter &f : std::as_const(m_filter)) {
+        CompiledFilter cf;
+        cf.combination = f.combination();
+
+        int firstcol = f.field();
+        int lastcol = firstcol;
+        if (firstcol < 0) {
+            firstcol = 0;
+            lastcol = columnCount() - 1;
+        }
+
+        for (int col = firstcol; col <= lastcol; ++col) {
+            const auto it = m_columns.constFind(col);
+
+            if ((it != m_columns.cend()) && !it->filterable) {
+                // the result doesn't depend on the lot
+                if (f.matches(QVariant { })) {
+                    cf.matchFns.clear();
+                    cf.constantResult = true;
+                    break;
+                }
+                continue;
+            }
+
+            FilterMatchFn fn;
+            if ((it != m_columns.cend()) && it->compileFilterFn)
+                fn = it->compileFilterFn(f);
+            if (!fn) {
+                fn = [this, f, field = static_cast<Field>(col)](const Lot *lot) {
+                    return f.matches(dataForFilterRole(lot, field));
+                };
+            }
+            cf.matchFns.push_back(std::move(fn));
+        }
+        m_compiledFilter.push_back(std::move(cf));
+    }
+}
+
 bool DocumentModel::filterAcceptsLot(const Lot *lot) const
 {
     if (!lot)
         return false;
-    else if (m_filter.isEmpty())
+    else if (m_compiledFilter.empty())
         return true;
 
     bool result = false;
     Filter::Combination nextcomb = Filter::Or;
 
-    for (const Filter &f : m_filter) {
+    for (const auto &cf : m_compiledFilter) {
         // short circuit
         if (((nextcomb == Filter::And) && !result) || ((nextcomb == Filter::Or) && result)) {
-            nextcomb = f.combination();
+            nextcomb = cf.combination;
             continue;
         }
 
-        int firstcol = f.field();
-        int lastcol = firstcol;
-        if (firstcol < 0) {
-            firstcol = 0;
-            lastcol = columnCount() - 1;
-        }
-
-        bool localresult = false;
-        for (int col = firstcol; col <= lastcol && !localresult; ++col) {
-            QVariant v = dataForFilterRole(lot, static_cast<Field>(col));
-            localresult = f.matches(v);
-        }
+        bool localresult = cf.constantResult
+                || std::any_of(cf.matchFns.cbegin(), cf.matchFns.cend(),
+                               [lot](const auto &matchFn) { return matchFn(lot); });
         if (nextcomb == Filter::And)
             result = result && localresult;
         else
             result = result || localresult;
 
-        nextcomb = f.combination();
+        nextcomb = cf.combination;
     }
     return result;
 }
@@ -2726,6 +3187,9 @@ void DocumentModel::languageChange()
     }
 
     m_filterParser->setFieldTokens(fields);
+
+    // some of the compiled filters depend on translated strings
+    compileFilter();
 }
 
 LotList DocumentModel::sortLotList(const LotList &list) const
@@ -2817,4 +3281,52 @@ bool DocumentLotsMimeData::hasFormat(const QString &mimeType) const
 }
 
 
+#ifdef DOCUMENTMODEL_TESTING // benchmarking
+#include "utility/stopwatch.h"
+
+static struct test_document_model
+{
+    test_document_model()
+    {
+        static constinit bool once = true;
+        if (!once)
+            return;
+        once = false;
+
+        // re-sorting a filtered view: 60k lots, a filter that matches every 3rd lot
+        static constexpr int count = 60'000;
+
+        QVector<Lot *> sortedLots(count);
+        for (int i = 0; i < count; ++i)
+            sortedLots[i] = reinterpret_cast<Lot *>(quintptr(i + 1) * 64);
+        QVector<Lot *> filteredLots;
+        for (int i = 0; i < count; i += 3)
+            filteredLots.append(sortedLots.at(i));
+        std::reverse(sortedLots.begin(), sortedLots.end()); // the new sort order
+
+        QVector<Lot *> resultContains;
+        QVector<Lot *> resultIndex;
+        {
+            stopwatch sw("re-sort filtered, QVector::contains()");
+            resultContains = QtConcurrent::blockingFiltered(sortedLots, [&filteredLots](auto *lot) {
+                return filteredLots.contains(lot);
+            });
+        }
+        {
+            stopwatch sw("re-sort filtered, index lookup (incl. building the index)");
+            QHash<const Lot *, int> filteredLotIndex;
+            filteredLotIndex.reserve(filteredLots.size());
+            for (auto i = 0; i < filteredLots.size(); ++i)
+                filteredLotIndex[filteredLots.at(i)] = i;
+            resultIndex = QtConcurrent::blockingFiltered(sortedLots, [&filteredLotIndex](auto *lot) {
+                return filteredLotIndex.contains(lot);
+            });
+        }
+        Q_ASSERT(resultContains == resultIndex);
+    }
+} test_document_model_instance;
+
+#endif
+
+
 #include "moc_documentmodel.cpp"
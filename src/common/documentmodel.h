@@ -3,9 +3,12 @@
 
 #pragma once
 
+#include <array>
 #include <functional>
+#include <optional>
 
 #include <QAbstractTableModel>
+#include <QCollator>
 #include <QPixmap>
 #include <QUuid>
 #include <QTimer>
@@ -17,6 +20,7 @@
 #include "bricklink/io.h"
 #include "documentio.h"
 #include "common/filter.h"
+#include "common/lotmergeindex.h"
 
 QT_FORWARD_DECLARE_CLASS(QUndoStack)
 class UndoStack;
@@ -56,10 +60,43 @@ public:
 
     DocumentStatistics() = default;
 
+    // Running sums over a set of lots: adding or removing a lot is O(1), so these can be kept
+    // up to date instead of iterating over all the lots whenever the statistics are needed.
+    class Totals
+    {
+    public:
+        void add(const DocumentModel *model, const Lot *lot)     { update(model, lot, 1); }
+        void remove(const DocumentModel *model, const Lot *lot)  { update(model, lot, -1); }
+        void clear()  { m_included = { }; m_excluded = { }; }
+
+    private:
+        struct Sums {
+            int lots = 0;
+            int items = 0;
+            double value = 0;
+            double minValue = 0;
+            double cost = 0;
+            double weight = 0;
+            int weightMissing = 0;
+            int incomplete = 0;
+            std::array<int, 64> errors { };      // number of lots per error flag bit
+            std::array<int, 64> differences { }; // number of lots per difference flag bit
+
+            void update(const Lot *lot, QPair<quint64, quint64> flags, int sign);
+        };
+
+        void update(const DocumentModel *model, const Lot *lot, int sign);
+
+        Sums m_included;
+        Sums m_excluded;
+
+        friend class DocumentStatistics;
+    };
+
     Q_INVOKABLE QString asHtmlTable() const;
 
 private:
-    DocumentStatistics(const DocumentModel *model, const LotList &list, bool ignoreExcluded,
+    DocumentStatistics(const DocumentModel *model, const Totals &totals, bool ignoreExcluded,
                        bool ignorePriceAndQuantityErrors = false);
 
     int m_lots;
@@ -246,6 +283,7 @@ public:
     const LotList &lots() const;
     const LotList &sortedLots() const;
     const LotList &filteredLots() const;
+    LotList mergeCandidates(const Lot &lot) const; // in lots() order
     bool clear();
 
     void appendLot(Lot * &&lot);
@@ -260,8 +298,13 @@ public:
     void changeLots(const std::vector<std::pair<Lot *, Lot>> &changes,
                      DocumentModel::Field hint = DocumentModel::FieldCount);
 
+    // O(1) for lots() and an unfiltered filteredLots(), O(n) for any other list
     DocumentStatistics statistics(const LotList &list, bool ignoreExcluded,
                                   bool ignorePriceAndQuantityErrors = false) const;
+    DocumentStatistics statistics(const DocumentStatistics::Totals &totals, bool ignoreExcluded,
+                                  bool ignorePriceAndQuantityErrors = false) const;
+    // incremented whenever the statistics of any lot might have changed
+    quint64 statisticsGeneration() const  { return m_statisticsGeneration; }
 
     void setLotFlagsMask(QPair<quint64, quint64> flagsMask);
 
@@ -304,6 +347,10 @@ signals:
     void modificationChanged(bool);
     void currencyCodeChanged(const QString &ccode);
     void lotCountChanged(int lotCount);
+    // the lots themselves (or their difference base) were added, removed or modified
+    void lotsInserted(const BrickLink::LotList &lots);
+    void lotsRemoved(const BrickLink::LotList &lots);
+    void lotsChanged(const BrickLink::LotList &lots);
     void filterChanged(const QVector<Filter> &filter);
     void sortColumnsChanged(const QVector<QPair<int, Qt::SortOrder>> &columns);
     void lastCommandWasVisualChanged(bool b);
@@ -321,21 +368,24 @@ private:
     void rebuildLotIndex();
     void rebuildFilteredLotIndex();
 
+    static void shareLotStrings(const LotList &lots);
     void setLotsDirect(const LotList &lots);
     void insertLotsDirect(const LotList &lots, QVector<int> &positions, QVector<int> &sortedPositions, QVector<int> &filteredPositions);
     void removeLotsDirect(const LotList &lots, QVector<int> &positions, QVector<int> &sortedPositions, QVector<int> &filteredPositions);
-    void changeLotsDirect(std::vector<std::pair<Lot *, Lot> > &changes);
+    void changeLotsDirect(const LotList &lots, QByteArray &deltas);
     void changeCurrencyDirect(const QString &ccode, double crate, double *&prices);
     void resetDifferenceModeDirect(QHash<const Lot *, Lot>
                                    &differenceBase);
     void filterDirect(const QVector<Filter> &filterList, bool &filtered,
                       LotList &unfiltered);
     void sortDirect(const QVector<QPair<int, Qt::SortOrder>> &columns, bool &sorted, LotList &unsorted);
+    void compileFilter();
 
     void emitDataChanged(const QModelIndex &tl = { }, const QModelIndex &br = { });
     void emitStatisticsChanged();
     void updateLotFlags(const Lot *lot);
     void setLotFlags(const Lot *lot, quint64 errors, quint64 updated);
+    void rebuildStatisticsTotals();
 
     void updateModified();
 
@@ -349,8 +399,34 @@ private:
     friend class SortCmd;
     friend class FilterCmd;
     friend class ResetDifferenceModeCmd;
+    friend class DocumentStatistics;
+    friend class DocumentStatistics::Totals;
 
 private:
+    // a Filter compiled for a specific column
+    using FilterMatchFn = std::function<bool(const Lot *)>;
+
+    // A lot's sort key for one column: sortDirect() extracts these once per lot, because
+    // comparing them is a lot cheaper than comparing the lots' fields, especially for strings.
+    struct SortKey {
+        enum Type : quint8 { Int, Double, String, NaturalString, CollatedString };
+
+        static SortKey fromInt(qint64 i);
+        static SortKey fromDouble(double d);
+        static SortKey fromString(const QString &str);
+        static SortKey fromNaturalString(const QString &str, qint64 secondary = 0);
+        static SortKey fromCollatedString(const QString &str, const QCollator &collator);
+
+        static int compare(const SortKey &key1, const SortKey &key2);
+
+        Type type = Int;
+        qint64 i = 0;  // Int, or the secondary key for NaturalString
+        double d = 0;  // Double
+        QString s;     // String, or the natural sort key for NaturalString
+        QString text;  // the original string for NaturalString
+        std::optional<QCollatorSortKey> collated;
+    };
+
     struct Column {
         int defaultWidth = 8;
         int alignment = Qt::AlignLeft;
@@ -364,7 +440,8 @@ private:
         std::function<void(Lot *, const QVariant &v)> setDataFn = { };
         std::function<QVariant(const Lot *)> displayFn = { };
         std::function<QVariant(const Lot *)> filterFn = { };
-        std::function<int(const Lot *, const Lot *)> compareFn;
+        std::function<FilterMatchFn(const Filter &)> compileFilterFn = { };
+        std::function<SortKey(const Lot *, const QCollator &)> sortKeyFn;
     };
     QHash<int, Column> m_columns;
 
@@ -374,6 +451,7 @@ private:
 
     mutable QHash<const Lot *, int> m_lotIndex;
     mutable QHash<const Lot *, int> m_filteredLotIndex;
+    LotMergeIndex m_mergeIndex;
 
     QHash<const Lot *, Lot> m_differenceBase;
     QVector<int>     m_fakeIndexes; // for the consolidate dialogs
@@ -383,12 +461,22 @@ private:
     std::unique_ptr<Filter::Parser> m_filterParser;
     QVector<Filter> m_filter;
 
+    struct CompiledFilter {
+        std::vector<FilterMatchFn> matchFns; // one per column, any of them needs to match
+        bool constantResult = false;         // valid if matchFns is empty
+        Filter::Combination combination;
+    };
+    std::vector<CompiledFilter> m_compiledFilter;
+
     bool m_isSorted = false;   // freshly sorted, no changes
     bool m_isFiltered = false; // freshly filtered, no changes
 
     QString          m_currencycode;
     QPair<quint64, quint64> m_lotFlagsMask = { 0, 0 };
 
+    DocumentStatistics::Totals m_statisticsTotals;
+    quint64 m_statisticsGeneration = 1;
+
     int m_fixedLotCount = 0;    // on load
     int m_invalidLotCount = 0;  // on load
 
@@ -7,6 +7,7 @@
 #include <QPointer>
 
 #include "documentmodel.h"
+#include "undo.h"
 
 
 class AddRemoveCmd : public QUndoCommand
@@ -34,7 +35,7 @@ private:
     Type               m_type;
 };
 
-class ChangeCmd : public QUndoCommand
+class ChangeCmd : public CompactableUndoCommand
 {
 public:
     ChangeCmd(DocumentModel *model, const std::vector<std::pair<Lot *, Lot>> &changes,
@@ -45,13 +46,19 @@ public:
     void redo() override;
     void undo() override;
 
+    qsizetype memoryUsage() const override;
+    qsizetype compact() override;
+
 private:
     void updateText();
+    void uncompact();
 
     DocumentModel *m_model;
     uint m_loopCount;
     DocumentModel::Field m_hint;
-    std::vector<std::pair<Lot *, Lot>> m_changes;
+    LotList m_lots;
+    QByteArray m_deltas; // one Lot delta record per entry in m_lots
+    bool m_compressed = false;
 
     static QTimer *s_eventLoopCounter;
 };
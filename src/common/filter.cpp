@@ -2,6 +2,9 @@
 // SPDX-License-Identifier: GPL-3.0-only
 
 
+#include <array>
+#include <atomic>
+
 #include <QStringList>
 #include <QCoreApplication>
 #include <QVariant>
@@ -38,10 +41,28 @@ void Filter::setExpression(const QString &expr)
     m_asDouble = loc.toDouble(expr, &isDouble);
     m_isDouble = isDouble;
 
+    m_asDoubleFixed = qRound64(m_asDouble * 1000.);
+
+    m_isRegExp = false;
     if (expr.contains(u'?') || expr.contains(u'*') || expr.contains(u'[')) {
+        static std::atomic<quint64> nextRegExpId = 0;
+
         m_isRegExp = true;
         m_asRegExp.setPattern(QRegularExpression::wildcardToRegularExpression(expr));
         m_asRegExp.setPatternOptions(QRegularExpression::CaseInsensitiveOption);
+        m_regExpId = ++nextRegExpId;
+    }
+
+    // A number formatted with the current locale can only match, if the expression doesn't
+    // contain anything besides digits, separators, signs and wildcards. If it does, we don't
+    // need to format numbers at all for the string comparisons.
+    m_couldBeNumber = expr.isEmpty() || expr.contains(u'[');
+    if (!m_couldBeNumber) {
+        const QString numberChars = loc.groupSeparator() + loc.decimalPoint() + loc.negativeSign()
+                + loc.positiveSign() + loc.exponential() + u"?*";
+        m_couldBeNumber = std::all_of(expr.cbegin(), expr.cend(), [&](QChar c) {
+            return c.isDigit() || numberChars.contains(c);
+        });
     }
     m_asDateTime = QDateTime { };
     for (auto fmt : { QLocale::LongFormat, QLocale::ShortFormat, QLocale::NarrowFormat }) {
@@ -60,6 +81,7 @@ void Filter::setExpression(const QString &expr)
             }
         }
     }
+    m_asDateTimeSecs = m_asDateTime.isValid() ? m_asDateTime.toSecsSinceEpoch() : 0;
 }
 
 void Filter::setComparison(Comparison cmp)
@@ -74,98 +96,229 @@ void Filter::setCombination(Combination cmb)
 
 bool Filter::matches(const QVariant &v) const
 {
-    static QLocale loc;
-    bool isInt = false;
-    qint64 i1 = 0, i2 = 0;
-    const QString s1 = m_expression;
-    QString s2;
-
     switch (v.userType()) {
     case QMetaType::Int:
-    case QMetaType::LongLong: {
-        if (m_isInt) {
-            i1 = m_asInt;
-            i2 = v.toInt();
-            isInt = true;
-        }
-        s2 = loc.toString(i2);
-        break;
-    }
+    case QMetaType::LongLong:
+        return matchesInt(v.toLongLong());
     case QMetaType::UInt:
-    case QMetaType::ULongLong: {
-        if (m_isInt) {
-            i1 = m_asInt;
-            i2 = v.toInt();
-            isInt = true;
-        }
-        s2 = QString::number(i2);
-        break;
-    }   
-    case QMetaType::Double: {
-        if (m_isDouble) {
-            i1 = qRound64(m_asDouble * 1000.);
-            i2 = qRound64(v.toDouble() * 1000.);
-            isInt = true;
-        }
-        s2 = loc.toString(v.toDouble(), 'f', 3);
-        break;
+    case QMetaType::ULongLong:
+        return matchesInt(v.toLongLong(), false);
+    case QMetaType::Double:
+        return matchesDouble(v.toDouble());
+    case QMetaType::QDateTime:
+        return matchesDateTime(v.toDateTime());
+    default:
+        return matchesString(QStringView { v.toString() });
     }
-    case QMetaType::QDateTime: {
-        if (m_asDateTime.isValid()) {
-            i1 = m_asDateTime.toSecsSinceEpoch();
-            i2 = v.toDateTime().toSecsSinceEpoch();
-            isInt = true;
+}
+
+bool Filter::matchesInt(qint64 i, bool localized) const
+{
+    if (m_isInt && isNumericComparison())
+        return compareNumbers(i, m_asInt);
+    else if (!m_couldBeNumber)
+        return compareString(QStringView { });
+
+    static QLocale loc;
+    return compareString(QStringView { localized ? loc.toString(i) : QString::number(i) });
+}
+
+bool Filter::matchesDouble(double d) const
+{
+    if (m_isDouble && isNumericComparison())
+        return compareNumbers(qRound64(d * 1000.), m_asDoubleFixed);
+    else if (!m_couldBeNumber)
+        return compareString(QStringView { });
+
+    static QLocale loc;
+    return compareString(QStringView { loc.toString(d, 'f', 3) });
+}
+
+bool Filter::matchesDateTime(const QDateTime &dt) const
+{
+    if (m_asDateTime.isValid() && isNumericComparison())
+        return compareNumbers(dt.toSecsSinceEpoch(), m_asDateTimeSecs);
+
+    static QLocale loc;
+    return compareString(QStringView { loc.toString(dt, QLocale::ShortFormat) });
+}
+
+bool Filter::matchesString(QStringView s) const
+{
+    return compareString(s);
+}
+
+bool Filter::matchesString(QLatin1String s) const
+{
+    return compareString(s);
+}
+
+bool Filter::isNarrowerThan(const Filter &other) const
+{
+    // an empty expression matches everything for all the string comparisons
+    if (other.m_expression.isEmpty()
+            && !Comparisons(Is | IsNot | Less | LessEqual | Greater | GreaterEqual).testFlag(other.m_comparison)) {
+        return true;
+    }
+    if ((m_field != other.m_field) || (m_comparison != other.m_comparison))
+        return false;
+    if (m_expression == other.m_expression)
+        return true;
+    // we cannot reason about wildcards
+    if (m_isRegExp || other.m_isRegExp)
+        return false;
+
+    const QString &expr = m_expression;
+    const QString &otherExpr = other.m_expression;
+
+    // an empty expression matches everything, even for the negated comparisons
+    if (expr.isEmpty()
+            && Comparisons(DoesNotMatch | DoesNotStartWith | DoesNotEndWith).testFlag(m_comparison)) {
+        return false;
+    }
+
+    switch (m_comparison) {
+    case Matches:          return expr.contains(otherExpr, Qt::CaseInsensitive);
+    case StartsWith:       return expr.startsWith(otherExpr, Qt::CaseInsensitive);
+    case EndsWith:         return expr.endsWith(otherExpr, Qt::CaseInsensitive);
+    case DoesNotMatch:     return otherExpr.contains(expr, Qt::CaseInsensitive);
+    case DoesNotStartWith: return otherExpr.startsWith(expr, Qt::CaseInsensitive);
+    case DoesNotEndWith:   return otherExpr.endsWith(expr, Qt::CaseInsensitive);
+    case Less:
+    case LessEqual:
+    case Greater:
+    case GreaterEqual: {
+        // all the interpretations of both expressions have to agree, because a filter on "Any"
+        // field compares ints, doubles and dates at the same time
+        if ((m_isInt != other.m_isInt) || (m_isDouble != other.m_isDouble)
+                || (m_asDateTime.isValid() != other.m_asDateTime.isValid())) {
+            return false;
         }
-        s2 = loc.toString(v.toDateTime(), QLocale::ShortFormat);
-        break;
+        const bool lower = (m_comparison == Less) || (m_comparison == LessEqual);
+        auto narrower = [lower](qint64 value, qint64 otherValue) {
+            return lower ? (value <= otherValue) : (value >= otherValue);
+        };
+        return (!m_isInt || narrower(m_asInt, other.m_asInt))
+                && (!m_isDouble || narrower(m_asDoubleFixed, other.m_asDoubleFixed))
+                && (!m_asDateTime.isValid() || narrower(m_asDateTimeSecs, other.m_asDateTimeSecs));
     }
-    default: {
-        s2 = v.toString();
-        break;
+    default:
+        return false;
     }
+}
+
+bool Filter::isRefinement(const QVector<Filter> &oldFilter, const QVector<Filter> &newFilter)
+{
+    // Combining with And and Or is monotonic, so narrowing any term narrows the result.
+    // Additional terms have to be appended with And though.
+    if (oldFilter.isEmpty() || (newFilter.size() < oldFilter.size()))
+        return false;
+
+    for (qsizetype i = 0; i < newFilter.size(); ++i) {
+        const Filter &f = newFilter.at(i);
+        const bool isLast = (i == (newFilter.size() - 1));
+
+        if (i < oldFilter.size()) {
+            if (!f.isNarrowerThan(oldFilter.at(i)))
+                return false;
+            if (i < (oldFilter.size() - 1)) {
+                if (f.combination() != oldFilter.at(i).combination())
+                    return false;
+                continue;
+            }
+        }
+        if (!isLast && (f.combination() != And))
+            return false;
     }
+    return true;
+}
 
-    switch (comparison()) {
+bool Filter::isNumericComparison() const
+{
+    return Comparisons(Is | IsNot | Less | LessEqual | Greater | GreaterEqual).testFlag(m_comparison);
+}
+
+bool Filter::compareNumbers(qint64 value, qint64 expression) const
+{
+    switch (m_comparison) {
+    case Is:           return value == expression;
+    case IsNot:        return value != expression;
+    case Less:         return value < expression;
+    case LessEqual:    return value <= expression;
+    case Greater:      return value > expression;
+    case GreaterEqual: return value >= expression;
+    default:           return false;
+    }
+}
+
+template <typename S> bool Filter::compareString(S s) const
+{
+    const QString &expr = m_expression;
+
+    switch (m_comparison) {
     case Is:
-        return isInt ? i2 == i1 : s2.compare(s1, Qt::CaseInsensitive) == 0;
+        return s.compare(expr, Qt::CaseInsensitive) == 0;
     case IsNot:
-        return isInt ? i2 != i1 : s2.compare(s1, Qt::CaseInsensitive) != 0;
+        return s.compare(expr, Qt::CaseInsensitive) != 0;
     case Less:
-        return isInt ? i2 < i1 : false;
     case LessEqual:
-        return isInt ? i2 <= i1 : false;
     case Greater:
-        return isInt ? i2 > i1 : false;
     case GreaterEqual:
-        return isInt ? i2 >= i1 : false;
+        return false;
     case StartsWith:
-        return s1.isEmpty() || s2.startsWith(s1, Qt::CaseInsensitive);
+        return expr.isEmpty() || s.startsWith(expr, Qt::CaseInsensitive);
     case DoesNotStartWith:
-        return s1.isEmpty() || !s2.startsWith(s1, Qt::CaseInsensitive);
+        return expr.isEmpty() || !s.startsWith(expr, Qt::CaseInsensitive);
     case EndsWith:
-        return s1.isEmpty() || s2.endsWith(s1, Qt::CaseInsensitive);
+        return expr.isEmpty() || s.endsWith(expr, Qt::CaseInsensitive);
     case DoesNotEndWith:
-        return s1.isEmpty() || !s2.endsWith(s1, Qt::CaseInsensitive);
+        return expr.isEmpty() || !s.endsWith(expr, Qt::CaseInsensitive);
     case Matches:
     case DoesNotMatch: {
-        if (s1.isEmpty()) {
+        bool res;
+        if (expr.isEmpty()) {
             return true;
         } else if (m_isRegExp) {
-            // We are using QRegularExpressions in multiple threads here, although the class is not
-            // marked thread-safe. We are relying on the const match() function to be thread-safe,
-            // which it currently is up to Qt 6.2.
-
-            bool res = m_asRegExp.match(s2).hasMatch();
-            return (comparison() == Matches) ? res : !res;
+            if constexpr (std::is_same_v<S, QStringView>) {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 5, 0)
+                res = regExp().matchView(s).hasMatch();
+#else
+                res = regExp().match(s).hasMatch();
+#endif
+            } else {
+                res = regExp().match(QString(s)).hasMatch();
+            }
         } else {
-            bool res = s2.contains(s1, Qt::CaseInsensitive);
-            return (comparison() == Matches) ? res : !res;
+            res = s.contains(expr, Qt::CaseInsensitive);
         }
+        return (m_comparison == Matches) ? res : !res;
     }
     }
     return false;
 }
 
+const QRegularExpression &Filter::regExp() const
+{
+    // QRegularExpression is not documented to be thread-safe, so every thread filtering in
+    // parallel gets its own compiled copy of the pattern
+    struct CacheEntry {
+        quint64 id = 0;
+        QRegularExpression regExp;
+    };
+    thread_local std::array<CacheEntry, 4> cache;
+    thread_local uint nextEntry = 0;
+
+    for (const auto &entry : cache) {
+        if (entry.id == m_regExpId)
+            return entry.regExp;
+    }
+    auto &entry = cache[nextEntry++ % cache.size()];
+    entry.id = m_regExpId;
+    entry.regExp = QRegularExpression(m_asRegExp.pattern(), m_asRegExp.patternOptions());
+    entry.regExp.optimize();
+    return entry.regExp;
+}
+
 QString Filter::Parser::toString(const QVector<Filter> &filter, bool preferSymbolic) const
 {
     QString result;
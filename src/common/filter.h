@@ -63,7 +63,20 @@ public:
     void setCombination(Combination cmb);
 
     bool matches(const QVariant &v) const;
-    
+
+    // typed, allocation free (in most cases) alternatives to matches()
+    bool matchesInt(qint64 i, bool localized = true) const;
+    bool matchesDouble(double d) const;
+    bool matchesDateTime(const QDateTime &dt) const;
+    bool matchesString(QStringView s) const;
+    bool matchesString(QLatin1String s) const;
+
+    // Returns true if every value matching this filter also matches the other filter
+    bool isNarrowerThan(const Filter &other) const;
+    // Returns true if the filter list newFilter can only match a subset of what oldFilter
+    // matches. The terms are evaluated left to right, without any operator precedence.
+    static bool isRefinement(const QVector<Filter> &oldFilter, const QVector<Filter> &newFilter);
+
 
     class Parser {
     public:
@@ -103,6 +116,11 @@ public:
     };
     
 private:
+    bool isNumericComparison() const;
+    bool compareNumbers(qint64 value, qint64 expression) const;
+    template <typename S> bool compareString(S s) const;
+    const QRegularExpression &regExp() const;
+
     QString     m_expression;
     int         m_field = -1;
     Comparison  m_comparison = Matches;
@@ -110,10 +128,14 @@ private:
     bool        m_isInt = false;
     bool        m_isDouble = false;
     bool        m_isRegExp = false;
+    bool        m_couldBeNumber = true;
     int         m_asInt = 0;
     double      m_asDouble = 0;
+    qint64      m_asDoubleFixed = 0;
     QDateTime   m_asDateTime;
+    qint64      m_asDateTimeSecs = 0;
     QRegularExpression m_asRegExp;
+    quint64     m_regExpId = 0;
 };
 
 QDebug &operator<<(QDebug &dbg, const Filter &filter);
@@ -0,0 +1,99 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <optional>
+
+#include <QtCore/QHash>
+
+#include "bricklink/lot.h"
+
+
+/* Groups lots by everything DocumentModel::canLotsBeMerged() compares: two different lots
+ * can be merged if and only if they have the same key. Finding the merge candidates for a
+ * lot is O(1) instead of a scan over all lots.
+ *
+ * The index does not watch the lots: whoever changes a lot's key fields has to remove() it
+ * with its old key and insert() it again.
+ */
+
+class LotMergeIndex
+{
+public:
+    struct Key
+    {
+        const BrickLink::Item *item;
+        const BrickLink::Color *color;
+        BrickLink::Condition condition;
+        BrickLink::SubCondition subCondition;
+        bool excluded;
+
+        bool operator==(const Key &other) const = default;
+
+        friend size_t qHash(const Key &key, size_t seed = 0)
+        {
+            return qHashMulti(seed, key.item, key.color, uint(key.condition),
+                              uint(key.subCondition), key.excluded);
+        }
+    };
+
+    // incomplete lots can't be merged at all
+    static std::optional<Key> key(const BrickLink::Lot &lot)
+    {
+        if (lot.isIncomplete())
+            return { };
+        return Key { lot.item(), lot.color(), lot.condition(), lot.subCondition(),
+                     lot.status() == BrickLink::Status::Exclude };
+    }
+
+    void insert(BrickLink::Lot *lot)
+    {
+        if (auto k = key(*lot))
+            insert(*k, lot);
+    }
+    void insert(const Key &key, BrickLink::Lot *lot)
+    {
+        m_buckets[key].append(lot);
+    }
+
+    void remove(BrickLink::Lot *lot)
+    {
+        if (auto k = key(*lot))
+            remove(*k, lot);
+    }
+    void remove(const Key &key, BrickLink::Lot *lot)
+    {
+        auto it = m_buckets.find(key);
+        if (it != m_buckets.end()) {
+            it->removeOne(lot);
+            if (it->isEmpty())
+                m_buckets.erase(it);
+        }
+    }
+
+    void rebuild(const BrickLink::LotList &lots)
+    {
+        clear();
+        for (auto *lot : lots)
+            insert(lot);
+    }
+    void clear()  { m_buckets.clear(); }
+
+    // all indexed lots that can be merged with lot, in insertion order
+    BrickLink::LotList candidates(const BrickLink::Lot &lot) const
+    {
+        BrickLink::LotList result;
+        if (auto k = key(lot)) {
+            result = m_buckets.value(*k);
+            result.removeOne(const_cast<BrickLink::Lot *>(&lot));
+        }
+        return result;
+    }
+
+    // the groups of lots that can be merged with each other, including single lots
+    const QHash<Key, BrickLink::LotList> &groups() const  { return m_buckets; }
+
+private:
+    QHash<Key, BrickLink::LotList> m_buckets;
+};
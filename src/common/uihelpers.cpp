@@ -1,8 +1,12 @@
 // Copyright (C) 2004-2023 Robert Griebl
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <atomic>
+
 #include <QCoreApplication>
 #include <QFileInfo>
+#include <QPointer>
+#include <QThreadPool>
 
 #include <QCoro/QCoroCore>
 
@@ -87,4 +91,71 @@ void UIHelpers::showToastMessageHelper(const QString &message, int timeout)
     processToastMessages();
 }
 
+class UIHelpersWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    UIHelpersWorker(std::function<void(const std::function<bool(int, int)> &)> work)
+        : m_work(std::move(work))
+    { }
+
+    bool isRunning() const   { return m_running; }
+    bool isCanceled() const  { return m_canceled; }
+
+    void start()
+    {
+        m_running = true;
+        QThreadPool::globalInstance()->start([this]() {
+            m_work([this](int done, int total) {
+                if (m_canceled)
+                    return false;
+                QMetaObject::invokeMethod(this, [this, done, total]() {
+                    emit progress(done, total);
+                }, Qt::QueuedConnection);
+                return true;
+            });
+            QMetaObject::invokeMethod(this, [this]() {
+                m_running = false;
+                // both signals can resume the waiting coroutine, which deletes this object
+                QPointer<UIHelpersWorker> that(this);
+                emit workDone();
+                if (that)
+                    emit finished(!m_canceled, { });
+            }, Qt::QueuedConnection);
+        });
+    }
+
+    void cancel()
+    {
+        m_canceled = true;
+    }
+
+signals:
+    void progress(int done, int total);
+    void finished(bool success, const QString &message);
+    void workDone();
+
+private:
+    std::function<void(const std::function<bool(int, int)> &)> m_work;
+    std::atomic<bool> m_canceled = false;
+    bool m_running = false;
+};
+
+QCoro::Task<bool> UIHelpers::runWithProgressDialog(QString title, QString message,
+                                                   std::function<void(const std::function<bool(int, int)> &)> work)
+{
+    UIHelpersWorker worker(std::move(work));
+
+    bool success = co_await progressDialog(title, message, &worker, &UIHelpersWorker::progress,
+                                           &UIHelpersWorker::finished, &UIHelpersWorker::start,
+                                           &UIHelpersWorker::cancel);
+
+    // canceling closes the dialog right away, but 'work' references the caller's data
+    if (worker.isRunning())
+        co_await qCoro(&worker, &UIHelpersWorker::workDone);
+    co_return success && !worker.isCanceled();
+}
+
 #include "moc_uihelpers.cpp"
+#include "uihelpers.moc"
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include <functional>
 #include <limits>
 
 #include <QObject>
@@ -162,6 +163,12 @@ public:
         co_return co_await pd->exec();
     }
 
+    // Runs 'work' on a worker thread, while a progress dialog is shown. 'work' gets a progress
+    // function to call every now and then, which returns false once the user canceled. Waits
+    // for 'work' to return in any case and returns false if it was canceled.
+    static QCoro::Task<bool> runWithProgressDialog(QString title, QString message,
+                                                   std::function<void(const std::function<bool(int, int)> &)> work);
+
     static void toast(const QString &message, int timeout = 3000) {
         inst()->showToastMessageHelper(message, timeout);
     }
@@ -1,12 +1,79 @@
 // Copyright (C) 2004-2023 Robert Griebl
 // SPDX-License-Identifier: GPL-3.0-only
 
+#include <QTimer>
+
+#include "utility/appstatistics.h"
+#include "common/config.h"
 #include "undo.h"
 
 
+qsizetype UndoStack::s_totalMemoryUsage = 0;
+int UndoStack::s_memoryStatId = -1;
+
 UndoStack::UndoStack(QObject *parent)
     : QUndoStack(parent)
-{ }
+    , m_checkMemoryUsage(new QTimer(this))
+{
+    if (s_memoryStatId < 0)
+        s_memoryStatId = AppStatistics::inst()->addSource(u"Undo memory usage"_qs, u"KB"_qs);
+
+    // pushes and macros have to be finished before we can look at the commands
+    m_checkMemoryUsage->setSingleShot(true);
+    m_checkMemoryUsage->setInterval(0);
+    connect(m_checkMemoryUsage, &QTimer::timeout,
+            this, &UndoStack::checkMemoryUsage);
+    connect(this, &QUndoStack::indexChanged,
+            m_checkMemoryUsage, qOverload<>(&QTimer::start));
+
+    setMemoryLimit(qsizetype(Config::inst()->undoMemoryLimit()) * 1'000'000);
+    connect(Config::inst(), &Config::undoMemoryLimitChanged,
+            this, [this](int mb) { setMemoryLimit(qsizetype(mb) * 1'000'000); });
+}
+
+UndoStack::~UndoStack()
+{
+    s_totalMemoryUsage -= m_memoryUsage;
+    AppStatistics::inst()->update(s_memoryStatId, s_totalMemoryUsage / 1000);
+}
+
+void UndoStack::setMemoryLimit(qsizetype bytes)
+{
+    if (bytes != m_memoryLimit) {
+        m_memoryLimit = bytes;
+        m_checkMemoryUsage->start();
+    }
+}
+
+void UndoStack::checkMemoryUsage()
+{
+    // the commands in the stack, with all their children
+    QVector<CompactableUndoCommand *> commands;
+    for (int i = 0; i < count(); ++i) {
+        QVector<const QUndoCommand *> todo { command(i) };
+        while (!todo.isEmpty()) {
+            const QUndoCommand *cmd = todo.takeLast();
+            if (auto ccmd = dynamic_cast<const CompactableUndoCommand *>(cmd))
+                commands << const_cast<CompactableUndoCommand *>(ccmd);
+            for (int c = cmd->childCount() - 1; c >= 0; --c)
+                todo << cmd->child(c);
+        }
+    }
+
+    qsizetype usage = 0;
+    for (const auto *cmd : std::as_const(commands))
+        usage += cmd->memoryUsage();
+
+    // QUndoStack cannot drop its oldest commands, so compact them instead
+    if (m_memoryLimit > 0) {
+        for (auto it = commands.cbegin(); (it != commands.cend()) && (usage > m_memoryLimit); ++it)
+            usage -= (*it)->compact();
+    }
+
+    s_totalMemoryUsage += (usage - m_memoryUsage);
+    m_memoryUsage = usage;
+    AppStatistics::inst()->update(s_memoryStatId, s_totalMemoryUsage / 1000);
+}
 
 void UndoStack::redoMultiple(int count)
 {
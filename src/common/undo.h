@@ -7,6 +7,20 @@
 #include <QUndoGroup>
 
 QT_FORWARD_DECLARE_CLASS(QAction)
+QT_FORWARD_DECLARE_CLASS(QTimer)
+
+
+// An undo command that knows its (approximate) memory footprint. If an UndoStack goes over its
+// memory limit, it compacts the oldest of these commands first.
+class CompactableUndoCommand : public QUndoCommand
+{
+public:
+    using QUndoCommand::QUndoCommand;
+
+    virtual qsizetype memoryUsage() const = 0;
+    // returns the number of bytes freed
+    virtual qsizetype compact()  { return 0; }
+};
 
 
 class UndoStack : public QUndoStack
@@ -15,13 +29,28 @@ class UndoStack : public QUndoStack
 
 public:
     UndoStack(QObject *parent = nullptr);
+    ~UndoStack() override;
 
     // workaround as long as I haven't added that to Qt
     void endMacro(const QString &str);
 
+    qsizetype memoryUsage() const  { return m_memoryUsage; }
+    qsizetype memoryLimit() const  { return m_memoryLimit; }
+    void setMemoryLimit(qsizetype bytes);
+
 public slots:
     void redoMultiple(int count);
     void undoMultiple(int count);
+
+private:
+    void checkMemoryUsage();
+
+    qsizetype m_memoryUsage = 0;
+    qsizetype m_memoryLimit = 0;
+    QTimer *m_checkMemoryUsage;
+
+    static qsizetype s_totalMemoryUsage;
+    static int s_memoryStatId;
 };
 
 
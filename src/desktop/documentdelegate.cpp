@@ -334,16 +334,15 @@ void DocumentDelegate::paint(QPainter *p, const QStyleOptionViewItem &option, co
         break;
 
     case DocumentModel::Picture: {
-        image = display.value<QImage>();
         double dpr = p->device()->devicePixelRatioF();
         QSize s = option.rect.size();
 
-        if (!image.isNull()) {
-            image = image.scaled(s * dpr, Qt::KeepAspectRatio, Qt::FastTransformation);
-            image.setDevicePixelRatio(dpr);
-        } else {
+        // the picture cache keeps pre-scaled thumbnails for size buckets: there's no smooth
+        // scaling while painting, not even on a cache miss
+        if (auto *pic = BrickLink::core()->pictureCache()->picture(lot->item(), lot->color()))
+            image = pic->thumbnail(s, dpr);
+        if (image.isNull())
             image = BrickLink::core()->noImage(s);
-        }
 
         selectionFrame = true;
         break;
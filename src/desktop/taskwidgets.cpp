@@ -239,9 +239,9 @@ void TaskInfoWidget::delayedSelectionUpdate()
         m_pic->setItemAndColor(m_selection.constFirst()->item(), m_selection.constFirst()->color());
         setCurrentWidget(m_pic);
     } else {
-        auto stat = m_document->model()->statistics(m_selection.isEmpty() ? m_document->model()->lots()
-                                                                          : m_selection,
-                                                    false /* ignoreExcluded */);
+        auto stat = m_selection.isEmpty()
+                ? m_document->model()->statistics(m_document->model()->lots(), false /* ignoreExcluded */)
+                : m_document->selectionStatistics(false /* ignoreExcluded */);
 
         QString s = u"<h3>%1</h3>"_qs
                 .arg(m_selection.isEmpty() ? tr("Document statistics") : tr("Multiple lots selected"))
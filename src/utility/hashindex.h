@@ -0,0 +1,78 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <vector>
+#include <bit>
+
+#include <QtGlobal>
+
+
+/* An immutable, open-addressing hash table (linear probing, load factor <= 0.5), mapping hash
+ * values to indexes into an external, contiguous container.
+ *
+ * The keys themselves are not stored: a candidate index is verified by the caller against the
+ * container element, so lookups never allocate. Each slot also stores some of the hash bits,
+ * which avoids most of these comparisons for collisions.
+ */
+
+class HashIndex
+{
+public:
+    template<typename Container, typename HashFunction>
+    void build(const Container &container, HashFunction hashFunction)
+    {
+        const size_t count = container.size();
+        Q_ASSERT(count < Empty);
+
+        const size_t tableSize = std::bit_ceil(std::max(size_t(16), count * 2));
+        m_table.assign(tableSize, Entry { });
+        m_mask = tableSize - 1;
+
+        for (size_t i = 0; i < count; ++i) {
+            const size_t hash = hashFunction(container[i]);
+            size_t pos = hash & m_mask;
+            while (m_table[pos].index != Empty)
+                pos = (pos + 1) & m_mask;
+            m_table[pos] = { tag(hash), quint32(i) };
+        }
+    }
+
+    // returns the container index for which matches(index) returned true, or -1
+    template<typename Matches>
+    qsizetype find(size_t hash, Matches matches) const
+    {
+        if (m_table.empty())
+            return -1;
+
+        const quint32 hashTag = tag(hash);
+        for (size_t pos = hash & m_mask; m_table[pos].index != Empty; pos = (pos + 1) & m_mask) {
+            const Entry &e = m_table[pos];
+            if ((e.tag == hashTag) && matches(e.index))
+                return qsizetype(e.index);
+        }
+        return -1;
+    }
+
+    bool isEmpty() const      { return m_table.empty(); }
+    void clear()              { m_table.clear(); m_table.shrink_to_fit(); m_mask = 0; }
+    size_t memoryUsage() const  { return m_table.capacity() * sizeof(Entry); }
+
+private:
+    static constexpr quint32 Empty = 0xffffffff;
+
+    struct Entry {
+        quint32 tag = 0;
+        quint32 index = Empty;
+    };
+    Q_STATIC_ASSERT(sizeof(Entry) == 8);
+
+    static constexpr quint32 tag(size_t hash)
+    {
+        return quint32(hash) ^ quint32(quint64(hash) >> 32);
+    }
+
+    std::vector<Entry> m_table;
+    size_t m_mask = 0;
+};
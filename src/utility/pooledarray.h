@@ -132,6 +132,15 @@ public:
         return { *this, mr };
     }
 
+    // Raw access to the underlying storage: the size (as T sized integer) followed by the
+    // elements. The database uses this to reference a memory mapped file without copying.
+    // Arrays set up via setRawData() are read-only and must never be resized.
+    using SizeType = typename QIntegerForSizeof<T>::Signed;
+
+    const void *rawData() const { return data; }
+    qsizetype rawDataSize() const { return data ? (size() + 1) * qsizetype(sizeof(T)) : 0; }
+    void setRawData(const void *raw) { data = static_cast<T *>(const_cast<void *>(raw)); }
+
 private:
     const typename QIntegerForSizeof<T>::Signed &sizeRef(const T *t) const
     {
@@ -0,0 +1,267 @@
+// Copyright (C) 2004-2023 Robert Griebl
+// SPDX-License-Identifier: GPL-3.0-only
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QSemaphore>
+#include <QtCore/QVector>
+
+
+//#define PRIORITYWORKQUEUE_TESTING // benchmarking
+
+
+/* A work queue for a pool of consumer threads, with two priority levels:
+ * high priority entries are served newest first, low priority entries oldest first.
+ *
+ * Entries are distributed over one shard per consumer thread (by hashing the entry), so
+ * producers and consumers rarely contend on the same mutex. Consumers take from their own
+ * shard first and steal from the other shards, high priority entries first.
+ *
+ * Each shard keeps its entries in a sequence ordered map plus a hash, so that adding,
+ * re-prioritizing and removing an entry are all O(log n).
+ */
+
+template <typename T>
+class PriorityWorkQueue
+{
+public:
+    explicit PriorityWorkQueue(int shardCount)
+    {
+        m_shards.resize(size_t(std::max(shardCount, 1)));
+        for (auto &shard : m_shards)
+            shard = std::make_unique<Shard>();
+    }
+
+    // Returns false if t was already queued: it was only re-prioritized in that case. Adding
+    // an entry again never lowers its priority.
+    bool add(const T &t, bool highPriority)
+    {
+        Shard &shard = shardFor(t);
+        QMutexLocker locker(&shard.mutex);
+        auto it = shard.index.constFind(t);
+        const bool isNew = (it == shard.index.cend());
+        if (isNew) {
+            shard.insert(t, highPriority);
+        } else if (highPriority) { // high priority always moves to the front
+            shard.queue.erase(it.value());
+            shard.insert(t, true);
+        }
+        locker.unlock();
+
+        if (isNew) {
+            m_size.fetchAndAddRelaxed(1);
+            m_available.release();
+        }
+        return isNew;
+    }
+
+    // returns false if t is not queued
+    bool reprioritize(const T &t, bool highPriority)
+    {
+        Shard &shard = shardFor(t);
+        QMutexLocker locker(&shard.mutex);
+        auto it = shard.index.constFind(t);
+        if (it == shard.index.cend())
+            return false;
+        if (highPriority || (it.value() < 0)) { // high priority always moves to the front
+            shard.queue.erase(it.value());
+            shard.insert(t, highPriority);
+        }
+        return true;
+    }
+
+    // returns false if t is not queued
+    bool remove(const T &t)
+    {
+        Shard &shard = shardFor(t);
+        QMutexLocker locker(&shard.mutex);
+        auto seq = shard.index.take(t);
+        if (!seq)
+            return false;
+        shard.queue.erase(seq);
+        locker.unlock();
+
+        m_size.fetchAndSubRelaxed(1);
+        // a consumer might have already acquired the permit for this entry: it will just
+        // come back empty-handed in that case
+        m_available.tryAcquire();
+        return true;
+    }
+
+    // Blocks until at least one entry is available and returns up to maxCount entries
+    // (including their priority), but not more than a fair share for each shard. Returns an
+    // empty list after abort() or if another consumer was faster.
+    QVector<std::pair<T, bool>> take(int consumerIndex, qsizetype maxCount)
+    {
+        m_available.acquire();
+        if (m_aborted.loadRelaxed()) {
+            m_available.release(); // wake the next consumer
+            return { };
+        }
+
+        // grab a few more, if available
+        qsizetype count = 1;
+        if (maxCount > 1) {
+            auto more = std::min(maxCount - 1,
+                                 qsizetype(m_available.available()) / qsizetype(m_shards.size()));
+            if ((more > 0) && m_available.tryAcquire(int(more)))
+                count += more;
+        }
+
+        QVector<std::pair<T, bool>> result;
+        result.reserve(count);
+
+        // high priority entries from all shards, then low priority ones
+        for (bool highPriority : { true, false }) {
+            for (size_t i = 0; (i < m_shards.size()) && (result.size() < count); ++i) {
+                Shard &shard = *m_shards[(size_t(consumerIndex) + i) % m_shards.size()];
+                QMutexLocker locker(&shard.mutex);
+
+                while ((result.size() < count) && !shard.queue.empty()) {
+                    auto it = shard.queue.begin();
+                    if ((it->first < 0) != highPriority)
+                        break;
+                    result.append({ it->second, highPriority });
+                    shard.index.remove(it->second);
+                    shard.queue.erase(it);
+                }
+            }
+        }
+        m_size.fetchAndSubRelaxed(int(result.size()));
+        return result;
+    }
+
+    // removes and returns all entries
+    QVector<T> takeAll()
+    {
+        QVector<T> result;
+        for (auto &shard : m_shards) {
+            QMutexLocker locker(&shard->mutex);
+            for (const auto &[seq, t] : shard->queue)
+                result.append(t);
+            shard->queue.clear();
+            shard->index.clear();
+        }
+        m_size.fetchAndSubRelaxed(int(result.size()));
+        return result;
+    }
+
+    // makes all current and future take() calls return immediately
+    void abort()
+    {
+        m_aborted.storeRelaxed(1);
+        m_available.release(int(m_shards.size()));
+    }
+
+    qsizetype size() const  { return m_size.loadRelaxed(); }
+
+private:
+    struct Shard
+    {
+        QMutex mutex;
+        std::map<qint64, T> queue;   // key: sequence number, negative for high priority
+        QHash<T, qint64> index;
+        qint64 nextHigh = -1;
+        qint64 nextLow = 1;
+
+        void insert(const T &t, bool highPriority)
+        {
+            qint64 seq = highPriority ? nextHigh-- : nextLow++;
+            queue.emplace(seq, t);
+            index.insert(t, seq);
+        }
+    };
+
+    Shard &shardFor(const T &t)
+    {
+        return *m_shards[qHash(t) % m_shards.size()];
+    }
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    QSemaphore m_available;
+    QAtomicInt m_size = 0;
+    QAtomicInt m_aborted = 0;
+};
+
+
+#ifdef PRIORITYWORKQUEUE_TESTING // benchmarking
+#include <QtCore/QThread>
+#include "stopwatch.h"
+
+static struct test_priority_work_queue
+{
+    test_priority_work_queue()
+    {
+        static constinit bool once = true;
+        if (!once)
+            return;
+        once = false;
+
+        static constexpr int count = 100'000;
+        static constexpr int consumers = 8;
+
+        QVector<quintptr> keys(count);
+        for (int i = 0; i < count; ++i)
+            keys[i] = quintptr(i + 1) * 64;
+
+        {
+            // the previous implementation: a QVector protected by a single mutex
+            QMutex mutex;
+            QVector<std::pair<quintptr, bool>> queue;
+
+            stopwatch sw("QVector: 100k enqueues");
+            for (int i = 0; i < count; ++i) {
+                QMutexLocker locker(&mutex);
+                queue.insert((i % 2) ? 0 : queue.size(), { keys[i], (i % 2) == 1 });
+            }
+            sw.restart("QVector: 10k reprioritizes");
+            for (int i = 0; i < count; i += 10) {
+                QMutexLocker locker(&mutex);
+                for (auto j = 0; j < queue.size(); ++j) {
+                    if (queue[j].first == keys[i]) {
+                        queue[j].second = true;
+                        queue.move(j, 0);
+                        break;
+                    }
+                }
+            }
+        }
+        {
+            PriorityWorkQueue<quintptr> queue(consumers);
+
+            stopwatch sw("PriorityWorkQueue: 100k enqueues");
+            for (int i = 0; i < count; ++i)
+                queue.add(keys[i], (i % 2) == 1);
+            sw.restart("PriorityWorkQueue: 10k reprioritizes");
+            for (int i = 0; i < count; i += 10)
+                queue.reprioritize(keys[i], true);
+
+            sw.restart("PriorityWorkQueue: 100k takes by 8 threads");
+            QVector<QThread *> threads;
+            QAtomicInt done = 0;
+            for (int t = 0; t < consumers; ++t) {
+                threads << QThread::create([&queue, &done, t]() {
+                    while (!done.loadRelaxed())
+                        queue.take(t, 64);
+                });
+                threads.constLast()->start();
+            }
+            while (queue.size())
+                QThread::yieldCurrentThread();
+            done.storeRelaxed(1);
+            queue.abort();
+            for (auto *thread : threads) {
+                thread->wait();
+                delete thread;
+            }
+        }
+    }
+} test_priority_work_queue_instance;
+
+#endif
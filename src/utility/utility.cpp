@@ -96,6 +96,38 @@ int Utility::naturalCompare(const QString &name1, const QString &name2)
     }
 }
 
+QString Utility::naturalSortKey(const QString &str)
+{
+    // White space is skipped. A run of digits is encoded as '0' (so that it compares to other
+    // characters just like a digit would), followed by the number of digits (longer numbers
+    // are larger) and the digit values.
+    QString key;
+    key.reserve(str.size() + 2);
+
+    const QChar *p = str.constData();
+    const QChar *pe = p + str.size();
+
+    while (p < pe) {
+        if (p->isSpace()) {
+            ++p;
+        } else if (p->isDigit()) {
+            key.append(u'0');
+            const auto lengthPos = key.size();
+            key.append(QChar(0));
+            char16_t length = 0;
+            while ((p < pe) && p->isDigit()) {
+                key.append(QChar(char16_t(u'0' + p->digitValue())));
+                ++length;
+                ++p;
+            }
+            key[lengthPos] = QChar(length);
+        } else {
+            key.append(*p++);
+        }
+    }
+    return key;
+}
+
 QColor Utility::gradientColor(const QColor &c1, const QColor &c2, float f)
 {
     float r1, g1, b1, a1, r2, g2, b2, a2;
@@ -35,6 +35,10 @@ constexpr bool fuzzyCompare(double d1, double d2) // just like qFuzzyCompare, bu
 }
 
 int naturalCompare(const QString &s1, const QString &s2);
+// Comparing two of these keys via QString::compare() gives the same result as naturalCompare()
+// on the original strings, except for strings that are "naturally" equal (e.g. "a 1" and "a1"):
+// naturalCompare() falls back to localeAwareCompare() on the original strings for these.
+QString naturalSortKey(const QString &str);
 
 QColor gradientColor(const QColor &c1, const QColor &c2, float f = 0.5);
 QColor textColor(const QColor &backgroundColor);